@@ -3,12 +3,12 @@
    Program:    calcpdbdist
    File:       calcpdbdist.c
    
-   Version:    V1.0
-   Date:       11.12.17
+   Version:    V1.2
+   Date:       16.10.26
    Function:   Calculate the distance between C-alpha atoms of the 
                two residues specified on the command line
    
-   Copyright:  (c) UCL / Dr. Andrew C. R. Martin 2017
+   Copyright:  (c) UCL / Dr. Andrew C. R. Martin 2017-2026
    Author:     Dr. Andrew C. R. Martin
    Address:    Biomolecular Structure & Modelling Unit,
                Institute of Structural & Molecular Biology,
@@ -40,6 +40,24 @@
 
    Should this be modified to work only with sidechain atoms???
 
+   With -m, the distances between the C-alphas of all residues are 
+   written as a binary matrix of 32-bit floats. The file starts with a
+   16-byte header: the characters "CAMATRX1", the number of residues (n)
+   and the band width (b), both as native 32-bit ints. There follow n 
+   rows, each of n distances or, with a band (-b), b+1 distances where 
+   item k of row i is the distance from residue i to residue i+k. The
+   residues are numbered through the whole file, so a band runs on 
+   across chain breaks into the next chain; only items past the last 
+   residue in the file are NaN. A band of n-1 or more gives the full 
+   matrix, with b written as 0. The residue labels are written one per
+   line to a sidecar file with .labels appended to the matrix file name.
+
+   With -q, pairs of residues are read from a query file, one pair per
+   line, and the distance for each is written as "res1 res2 distance" 
+   (or "res1 res2 NULL" if the distance cannot be calculated). The 
+   residues are looked up through a residue index so the PDB file is 
+   read only once.
+
 **************************************************************************
 
    Usage:
@@ -50,23 +68,56 @@
    Revision History:
    =================
    V1.0   11.12.18   Original   By: ACRM
+   V1.1   16.10.26   Added -m, -b and -M for the C-alpha distance matrix
+                     By: agent
+   V1.2   16.10.26   Added -q for a file of residue pairs. Residues are
+                     found through a residue index   By: agent
 
 *************************************************************************/
 /* Includes
 */
+#define _POSIX_C_SOURCE 200112L
 #include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
 #include <math.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/mman.h>
 #include "bioplib/macros.h"
 #include "bioplib/MathType.h"
 #include "bioplib/SysDefs.h"
 #include "bioplib/pdb.h"
 #include "bioplib/general.h"
 #include "bioplib/array.h"
+#include "resindex.h"
 
 /************************************************************************/
 /* Defines and macros
 */
 #define MAXBUFF 160
+#define MATRIXMAGIC   "CAMATRX1"
+#define LABELEXT      ".labels"
+#define SIMDALIGN     32      /* Alignment of the coordinate arrays      */
+
+/* C-alpha coordinates as separate x, y and z arrays for the distance
+   kernel
+*/
+typedef struct
+{
+   float *x, *y, *z;
+   PDB   **ca;
+   int   nRes;
+}  CACOORDS;
+
+typedef struct
+{
+   char magic[8];
+   int  nRes,
+        band;
+}  MATRIXHEADER;
 
 /************************************************************************/
 /* Globals
@@ -77,9 +128,23 @@
 */
 int main(int argc, char **argv);
 BOOL ParseCmdLine(int argc, char **argv, char *res1, char *res2,
-                  char *infile, char *outfile);
+                  char *infile, char *outfile, char *matrixFile,
+                  int *band, BOOL *useMmap, char *queryFile);
+BOOL CheckModes(char *matrixFile, char *queryFile, BOOL matrixOpts);
 void Usage(void);
-REAL CalcDistance(PDB *pdb, char *res1, char *res2);
+REAL CalcDistance(RESINDEX *index, char *res1, char *res2);
+BOOL RunQueries(FILE *out, RESINDEX *index, char *queryFile);
+BOOL ExtractCACoords(PDB *pdb, CACOORDS *coords);
+void FreeCACoords(CACOORDS *coords);
+float *AllocAligned(int n);
+void CalcDistanceRow(const float *restrict x, const float *restrict y,
+                     const float *restrict z, float xi, float yi, 
+                     float zi, int n, float *restrict row);
+void CalcMatrixRow(CACOORDS *coords, int i, int band, float *row);
+BOOL WriteDistanceMatrix(char *matrixFile, CACOORDS *coords, int band,
+                         BOOL useMmap);
+BOOL WriteResidueLabels(char *matrixFile, CACOORDS *coords);
+void BuildLabel(PDB *p, char *label);
 
 /************************************************************************/
 /*>int main(int argc, char **argv)
@@ -88,6 +153,8 @@ REAL CalcDistance(PDB *pdb, char *res1, char *res2);
    Main program
 
 -  11.12.17   Original   By: ACRM
+-  16.10.26   Added matrix mode   By: agent
+-  16.10.26   Added query file mode and residue index   By: agent
 */
 int main(int argc, char **argv)
 {
@@ -95,10 +162,15 @@ int main(int argc, char **argv)
         *out = stdout;
    char InFile[MAXBUFF],
         OutFile[MAXBUFF],
+        MatrixFile[MAXBUFF],
+        QueryFile[MAXBUFF],
         res1[MAXBUFF],
         res2[MAXBUFF];
+   int  band    = 0;
+   BOOL useMmap = FALSE;
 
-   if(ParseCmdLine(argc, argv, res1, res2, InFile, OutFile))
+   if(ParseCmdLine(argc, argv, res1, res2, InFile, OutFile, MatrixFile,
+                   &band, &useMmap, QueryFile))
    {
       if(blOpenStdFiles(InFile, OutFile, &in, &out))
       {
@@ -107,9 +179,46 @@ int main(int argc, char **argv)
          
          if((pdb=blReadPDB(in, &natom))!=NULL)
          {
-            REAL d;
+            RESINDEX *index;
+            REAL     d;
+
+            if(MatrixFile[0])
+            {
+               CACOORDS coords;
+               BOOL     ok;
+               
+               if(!ExtractCACoords(pdb, &coords))
+               {
+                  fprintf(stderr,"calcpdbdistances: (Error) No memory \
+for C-alpha coordinates\n");
+                  return(1);
+               }
+               /* A band reaching the last residue is the full matrix   */
+               if(band >= coords.nRes-1)
+                  band = 0;
+               ok = WriteDistanceMatrix(MatrixFile, &coords, band, 
+                                        useMmap) &&
+                    WriteResidueLabels(MatrixFile, &coords);
+               FreeCACoords(&coords);
+               FREELIST(pdb, PDB);
+               return(ok ? 0 : 1);
+            }
+            
+            if((index = BuildResidueIndex(pdb))==NULL)
+            {
+               fprintf(stderr,"calcpdbdistances: (Error) No memory \
+for residue index\n");
+               return(1);
+            }
+
+            if(QueryFile[0])
+            {
+               if(!RunQueries(out, index, QueryFile))
+                  return(1);
+               return(0);
+            }
             
-            d = CalcDistance(pdb, res1, res2);
+            d = CalcDistance(index, res1, res2);
             if(d < 0.0)
             {
                return(1);
@@ -143,7 +252,8 @@ file\n");
 
 /************************************************************************/
 /*>BOOL ParseCmdLine(int argc, char **argv, char *res1, char *res2,
-                     char *infile, char *outfile)
+                     char *infile, char *outfile, char *matrixFile,
+                     int *band, BOOL *useMmap, char *queryFile)
    -----------------------------------------------------------------
 *//**
 
@@ -153,19 +263,35 @@ file\n");
    \param[out]     *res2                Second key residue
    \param[out]     *infile              Input file (or blank string)
    \param[out]     *outfile             Output file (or blank string)
+   \param[out]     *matrixFile          Distance matrix file (or blank
+                                        string)
+   \param[out]     *band                Band width (0 for full matrix)
+   \param[out]     *useMmap             Write the matrix through mmap()
+   \param[out]     *queryFile           File of residue pairs (or blank
+                                        string)
    \return                              Success?
 
-   Parse the command line
+   Parse the command line. In matrix mode there are no residues and the
+   only file is the input file. In query mode there are no residues on
+   the command line.
 
 -  11.12.17  Original   By: ACRM   
+-  16.10.26  Added -m, -b and -M   By: agent
+-  16.10.26  Added -q   By: agent
+-  17.10.26  Rejects -b and -M without -m, and -m with -q   By: agent
 */
 BOOL ParseCmdLine(int argc, char **argv, char *res1, char *res2, 
-                  char *infile, char *outfile)
+                  char *infile, char *outfile, char *matrixFile,
+                  int *band, BOOL *useMmap, char *queryFile)
 {
+   BOOL matrixOpts = FALSE;
+   
    argc--;
    argv++;
 
-   infile[0] = outfile[0] = '\0';
+   infile[0] = outfile[0] = matrixFile[0] = queryFile[0] = '\0';
+   *band     = 0;
+   *useMmap  = FALSE;
    res1[0]                = '\0';
    res2[0]                = '\0';
    
@@ -189,12 +315,62 @@ BOOL ParseCmdLine(int argc, char **argv, char *res1, char *res2,
             case 'h':
                return(FALSE);
                break;
+            case 'm':
+               argc--;
+               argv++;
+               if(!argc)
+                  return(FALSE);
+               strncpy(matrixFile, argv[0], MAXBUFF-strlen(LABELEXT));
+               matrixFile[MAXBUFF-strlen(LABELEXT)-1] = '\0';
+               break;
+            case 'b':
+               argc--;
+               argv++;
+               if(!argc || (sscanf(argv[0], "%d", band) != 1) ||
+                  (*band < 0))
+                  return(FALSE);
+               matrixOpts = TRUE;
+               break;
+            case 'M':
+               *useMmap   = TRUE;
+               matrixOpts = TRUE;
+               break;
+            case 'q':
+               argc--;
+               argv++;
+               if(!argc)
+                  return(FALSE);
+               strncpy(queryFile, argv[0], MAXBUFF);
+               queryFile[MAXBUFF-1] = '\0';
+               break;
             default:
                return(FALSE);
                break;
             }
          }         
       }
+      else if(!CheckModes(matrixFile, queryFile, matrixOpts))
+      {
+         return(FALSE);
+      }
+      else if(matrixFile[0])
+      {
+         /* Just the input file in matrix mode                          */
+         if(argc > 1)
+            return(FALSE);
+         strcpy(infile, argv[0]);
+         return(TRUE);
+      }
+      else if(queryFile[0])
+      {
+         /* Input and output files in query mode                        */
+         if(argc > 2)
+            return(FALSE);
+         strcpy(infile, argv[0]);
+         if(argc > 1)
+            strcpy(outfile, argv[1]);
+         return(TRUE);
+      }
       else
       {
          /* Check that there are 2, 3 or 4 arguments left               */
@@ -231,6 +407,35 @@ BOOL ParseCmdLine(int argc, char **argv, char *res1, char *res2,
       argc--;
       argv++;
    }
+   
+   /* Residues are needed unless making a matrix or reading queries     */
+   return(CheckModes(matrixFile, queryFile, matrixOpts) &&
+          ((matrixFile[0] != '\0') || (queryFile[0] != '\0')));
+}
+
+
+/************************************************************************/
+/*>BOOL CheckModes(char *matrixFile, char *queryFile, BOOL matrixOpts)
+   -------------------------------------------------------------------
+*//**
+   \param[in]      *matrixFile          Distance matrix file (or blank
+                                        string)
+   \param[in]      *queryFile           File of residue pairs (or blank
+                                        string)
+   \param[in]      matrixOpts           Were -b or -M given?
+   \return                              Are the options consistent?
+
+   Checks that -b and -M are only used with -m, and that -m and -q are
+   not used together
+
+-  17.10.26  Original   By: agent
+*/
+BOOL CheckModes(char *matrixFile, char *queryFile, BOOL matrixOpts)
+{
+   if(matrixFile[0] && queryFile[0])
+      return(FALSE);
+   if(matrixOpts && !matrixFile[0])
+      return(FALSE);
    return(TRUE);
 }
 
@@ -242,32 +447,60 @@ BOOL ParseCmdLine(int argc, char **argv, char *res1, char *res2,
    Prints a usage message
 
 -  11.12.17  Original   By: ACRM
+-  16.10.26  Added -m, -b and -M   By: agent
+-  16.10.26  Added -q   By: agent
+-  17.10.26  Notes that -b and -M need -m   By: agent
 */
 void Usage(void)
 {
-   fprintf(stderr, "\ncalcpdbdistance V1.0 (c) 2017 UCL, Dr. Andrew C.R. \
-Martin\n");
+   fprintf(stderr, "\ncalcpdbdistance V1.2 (c) 2017-2026 UCL, Dr. Andrew \
+C.R. Martin\n");
 
    fprintf(stderr, "\nUsage: calcpdbdistance res1 res2 \
 [in.pdb [out.txt]]\n");
+   fprintf(stderr, "       calcpdbdistance -m matrix.bin [-b band] [-M] \
+[in.pdb]\n");
+   fprintf(stderr, "       -m Write the distance matrix for all \
+C-alphas\n");
+   fprintf(stderr, "       -b Only calculate distances to the next band \
+residues\n");
+   fprintf(stderr, "          (running on across chain breaks)\n");
+   fprintf(stderr, "       -M Write the matrix through a memory mapping\n");
+   fprintf(stderr, "          (-b and -M are only used with -m, which \
+can't be used with -q)\n");
+   fprintf(stderr, "       calcpdbdistance -q pairs.txt \
+[in.pdb [out.txt]]\n");
+   fprintf(stderr, "       -q Read pairs of residues from a file, one \
+pair per line\n");
 
-   fprintf(stderr, "Calculates the distance between the C-alpha atoms \
+   fprintf(stderr, "\nCalculates the distance between the C-alpha atoms \
 of the two specified\n");
    fprintf(stderr, "residues. I/O is through standard input / output \
 if files are not\n");
    fprintf(stderr, "specified.\n");
 
+   fprintf(stderr, "\nWith -m, all the C-alpha distances are written as \
+a binary matrix of\n");
+   fprintf(stderr, "32-bit floats after a 16-byte header (\"%s\", the \
+number of residues\n", MATRIXMAGIC);
+   fprintf(stderr, "and the band width as 32-bit ints). The residue \
+labels are written to\n");
+   fprintf(stderr, "matrix.bin%s\n", LABELEXT);
+
+   fprintf(stderr, "\nWith -q, each output line gives the two residues \
+and their distance\n");
+   fprintf(stderr, "(or NULL if it could not be calculated).\n");
+
    fprintf(stderr, "\n");
    blPrintResSpecHelp(stderr);
    fprintf(stderr, "\n");
 }
 
 /************************************************************************/
-/*>REAL CalcDistance(PDB *pdb, char *res1, char *res2)
-   ---------------------------------------------------
+/*>REAL CalcDistance(RESINDEX *index, char *res1, char *res2)
+   -----------------------------------------------------------
 *//**
-   \param[in]    *out    Output file pointer
-   \param[in]    *pdb    PDB linked list
+   \param[in]    *index  Residue index
    \param[in]    res1    First residue spec
    \param[in]    res2    Second residue spec
    \return               Distance (<0 on failure)
@@ -276,21 +509,22 @@ if files are not\n");
    specified residues.
 
 -  11.12.17   Original   By: ACRM
+-  16.10.26   Finds the residues through the residue index   By: agent
 */
-REAL CalcDistance(PDB *pdb, char *res1, char *res2)
+REAL CalcDistance(RESINDEX *index, char *res1, char *res2)
 {
    PDB *r1 = NULL,
        *r2 = NULL;
    REAL d  = 0.0;
    
    
-   if((r1 = blFindResidueSpec(pdb, res1))==NULL)
+   if((r1 = FindIndexedResidueSpec(index, res1))==NULL)
    {
       fprintf(stderr,"Error (calcpdbdistance): residue not found (%s)\n",
               res1);
       return(-1.0);
    }
-   if((r2 = blFindResidueSpec(pdb, res2))==NULL)
+   if((r2 = FindIndexedResidueSpec(index, res2))==NULL)
    {
       fprintf(stderr,"Error (calcpdbdistance): residue not found (%s)\n",
               res2);
@@ -314,3 +548,416 @@ REAL CalcDistance(PDB *pdb, char *res1, char *res2)
    return(d);
 }
 
+
+/************************************************************************/
+/*>BOOL RunQueries(FILE *out, RESINDEX *index, char *queryFile)
+   ------------------------------------------------------------
+*//**
+   \param[in]    *out        Output file pointer
+   \param[in]    *index      Residue index
+   \param[in]    *queryFile  File of residue pairs
+   \return                   Success?
+
+   Reads pairs of residue specs, one pair per line, and writes each pair
+   with the distance between their C-alphas. Blank lines and lines 
+   starting with a # are skipped. Every other line gives one output 
+   line so the output can be matched to the queries: a line with only
+   one residue gives "res1 NULL", and anything after the pair is 
+   ignored with a warning.
+
+-  16.10.26   Original   By: agent
+-  17.10.26   Writes NULL for a line with one residue and warns about
+              extra fields   By: agent
+*/
+BOOL RunQueries(FILE *out, RESINDEX *index, char *queryFile)
+{
+   FILE *fp;
+   char buffer[MAXBUFF],
+        res1[MAXBUFF],
+        res2[MAXBUFF],
+        extra[MAXBUFF];
+
+   if((fp = fopen(queryFile, "r"))==NULL)
+   {
+      fprintf(stderr,"Error (calcpdbdistance): Unable to open query \
+file (%s)\n", queryFile);
+      return(FALSE);
+   }
+
+   while(fgets(buffer, MAXBUFF, fp))
+   {
+      REAL d;
+      int  nFields;
+      
+      TERMINATE(buffer);
+      if((buffer[0] == '#') ||
+         ((nFields = sscanf(buffer, "%s %s %s", res1, res2, extra)) < 1))
+         continue;
+      if(nFields == 1)
+      {
+         fprintf(stderr,"Warning (calcpdbdistance): Query with only one \
+residue (%s)\n", res1);
+         fprintf(out, "%s NULL\n", res1);
+         continue;
+      }
+      if(nFields > 2)
+      {
+         fprintf(stderr,"Warning (calcpdbdistance): Ignored extra fields \
+after %s %s\n", res1, res2);
+      }
+
+      if((d = CalcDistance(index, res1, res2)) < 0.0)
+         fprintf(out, "%s %s NULL\n", res1, res2);
+      else
+         fprintf(out, "%s %s %.3f\n", res1, res2, d);
+   }
+
+   fclose(fp);
+   return(TRUE);
+}
+
+
+
+/************************************************************************/
+/*>BOOL ExtractCACoords(PDB *pdb, CACOORDS *coords)
+   ------------------------------------------------
+*//**
+   \param[in]    *pdb     PDB linked list
+   \param[out]   *coords  C-alpha coordinates
+   \return                Success?
+
+   Extracts the C-alpha coordinates of each residue (that has one) into
+   aligned x, y and z arrays, padded with zeros to a multiple of the
+   alignment.
+
+-  16.10.26   Original   By: agent
+*/
+BOOL ExtractCACoords(PDB *pdb, CACOORDS *coords)
+{
+   PDB *p, *ca;
+   int nRes = 0,
+       nPad, i;
+
+   coords->x    = coords->y = coords->z = NULL;
+   coords->ca   = NULL;
+   coords->nRes = 0;
+   
+   for(p=pdb; p!=NULL; p=blFindNextResidue(p))
+      nRes++;
+   nPad = nRes + SIMDALIGN / sizeof(float);
+
+   if(((coords->x  = AllocAligned(nPad))==NULL) ||
+      ((coords->y  = AllocAligned(nPad))==NULL) ||
+      ((coords->z  = AllocAligned(nPad))==NULL) ||
+      ((coords->ca = (PDB **)malloc((nRes+1) * sizeof(PDB *)))==NULL))
+   {
+      FreeCACoords(coords);
+      return(FALSE);
+   }
+   
+   for(p=pdb; p!=NULL; p=blFindNextResidue(p))
+   {
+      if((ca = blFindAtomInRes(p, "CA"))!=NULL)
+      {
+         coords->x[coords->nRes]  = (float)ca->x;
+         coords->y[coords->nRes]  = (float)ca->y;
+         coords->z[coords->nRes]  = (float)ca->z;
+         coords->ca[coords->nRes] = ca;
+         coords->nRes++;
+      }
+   }
+   for(i=coords->nRes; i<nPad; i++)
+      coords->x[i] = coords->y[i] = coords->z[i] = 0.0f;
+
+   return(TRUE);
+}
+
+
+/************************************************************************/
+/*>void FreeCACoords(CACOORDS *coords)
+   -----------------------------------
+*//**
+   \param[in,out]   *coords  C-alpha coordinates to free
+
+-  16.10.26   Original   By: agent
+*/
+void FreeCACoords(CACOORDS *coords)
+{
+   if(coords->x  != NULL) free(coords->x);
+   if(coords->y  != NULL) free(coords->y);
+   if(coords->z  != NULL) free(coords->z);
+   if(coords->ca != NULL) free(coords->ca);
+   coords->x    = coords->y = coords->z = NULL;
+   coords->ca   = NULL;
+   coords->nRes = 0;
+}
+
+
+/************************************************************************/
+/*>float *AllocAligned(int n)
+   --------------------------
+*//**
+   \param[in]    n       Number of floats
+   \return               Array aligned to SIMDALIGN bytes (NULL if no
+                         memory)
+
+-  16.10.26   Original   By: agent
+*/
+float *AllocAligned(int n)
+{
+   void *mem = NULL;
+   
+   if(posix_memalign(&mem, SIMDALIGN, n * sizeof(float)))
+      return(NULL);
+   return((float *)mem);
+}
+
+
+/************************************************************************/
+/*>void CalcDistanceRow(const float *restrict x, 
+                        const float *restrict y,
+                        const float *restrict z, float xi, float yi, 
+                        float zi, int n, float *restrict row)
+   ---------------------------------------------------------------------
+*//**
+   \param[in]    *x, *y, *z   Coordinate arrays
+   \param[in]    xi, yi, zi   Coordinates of one point
+   \param[in]    n            Number of coordinates
+   \param[out]   *row         Distances from the point to each 
+                              coordinate
+
+   The distance kernel. A single branch-free loop over separate 
+   coordinate arrays. The compiler only vectorises it if sqrtf() need 
+   not set errno, so Makefile.dist builds with -fno-math-errno (check 
+   with -fopt-info-vec). The arrays must not overlap.
+
+-  16.10.26   Original   By: agent
+-  17.10.26   Pointers are restrict   By: agent
+*/
+void CalcDistanceRow(const float *restrict x, const float *restrict y,
+                     const float *restrict z, float xi, float yi, 
+                     float zi, int n, float *restrict row)
+{
+   int j;
+   
+   for(j=0; j<n; j++)
+   {
+      float dx = x[j] - xi,
+            dy = y[j] - yi,
+            dz = z[j] - zi;
+      row[j] = sqrtf(dx*dx + dy*dy + dz*dz);
+   }
+}
+
+
+/************************************************************************/
+/*>void CalcMatrixRow(CACOORDS *coords, int i, int band, float *row)
+   -----------------------------------------------------------------
+*//**
+   \param[in]    *coords  C-alpha coordinates
+   \param[in]    i        Row (residue) number
+   \param[in]    band     Band width (0 for the full matrix)
+   \param[out]   *row     The row of the matrix
+
+   Fills in one row of the full or banded distance matrix
+
+-  16.10.26   Original   By: agent
+*/
+void CalcMatrixRow(CACOORDS *coords, int i, int band, float *row)
+{
+   if(band == 0)
+   {
+      CalcDistanceRow(coords->x, coords->y, coords->z,
+                      coords->x[i], coords->y[i], coords->z[i],
+                      coords->nRes, row);
+   }
+   else
+   {
+      int n = MIN(band+1, coords->nRes-i),
+          k;
+      
+      CalcDistanceRow(coords->x+i, coords->y+i, coords->z+i,
+                      coords->x[i], coords->y[i], coords->z[i],
+                      n, row);
+      for(k=n; k<=band; k++)
+         row[k] = NAN;
+   }
+}
+
+
+/************************************************************************/
+/*>BOOL WriteDistanceMatrix(char *matrixFile, CACOORDS *coords, int band,
+                            BOOL useMmap)
+   ----------------------------------------------------------------------
+*//**
+   \param[in]    *matrixFile  Output file
+   \param[in]    *coords      C-alpha coordinates
+   \param[in]    band         Band width (0 for the full matrix)
+   \param[in]    useMmap      Write through a memory mapping of the file
+   \return                    Success?
+
+   Writes the header and the matrix. Normally each row is calculated 
+   into a buffer and written, so memory use is one row. With useMmap the 
+   file is sized and mapped and the rows are calculated straight into 
+   it.
+
+-  16.10.26   Original   By: agent
+*/
+BOOL WriteDistanceMatrix(char *matrixFile, CACOORDS *coords, int band,
+                         BOOL useMmap)
+{
+   MATRIXHEADER header;
+   size_t       rowLen = (band) ? (size_t)band+1 : (size_t)coords->nRes;
+   int          i;
+
+   memset(&header, 0, sizeof(MATRIXHEADER));
+   memcpy(header.magic, MATRIXMAGIC, 8);
+   header.nRes = coords->nRes;
+   header.band = band;
+
+   if(useMmap)
+   {
+      size_t size = sizeof(MATRIXHEADER) + 
+                    (size_t)coords->nRes * rowLen * sizeof(float);
+      char   *map;
+      int    fd;
+      
+      if((fd = open(matrixFile, O_RDWR | O_CREAT | O_TRUNC, 0644)) < 0)
+      {
+         fprintf(stderr,"calcpdbdistance: (Error) Unable to open %s\n",
+                 matrixFile);
+         return(FALSE);
+      }
+      if(ftruncate(fd, (off_t)size) ||
+         ((map = (char *)mmap(NULL, size, PROT_READ | PROT_WRITE, 
+                              MAP_SHARED, fd, 0))==MAP_FAILED))
+      {
+         fprintf(stderr,"calcpdbdistance: (Error) Unable to map %s\n",
+                 matrixFile);
+         close(fd);
+         return(FALSE);
+      }
+
+      memcpy(map, &header, sizeof(MATRIXHEADER));
+      for(i=0; i<coords->nRes; i++)
+      {
+         CalcMatrixRow(coords, i, band, 
+                       (float *)(map + sizeof(MATRIXHEADER)) + i*rowLen);
+      }
+      
+      munmap(map, size);
+      close(fd);
+   }
+   else
+   {
+      FILE  *fp;
+      float *row;
+      BOOL  ok;
+      
+      if((row = AllocAligned(rowLen+1))==NULL)
+      {
+         fprintf(stderr,"calcpdbdistance: (Error) No memory for matrix \
+row\n");
+         return(FALSE);
+      }
+      if((fp = fopen(matrixFile, "wb"))==NULL)
+      {
+         fprintf(stderr,"calcpdbdistance: (Error) Unable to open %s\n",
+                 matrixFile);
+         free(row);
+         return(FALSE);
+      }
+
+      ok = (fwrite(&header, sizeof(MATRIXHEADER), 1, fp) == 1);
+      for(i=0; ok && i<coords->nRes; i++)
+      {
+         CalcMatrixRow(coords, i, band, row);
+         ok = (fwrite(row, sizeof(float), rowLen, fp) == rowLen);
+      }
+      if(fclose(fp))
+         ok = FALSE;
+      free(row);
+      
+      if(!ok)
+      {
+         fprintf(stderr,"calcpdbdistance: (Error) Unable to write %s\n",
+                 matrixFile);
+         return(FALSE);
+      }
+   }
+   
+   return(TRUE);
+}
+
+
+/************************************************************************/
+/*>BOOL WriteResidueLabels(char *matrixFile, CACOORDS *coords)
+   -----------------------------------------------------------
+*//**
+   \param[in]    *matrixFile  Matrix file
+   \param[in]    *coords      C-alpha coordinates
+   \return                    Success?
+
+   Writes the residue label for each row of the matrix, one per line, to
+   the matrix file name with LABELEXT appended
+
+-  16.10.26   Original   By: agent
+*/
+BOOL WriteResidueLabels(char *matrixFile, CACOORDS *coords)
+{
+   FILE *fp;
+   char filename[MAXBUFF],
+        label[MAXBUFF];
+   int  i;
+   
+   sprintf(filename, "%s%s", matrixFile, LABELEXT);
+   if((fp = fopen(filename, "w"))==NULL)
+   {
+      fprintf(stderr,"calcpdbdistance: (Error) Unable to open %s\n",
+              filename);
+      return(FALSE);
+   }
+   
+   for(i=0; i<coords->nRes; i++)
+   {
+      BuildLabel(coords->ca[i], label);
+      fprintf(fp, "%s\n", label);
+   }
+
+   if(fclose(fp))
+   {
+      fprintf(stderr,"calcpdbdistance: (Error) Unable to write %s\n",
+              filename);
+      return(FALSE);
+   }
+   return(TRUE);
+}
+
+
+/************************************************************************/
+/*>void BuildLabel(PDB *p, char *label)
+   ------------------------------------
+*//**
+   \param[in]    *p       Atom
+   \param[out]   *label   Residue spec for the atom's residue
+
+   Builds a residue spec in the form accepted on the command line, 
+   [c[.]]num[i], with the '.' when the chain label is numeric or longer 
+   than one character.
+
+-  16.10.26   Original   By: agent
+*/
+void BuildLabel(PDB *p, char *label)
+{
+   char chain[8],
+        insert[8];
+
+   strcpy(chain, p->chain);
+   KILLTRAILSPACES(chain);
+   strcpy(insert, p->insert);
+   KILLTRAILSPACES(insert);
+   
+   sprintf(label, "%s%s%d%s", chain, 
+           ((strlen(chain) > 1) || isdigit(chain[0])) ? "." : "",
+           p->resnum, insert);
+}
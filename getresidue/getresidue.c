@@ -3,11 +3,11 @@
    Program:    getresidue
    File:       getresidue.c
    
-   Version:    V1.0
-   Date:       14.07.11
+   Version:    V1.1
+   Date:       16.10.26
    Function:   Extract the residue name for a specifed ID
    
-   Copyright:  (c) UCL / Dr. Andrew C. R. Martin 2011
+   Copyright:  (c) UCL / Dr. Andrew C. R. Martin 2011-2026
    Author:     Dr. Andrew C. R. Martin
    Address:    Biomolecular Structure & Modelling Unit,
                Department of Biochemistry & Molecular Biology,
@@ -35,6 +35,9 @@
 
    Description:
    ============
+   With -q, residue specs are read from a file, one per line, and each
+   is written with its residue name. All are answered from one read of
+   the PDB file using a residue index.
 
 **************************************************************************
 
@@ -46,14 +49,18 @@
    Revision History:
    =================
    V1.0  14.07.11 Original   By: ACRM
+   V1.1  16.10.26 Added -q for a file of residue specs. Residues are 
+                  found through a residue index   By: agent
 
 *************************************************************************/
 /* Includes
 */
 #include <stdio.h>
+#include <string.h>
 #include "bioplib/pdb.h"
 #include "bioplib/general.h"
 #include "bioplib/macros.h"
+#include "resindex.h"
 
 /************************************************************************/
 /* Defines and macros
@@ -70,7 +77,8 @@
 int main(int argc, char **argv);
 void Usage(void);
 BOOL ParseCmdLine(int argc, char **argv, char *infile, char *outfile,
-                  char *resspec);
+                  char *resspec, char *queryFile);
+BOOL RunQueries(FILE *out, RESINDEX *index, char *queryFile);
 
 
 /************************************************************************/
@@ -82,18 +90,21 @@ BOOL ParseCmdLine(int argc, char **argv, char *infile, char *outfile,
    06.04.09 Added lowercase option
    22.05.09 Added keepHeader
    29.06.09 Added atomsOnly
+   16.10.26 Added query file mode and residue index   By: agent
 */
 int main(int argc, char **argv)
 {
-   char InFile[MAXBUFF],
-        OutFile[MAXBUFF],
-        resspec[MAXBUFF];
-   FILE *in  = stdin,
-        *out = stdout;
-   PDB  *pdb = NULL;
-   int  natoms;
+   char     InFile[MAXBUFF],
+            OutFile[MAXBUFF],
+            resspec[MAXBUFF],
+            QueryFile[MAXBUFF];
+   FILE     *in  = stdin,
+            *out = stdout;
+   PDB      *pdb = NULL;
+   RESINDEX *index;
+   int      natoms;
    
-   if(ParseCmdLine(argc, argv, InFile, OutFile, resspec))
+   if(ParseCmdLine(argc, argv, InFile, OutFile, resspec, QueryFile))
    {
       if(blOpenStdFiles(InFile, OutFile, &in, &out))
       {
@@ -102,10 +113,20 @@ int main(int argc, char **argv)
             fprintf(stderr,"No atoms read from input PDB file\n");
             return(1);
          }
+         else if((index = BuildResidueIndex(pdb)) == NULL)
+         {
+            fprintf(stderr,"No memory for residue index\n");
+            return(1);
+         }
+         else if(QueryFile[0])
+         {
+            if(!RunQueries(out, index, QueryFile))
+               return(1);
+         }
          else
          {
             PDB *p;
-            p = blFindResidueSpec(pdb, resspec);
+            p = FindIndexedResidueSpec(index, resspec);
             if(p!=NULL)
             {
                fprintf(out, "%s\n", p->resnam);
@@ -132,42 +153,96 @@ int main(int argc, char **argv)
    Prints a usage message
 
    14.07.11 Original   By: ACRM
+   16.10.26 Added -q   By: agent
 */
 void Usage(void)
 {
-   fprintf(stderr,"\ngetresidue V1.0 (c) 2011 Dr. Andrew C.R. Martin, UCL\n");
+   fprintf(stderr,"\ngetresidue V1.1 (c) 2011-2026 Dr. Andrew C.R. \
+Martin, UCL\n");
 
    fprintf(stderr,"\nUsage: getresidue [chain]resnum[insert] \
 [in.pdb [outfile]]\n");
+   fprintf(stderr,"       getresidue -q specs.txt [in.pdb [outfile]]\n");
+   fprintf(stderr,"       -q Read residue specs from a file, one per \
+line\n");
 
    fprintf(stderr,"\nGetresidue identifies the amino acid at a specified \
 position in a\n");
-   fprintf(stderr,"PDB file.\n\n");
+   fprintf(stderr,"PDB file. With -q, each output line gives the residue \
+spec and the\n");
+   fprintf(stderr,"amino acid.\n\n");
 } 
 
 
+/************************************************************************/
+/*>BOOL RunQueries(FILE *out, RESINDEX *index, char *queryFile)
+   ------------------------------------------------------------
+   Input:   FILE     *out        Output file pointer
+            RESINDEX *index      Residue index
+            char     *queryFile  File of residue specs
+   Returns: BOOL                 Success
+
+   Reads residue specs, one per line, and writes each with the residue
+   name (or NULL if not found). Blank lines and lines starting with a #
+   are skipped.
+
+   16.10.26 Original   By: agent
+*/
+BOOL RunQueries(FILE *out, RESINDEX *index, char *queryFile)
+{
+   FILE *fp;
+   char buffer[MAXBUFF],
+        resspec[MAXBUFF];
+
+   if((fp = fopen(queryFile, "r")) == NULL)
+   {
+      fprintf(stderr,"Unable to open query file: %s\n", queryFile);
+      return(FALSE);
+   }
+
+   while(fgets(buffer, MAXBUFF, fp))
+   {
+      PDB *p;
+      
+      TERMINATE(buffer);
+      if((buffer[0] == '#') || (sscanf(buffer, "%s", resspec) != 1))
+         continue;
+
+      if((p = FindIndexedResidueSpec(index, resspec)) != NULL)
+         fprintf(out, "%s %s\n", resspec, p->resnam);
+      else
+         fprintf(out, "%s NULL\n", resspec);
+   }
+
+   fclose(fp);
+   return(TRUE);
+}
+
+
 /************************************************************************/
 /*>BOOL ParseCmdLine(int argc, char **argv, char *infile, char *outfile,
-                     char *resspec)
+                     char *resspec, char *queryFile)
    ----------------------------------------------------------------------
    Input:   int    argc        Argument count
             char   **argv      Argument array
    Output:  char   *infile     Input filename (or blank string)
             char   *outfile    Output filename (or blank string)
             char   *resspec    Residue ID
+            char   *queryFile  File of residue IDs (or blank string)
    Returns: BOOL               Success
 
    Parse the command line
 
    14.07.11 Original    By: ACRM
+   16.10.26 Added -q   By: agent
 */
 BOOL ParseCmdLine(int argc, char **argv, char *infile, char *outfile,
-                  char *resspec)
+                  char *resspec, char *queryFile)
 {
    argc--;
    argv++;
    
-   infile[0] = outfile[0] = resspec[0] = '\0';
+   infile[0] = outfile[0] = resspec[0] = queryFile[0] = '\0';
    
    while(argc)
    {
@@ -178,11 +253,29 @@ BOOL ParseCmdLine(int argc, char **argv, char *infile, char *outfile,
          case 'h':
             return(FALSE);
             break;
+         case 'q':
+            argc--;
+            argv++;
+            if(!argc)
+               return(FALSE);
+            strncpy(queryFile, argv[0], MAXBUFF);
+            queryFile[MAXBUFF-1] = '\0';
+            break;
          default:
             return(FALSE);
             break;
          }
       }
+      else if(queryFile[0])
+      {
+         /* Just the input and output files with a query file           */
+         if(argc > 2)
+            return(FALSE);
+         strcpy(infile, argv[0]);
+         if(argc > 1)
+            strcpy(outfile, argv[1]);
+         return(TRUE);
+      }
       else
       {
          /* Check that there are 1-3 arguments left                     */
@@ -212,7 +305,7 @@ BOOL ParseCmdLine(int argc, char **argv, char *infile, char *outfile,
       argv++;
    }
    
-   if(!resspec[0])
+   if(!resspec[0] && !queryFile[0])
       return(FALSE);
 
    return(TRUE);
@@ -3,12 +3,12 @@
    Program:    getrnaandnear
    File:       getrnaandnear.c
    
-   Version:    V1.1
-   Date:       05.03.10
+   Version:    V1.4
+   Date:       16.10.26
    Function:   Get RNA chains and protein (or HETATM chains that interact
                with them out of a PDB file)
    
-   Copyright:  (c) UCL / Dr. Andrew C. R. Martin 2010
+   Copyright:  (c) UCL / Dr. Andrew C. R. Martin 2010-2026
    Author:     Dr. Andrew C. R. Martin
    Address:    Biomolecular Structure & Modelling Unit,
                Department of Biochemistry & Molecular Biology,
@@ -49,12 +49,19 @@
    =================
    V1.0  03.03.10  Original
    V1.1  05.03.10  Added residue level stuff
+   V1.2  16.10.26  Residue level search uses a spatial hash of the RNA
+                   atoms
+   V1.3  16.10.26  Added -s to stream the file a chain at a time
+   V1.4  16.10.26  Added -c to report the minimum distances between 
+                   chains and chain types for a list of cutoffs
 
 *************************************************************************/
 /* Includes
 */
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
+#include <math.h>
 #include "bioplib/pdb.h"
 #include "bioplib/seq.h"
 #include "bioplib/macros.h"
@@ -84,6 +91,14 @@
 /* String buffer                                                        */
 #define MAXBUFF 1024
 
+/* Spatial hash cell for an atom coordinate                             */
+#define HASHCELL(x, size) ((int)floor((x) / (size)))
+
+/* Cutoffs for -c                                                       */
+#define MAXCUTOFFS  16
+#define NOCONTACT   ((REAL)(-1.0))
+#define NCHAINTYPES (TYPE_NONSTD+1)
+
 /* Extra chain info                                                     */
 typedef struct
 {
@@ -91,6 +106,39 @@ typedef struct
    REAL xmin, xmax, ymin, ymax, zmin, zmax;
 } CHAININFO ;
 
+/* Spatial hash of atom coordinates in cubic cells                     */
+typedef struct
+{
+   REAL *xyz,             /* Coordinates, 3 per atom                    */
+        cellSize;         /* At least the distance to be searched       */
+   int  *bucketHead,      /* First atom in each bucket                  */
+        *atomNext,        /* Next atom in the same bucket               */
+        nAtoms,
+        maxAtoms,
+        nBuckets;         /* A power of 2                               */
+} ATOMHASH;
+
+/* Reads a PDB file one chain at a time                                 */
+typedef struct
+{
+   FILE *fp;
+   char line[MAXBUFF];    /* First record of the next chain             */
+   BOOL haveLine,
+        done;
+} CHAINREADER;
+
+#define HASHQUANTUM 4096
+
+/* Minimum distances between chains, up to a maximum cutoff             */
+typedef struct
+{
+   char (*labels)[8];     /* Chain labels                               */
+   int  *types,           /* Chain types (TYPE_...)                     */
+        nChains;
+   REAL *minDist,         /* nChains x nChains, NOCONTACT if further    */
+        maxCutoff;        /* apart than maxCutoff                       */
+} CHAINDISTS;
+
 /************************************************************************/
 /* Globals
 */
@@ -101,6 +149,7 @@ typedef struct
 int main(int argc, char **argv);
 int FindChainType(PDB *start, PDB *stop, BOOL doPep, BOOL doX);
 BOOL CheckBounds(PDBCHAIN *chain1, PDBCHAIN *chain2);
+BOOL BoxesClose(CHAININFO *box1, CHAININFO *box2);
 void SetBounds(PDB *start, PDB *stop, REAL *xmin, REAL *xmax, REAL *ymin,
                REAL *ymax, REAL *zmin, REAL *zmax);
 void AssignChainTypes(PDBSTRUCT *pdbs);
@@ -108,9 +157,27 @@ void FindChainsNearRNA(PDBSTRUCT *pdbs);
 void FindResiduesNearRNA(PDBSTRUCT *pdbs);
 void PrintRNANearChains(FILE *out, PDBSTRUCT *pdbs, BOOL resLevel);
 BOOL ParseCmdLine(int argc, char **argv, char *infile, char *outfile,
-                  BOOL *resLevel);
+                  BOOL *resLevel, BOOL *stream, REAL *cutoffs, 
+                  int *nCutoffs);
 void Usage(void);
 void ClearResidueFlags(PDBSTRUCT *pdbs);
+BOOL BuildRNAHash(PDBSTRUCT *pdbs, ATOMHASH *hash);
+BOOL AddHashAtoms(ATOMHASH *hash, PDB *start, PDB *stop);
+BOOL IndexAtomHash(ATOMHASH *hash);
+void FreeAtomHash(ATOMHASH *hash);
+int HashCell(int ix, int iy, int iz, int nBuckets);
+BOOL NearHashedAtom(ATOMHASH *hash, PDB *q);
+BOOL StreamRNAAndNear(FILE *in, FILE *out, BOOL resLevel);
+BOOL FindRNAInStream(FILE *in, ATOMHASH *hash, CHAININFO **rnaBoxes,
+                     int *nRNA);
+PDB *ReadNextChain(CHAINREADER *reader);
+BOOL FindChainDistances(PDBSTRUCT *pdbs, REAL maxCutoff, 
+                        CHAINDISTS *dists);
+void FreeChainDistances(CHAINDISTS *dists);
+REAL ChainDistance(CHAINDISTS *dists, int chain1, int chain2);
+void PrintChainDistances(FILE *out, CHAINDISTS *dists, REAL *cutoffs, 
+                         int nCutoffs);
+char *ChainTypeName(int type);
 
 
 /************************************************************************/
@@ -119,6 +186,9 @@ void ClearResidueFlags(PDBSTRUCT *pdbs);
    Main program
 
    03.03.10  Original   By: ACRM
+   16.10.26  Added streaming mode   By: agent
+   16.10.26  Added chain distance report   By: agent
+   17.10.26  -s and -c together is an error   By: agent
 */
 int main(int argc, char **argv)
 {
@@ -129,14 +199,26 @@ int main(int argc, char **argv)
    int  natoms;
    char infile[MAXBUFF],
         outfile[MAXBUFF];
-   BOOL resLevel = FALSE;
+   BOOL resLevel = FALSE,
+        stream   = FALSE;
+   REAL cutoffs[MAXCUTOFFS];
+   int  nCutoffs = 0;
    
 
-   if(!ParseCmdLine(argc, argv, infile, outfile, &resLevel))
+   if(!ParseCmdLine(argc, argv, infile, outfile, &resLevel, &stream,
+                    cutoffs, &nCutoffs))
    {
       Usage();
       return(0);
    }
+
+   /* The chain distance report needs the whole structure in memory     */
+   if(stream && nCutoffs)
+   {
+      fprintf(stderr, "\nError: -s cannot be used with -c\n");
+      Usage();
+      return(1);
+   }
    
    /* Open files                                                        */
    if(!OpenStdFiles(infile, outfile, &in, &out))
@@ -144,6 +226,9 @@ int main(int argc, char **argv)
       fprintf(stderr, "Unable to open input or output files\n");
       return(1);
    }
+
+   if(stream)
+      return(StreamRNAAndNear(in, out, resLevel) ? 0 : 1);
    
    /* Read and format data                                              */
    if((pdb = ReadPDB(in, &natoms)) == NULL)
@@ -156,6 +241,28 @@ int main(int argc, char **argv)
       fprintf(stderr, "No memory for PDB structure\n");
    }
 
+   /* Report distances between chains rather than extracting chains     */
+   if(nCutoffs)
+   {
+      CHAINDISTS dists;
+      REAL       maxCutoff = cutoffs[0];
+      int        i;
+
+      for(i=1; i<nCutoffs; i++)
+         maxCutoff = MAX(maxCutoff, cutoffs[i]);
+      
+      if(!FindChainDistances(pdbstruct, maxCutoff, &dists))
+      {
+         fprintf(stderr, "No memory for chain distances\n");
+         return(1);
+      }
+      PrintChainDistances(out, &dists, cutoffs, nCutoffs);
+      FreeChainDistances(&dists);
+      FreePDBStructure(pdbstruct);
+      FREELIST(pdb, PDB);
+      return(0);
+   }
+
    /* Process the data to find and print chains of interest             */
    AssignChainTypes(pdbstruct);
    if(resLevel)
@@ -375,27 +482,37 @@ void SetBounds(PDB *start, PDB *stop, REAL *xmin, REAL *xmax, REAL *ymin,
    Angstroms of the bounding box of the second chain
 
    03.03.10  Original   By: ACRM
+   16.10.26  Box test moved to BoxesClose()   By: agent
 */
 BOOL CheckBounds(PDBCHAIN *chain1, PDBCHAIN *chain2)
 {
-   if(((((CHAININFO *)chain1->extras)->xmax) + DISTCUTOFF) <
-      (((CHAININFO *)chain2->extras)->xmin))
+   return(BoxesClose((CHAININFO *)chain1->extras, 
+                     (CHAININFO *)chain2->extras));
+}
+
+
+/************************************************************************/
+/*>BOOL BoxesClose(CHAININFO *box1, CHAININFO *box2)
+   -------------------------------------------------
+   Look to see if one bounding box is within DISTCUTOFF Angstroms of the 
+   other
+
+   16.10.26  Original (from CheckBounds())   By: agent
+*/
+BOOL BoxesClose(CHAININFO *box1, CHAININFO *box2)
+{
+   if((box1->xmax + DISTCUTOFF) < box2->xmin)
       return(FALSE);
-   if(((((CHAININFO *)chain1->extras)->ymax) + DISTCUTOFF) <
-      (((CHAININFO *)chain2->extras)->ymin))
+   if((box1->ymax + DISTCUTOFF) < box2->ymin)
       return(FALSE);
-   if(((((CHAININFO *)chain1->extras)->zmax) + DISTCUTOFF) <
-      (((CHAININFO *)chain2->extras)->zmin))
+   if((box1->zmax + DISTCUTOFF) < box2->zmin)
       return(FALSE);
    
-   if(((((CHAININFO *)chain2->extras)->xmax) + DISTCUTOFF) <
-      (((CHAININFO *)chain1->extras)->xmin))
+   if((box2->xmax + DISTCUTOFF) < box1->xmin)
       return(FALSE);
-   if(((((CHAININFO *)chain2->extras)->ymax) + DISTCUTOFF) <
-      (((CHAININFO *)chain1->extras)->ymin))
+   if((box2->ymax + DISTCUTOFF) < box1->ymin)
       return(FALSE);
-   if(((((CHAININFO *)chain2->extras)->zmax) + DISTCUTOFF) <
-      (((CHAININFO *)chain1->extras)->zmin))
+   if((box2->zmax + DISTCUTOFF) < box1->zmin)
       return(FALSE);
    
    return(TRUE);
@@ -575,28 +692,39 @@ void PrintRNANearChains(FILE *out, PDBSTRUCT *pdbs, BOOL resLevel)
 
 /************************************************************************/
 /*>BOOL ParseCmdLine(int argc, char **argv, char *infile, char *outfile,
-                     BOOL *resLevel)
+                     BOOL *resLevel, BOOL *stream, REAL *cutoffs,
+                     int *nCutoffs)
    ----------------------------------------------------------------------
    Input:   int   argc      Command line argc
             char  **argv    Command line argv
    Output:  char  *infile   Input PDB filename (or blank string)
             char  *outfile  Output PDB filename (or blank string)
             BOOL  *resLevel Do residue level nearness
+            BOOL  *stream   Stream the file a chain at a time
+            REAL  *cutoffs  Cutoffs for the chain distance report
+            int   *nCutoffs Number of cutoffs (0 if no report)
    Returns: BOOL            Success
 
    Parse the command line
 
    03.03.10  Original   By: ACRM
    05.03.10  Added -r / resLevel
+   16.10.26  Added -s / stream   By: agent
+   16.10.26  Added -c / cutoffs   By: agent
 */
 BOOL ParseCmdLine(int argc, char **argv, char *infile, char *outfile,
-                  BOOL *resLevel)
+                  BOOL *resLevel, BOOL *stream, REAL *cutoffs, 
+                  int *nCutoffs)
 {
+   char *c;
+
    argc--;
    argv++;
 
    infile[0] = outfile[0] = '\0';
    *resLevel = FALSE;
+   *stream   = FALSE;
+   *nCutoffs = 0;
    
    while(argc)
    {
@@ -607,6 +735,25 @@ BOOL ParseCmdLine(int argc, char **argv, char *infile, char *outfile,
          case 'r':
             *resLevel = TRUE;
             break;
+         case 's':
+            *stream = TRUE;
+            break;
+         case 'c':
+            argc--;
+            argv++;
+            if(!argc)
+               return(FALSE);
+            for(c=argv[0]; c!=NULL; c=strchr(c, ','))
+            {
+               if(*c == ',')
+                  c++;
+               if((*nCutoffs >= MAXCUTOFFS) ||
+                  (sscanf(c, "%lf", &(cutoffs[*nCutoffs])) != 1) ||
+                  (cutoffs[*nCutoffs] <= (REAL)0.0))
+                  return(FALSE);
+               (*nCutoffs)++;
+            }
+            break;
          case 'h':
             return(FALSE);
             break;
@@ -653,21 +800,50 @@ BOOL ParseCmdLine(int argc, char **argv, char *infile, char *outfile,
    Prints a usage message 
 
    03.03.10  Original   By: ACRM
+   16.10.26  Added -s   By: agent
+   16.10.26  Added -c   By: agent
+   17.10.26  -s is not allowed with -c   By: agent
+   17.10.26  CHAIN and PAIR records give chain numbers   By: agent
 */
 void Usage(void)
 {
-   fprintf(stderr,"\ngetrnaandnear V1.1 (C) Dr. Andrew C.R Martin, \
+   fprintf(stderr,"\ngetrnaandnear V1.4 (C) Dr. Andrew C.R Martin, \
 UCL\n");
 
-   fprintf(stderr,"\nUsage: getrnaandnear [-r] [infile [outfile]]\n");
+   fprintf(stderr,"\nUsage: getrnaandnear [-r] [-s] [-c cutoff[,cutoff...]] \
+[infile [outfile]]\n");
    fprintf(stderr,"       -r Do residues rather than whole chains\n");
+   fprintf(stderr,"       -s Read the file a chain at a time to save \
+memory (not with -c)\n");
+   fprintf(stderr,"       -c Report distances between chains rather \
+than extracting\n");
+   fprintf(stderr,"          chains (up to %d cutoffs)\n", MAXCUTOFFS);
 
    fprintf(stderr,"\ngetrnaandnear extracts RNA chains and chains that \
 are within %.1f A\n", (REAL)DISTCUTOFF);
    fprintf(stderr,"of an RNA chain. It is used for cutting down huge \
 structures such\n");
    fprintf(stderr,"as ribosomes before processing with programs like \
-ligplot\n\n");
+ligplot\n");
+   fprintf(stderr,"\nWith -s the file is read twice: first keeping just \
+the RNA coordinates,\n");
+   fprintf(stderr,"then one chain at a time to find those near the RNA, \
+so only the RNA and\n");
+   fprintf(stderr,"one other chain are held in memory. Standard input is \
+copied to a\n");
+   fprintf(stderr,"temporary file first.\n");
+   fprintf(stderr,"\nWith -c, the output gives the number, label and \
+type of each chain\n");
+   fprintf(stderr,"(CHAIN records), the minimum distance between each \
+pair of chains which\n");
+   fprintf(stderr,"are closer than the largest cutoff (PAIR records, \
+giving the two chain\n");
+   fprintf(stderr,"numbers and labels) and, for each pair of chain \
+types, the minimum\n");
+   fprintf(stderr,"distance and the number of chain pairs closer than \
+each cutoff (TYPES\n");
+   fprintf(stderr,"records). Chains are numbered as several can have \
+the same label.\n\n");
 }
 
 
@@ -676,66 +852,282 @@ ligplot\n\n");
    -----------------------------------------
    Identifies and flags residues which are near to RNA
 
+   Each atom of a non-RNA residue looks for RNA atoms only in the 
+   neighbouring cells of a spatial hash of the RNA atoms, and the 
+   residue is flagged at the first atom within range. Chains whose 
+   bounding box is not close to any RNA chain are skipped.
+
    05.03.10 Original   By: ACRM
+   16.10.26 Uses a spatial hash of the RNA atoms rather than comparing
+            every RNA atom with every residue   By: agent
 */
 void FindResiduesNearRNA(PDBSTRUCT *pdbs)
 {
    PDBCHAIN   *chain1, *chain2;
    PDBRESIDUE *r;
-   PDB        *p, *q;
+   PDB        *q;
+   ATOMHASH   hash;
+
+   if(!BuildRNAHash(pdbs, &hash))
+   {
+      fprintf(stderr, "No memory for RNA atom hash\n");
+      exit(1);
+   }
       
-   /* Run through each chain                                            */
-   for(chain1=pdbs->chains; chain1!=NULL; NEXT(chain1))
+   /* Run through each non-RNA chain                                    */
+   for(chain2=pdbs->chains; chain2!=NULL; NEXT(chain2))
    {
-      /* If it's RNA                                                    */
-      if(((CHAININFO *)chain1->extras)->type == CHAIN_RNA)
+      if(((CHAININFO *)chain2->extras)->type == CHAIN_RNA)
+         continue;
+      
+      /* See if the bounding box is close enough to any RNA chain       */
+      for(chain1=pdbs->chains; chain1!=NULL; NEXT(chain1))
       {
-         /* Run through all other chains                                */
-         for(chain2=pdbs->chains; chain2!=NULL; NEXT(chain2))
+         if((((CHAININFO *)chain1->extras)->type == CHAIN_RNA) &&
+            CheckBounds(chain1, chain2))
+            break;
+      }
+      if(chain1 == NULL)
+         continue;
+
+      /* Run through residues in this (non-RNA) chain                   */
+      for(r=chain2->residues; r!=NULL; NEXT(r))
+      {
+         /* If this residue not flagged as near RNA                     */
+         if(!r->extras)
          {
-            /* If it's not RNA                                          */
-            if(((CHAININFO *)chain2->extras)->type != CHAIN_RNA)
+            /* Run through atoms in this residue until one is near     */
+            for(q=r->start; q!=r->stop; NEXT(q))
             {
-               /* If the bounding boxes of the chains are close enough  */
-               if(CheckBounds(chain1, chain2))
+               if(NearHashedAtom(&hash, q))
                {
-                  /* Run through atoms in first (RNA) chain             */
-                  for(p=chain1->start; p!=chain1->stop; NEXT(p))
-                  {
-                     /* Run through residues in second (non-RNA) chain  */
-                     for(r=chain2->residues; r!=NULL; NEXT(r))
-                     {
-                        /* If this residue not flagged as near RNA      */
-                        if(!r->extras)
-                        {
-                           /* Run through atoms in this residue         */
-                           for(q=r->start; q!=r->stop; NEXT(q))
-                           {
-                              /* If they are within specified distance  */
-                              if(DISTSQ(p,q) < DISTCUTOFFSQ)
-                              {
-                                 /* Flag the reside from the second 
-                                    (non-RNA) chain as being near RNA   
-                                 */
-                                 r->extras = (APTR *)1;
-                                 fprintf(stderr, 
-                                         "Near Residue %s %c%d%c\n",
-                                         r->start->resnam,
-                                         r->start->chain[0],
-                                         r->start->resnum,
-                                         r->start->insert[0]);
-                                 goto breakout;
-                              }
-                           }  /* for() atoms in this residue            */
-                        }  /* Residue not already flagged as near RNA   */
-breakout:               continue;
-                     }  /* for() residues in second chain               */
-                  }  /* for() atoms in first chain                      */
-               }  /* if boxes are close enough                          */
-            }  /* if second chain not already RNA or NEAR               */
-         }  /* for() each second chain                                  */
-      }  /* if first chain is RNA                                       */
-   }  /* for() each first chain                                         */
+                  /* Flag the residue as being near RNA                 */
+                  r->extras = (APTR *)1;
+                  fprintf(stderr, 
+                          "Near Residue %s %c%d%c\n",
+                          r->start->resnam,
+                          r->start->chain[0],
+                          r->start->resnum,
+                          r->start->insert[0]);
+                  break;
+               }
+            }  /* for() atoms in this residue                           */
+         }  /* Residue not already flagged as near RNA                  */
+      }  /* for() residues in chain                                     */
+   }  /* for() each non-RNA chain                                       */
+
+   FreeAtomHash(&hash);
+}
+
+
+/************************************************************************/
+/*>BOOL BuildRNAHash(PDBSTRUCT *pdbs, ATOMHASH *hash)
+   --------------------------------------------------
+   Input:   PDBSTRUCT *pdbs   PDB structure with chain types assigned
+   Output:  ATOMHASH  *hash   Spatial hash of the atoms of RNA chains
+   Returns: BOOL              Success
+
+   Places the atoms of the RNA chains in a hash keyed on the DISTCUTOFF
+   sized cell in which they lie. Unlike a grid over the bounding box, the
+   memory needed depends only on the number of RNA atoms.
+
+   16.10.26 Original   By: agent
+   16.10.26 Uses AddHashAtoms() and IndexAtomHash()   By: agent
+*/
+BOOL BuildRNAHash(PDBSTRUCT *pdbs, ATOMHASH *hash)
+{
+   PDBCHAIN *chain;
+
+   hash->cellSize   = (REAL)DISTCUTOFF;
+   hash->xyz        = NULL;
+   hash->bucketHead = NULL;
+   hash->atomNext   = NULL;
+   hash->nAtoms     = 0;
+   hash->maxAtoms   = 0;
+
+   for(chain=pdbs->chains; chain!=NULL; NEXT(chain))
+   {
+      if((((CHAININFO *)chain->extras)->type == CHAIN_RNA) &&
+         !AddHashAtoms(hash, chain->start, chain->stop))
+      {
+         FreeAtomHash(hash);
+         return(FALSE);
+      }
+   }
+   
+   return(IndexAtomHash(hash));
+}
+
+
+/************************************************************************/
+/*>BOOL AddHashAtoms(ATOMHASH *hash, PDB *start, PDB *stop)
+   --------------------------------------------------------
+   I/O:     ATOMHASH *hash    Spatial hash
+   Input:   PDB      *start   First atom to add
+            PDB      *stop    Atom after the last to add (or NULL)
+   Returns: BOOL              Success
+
+   Copies the coordinates of a range of atoms into the hash. The hash
+   can't be searched until IndexAtomHash() has been called.
+
+   16.10.26 Original   By: agent
+*/
+BOOL AddHashAtoms(ATOMHASH *hash, PDB *start, PDB *stop)
+{
+   PDB *p;
+   
+   for(p=start; p!=stop; NEXT(p))
+   {
+      if(hash->nAtoms >= hash->maxAtoms)
+      {
+         REAL *xyz;
+         
+         if((xyz = (REAL *)realloc(hash->xyz, 3 * sizeof(REAL) *
+                                   (hash->maxAtoms + HASHQUANTUM)))==NULL)
+            return(FALSE);
+         hash->xyz       = xyz;
+         hash->maxAtoms += HASHQUANTUM;
+      }
+      hash->xyz[3*hash->nAtoms]   = p->x;
+      hash->xyz[3*hash->nAtoms+1] = p->y;
+      hash->xyz[3*hash->nAtoms+2] = p->z;
+      hash->nAtoms++;
+   }
+
+   return(TRUE);
+}
+
+
+/************************************************************************/
+/*>BOOL IndexAtomHash(ATOMHASH *hash)
+   ----------------------------------
+   I/O:     ATOMHASH *hash    Spatial hash
+   Returns: BOOL              Success
+
+   Links the atoms added with AddHashAtoms() into the buckets for their
+   cells of side hash->cellSize. On failure, the hash is freed.
+
+   16.10.26 Original   By: agent
+*/
+BOOL IndexAtomHash(ATOMHASH *hash)
+{
+   int i;
+   
+   for(hash->nBuckets=1; hash->nBuckets < hash->nAtoms; hash->nBuckets *= 2);
+
+   if(((hash->atomNext = (int *)malloc((hash->nAtoms+1) * sizeof(int)))
+       ==NULL) ||
+      ((hash->bucketHead = (int *)malloc(hash->nBuckets * sizeof(int)))
+       ==NULL))
+   {
+      FreeAtomHash(hash);
+      return(FALSE);
+   }
+   
+   for(i=0; i<hash->nBuckets; i++)
+      hash->bucketHead[i] = (-1);
+
+   for(i=0; i<hash->nAtoms; i++)
+   {
+      int bucket = HashCell(HASHCELL(hash->xyz[3*i],   hash->cellSize), 
+                            HASHCELL(hash->xyz[3*i+1], hash->cellSize), 
+                            HASHCELL(hash->xyz[3*i+2], hash->cellSize), 
+                            hash->nBuckets);
+      hash->atomNext[i]        = hash->bucketHead[bucket];
+      hash->bucketHead[bucket] = i;
+   }
+   
+   return(TRUE);
+}
+
+
+/************************************************************************/
+/*>void FreeAtomHash(ATOMHASH *hash)
+   ---------------------------------
+   16.10.26 Original   By: agent
+*/
+void FreeAtomHash(ATOMHASH *hash)
+{
+   if(hash->xyz != NULL)
+      free(hash->xyz);
+   if(hash->atomNext != NULL)
+      free(hash->atomNext);
+   if(hash->bucketHead != NULL)
+      free(hash->bucketHead);
+   hash->xyz        = NULL;
+   hash->atomNext   = NULL;
+   hash->bucketHead = NULL;
+   hash->nAtoms     = 0;
+   hash->maxAtoms   = 0;
+}
+
+
+/************************************************************************/
+/*>int HashCell(int ix, int iy, int iz, int nBuckets)
+   --------------------------------------------------
+   Input:   int   ix,iy,iz    Cell coordinates
+            int   nBuckets    Number of buckets (a power of 2)
+   Returns: int               Bucket for the cell
+
+   16.10.26 Original   By: agent
+*/
+int HashCell(int ix, int iy, int iz, int nBuckets)
+{
+   unsigned int h;
+
+   h = ((unsigned int)ix * 73856093U) ^
+       ((unsigned int)iy * 19349663U) ^
+       ((unsigned int)iz * 83492791U);
+   return((int)(h & (unsigned int)(nBuckets - 1)));
+}
+
+
+/************************************************************************/
+/*>BOOL NearHashedAtom(ATOMHASH *hash, PDB *q)
+   -------------------------------------------
+   Input:   ATOMHASH *hash    Spatial hash of atoms
+            PDB      *q       An atom
+   Returns: BOOL              Is any hashed atom within DISTCUTOFF?
+
+   Checks the atoms in the buckets of the cell containing q and the 26
+   cells around it (so hash->cellSize must be at least DISTCUTOFF). 
+   Other cells that share those buckets are checked too but this doesn't
+   affect the result.
+
+   16.10.26 Original   By: agent
+*/
+BOOL NearHashedAtom(ATOMHASH *hash, PDB *q)
+{
+   int ix = HASHCELL(q->x, hash->cellSize),
+       iy = HASHCELL(q->y, hash->cellSize),
+       iz = HASHCELL(q->z, hash->cellSize),
+       x, y, z, i;
+
+   if(hash->nAtoms == 0)
+      return(FALSE);
+   
+   for(x=ix-1; x<=ix+1; x++)
+   {
+      for(y=iy-1; y<=iy+1; y++)
+      {
+         for(z=iz-1; z<=iz+1; z++)
+         {
+            for(i=hash->bucketHead[HashCell(x, y, z, hash->nBuckets)];
+                i>=0;
+                i=hash->atomNext[i])
+            {
+               REAL dx = hash->xyz[3*i]   - q->x,
+                    dy = hash->xyz[3*i+1] - q->y,
+                    dz = hash->xyz[3*i+2] - q->z;
+               
+               if((dx*dx + dy*dy + dz*dz) < DISTCUTOFFSQ)
+                  return(TRUE);
+            }
+         }
+      }
+   }
+   
+   return(FALSE);
 }
 
 
@@ -759,3 +1151,596 @@ void ClearResidueFlags(PDBSTRUCT *pdbs)
       }
    }
 }
+
+
+/************************************************************************/
+/*>BOOL StreamRNAAndNear(FILE *in, FILE *out, BOOL resLevel)
+   ---------------------------------------------------------
+   Input:   FILE  *in        Input PDB file
+            FILE  *out       Output PDB file
+            BOOL  resLevel   Do residue level nearness
+   Returns: BOOL             Success
+
+   Does the same as reading the whole file and calling 
+   FindChainsNearRNA() or FindResiduesNearRNA() then 
+   PrintRNANearChains(), but reads the file a chain at a time. The first
+   pass keeps only the coordinates of the RNA chains, in a spatial hash, 
+   and their bounding boxes. The second pass writes the RNA chains and
+   checks each other chain against the hash, writing it (or its residues
+   near RNA) before it is freed.
+
+   If the input is not seekable (e.g. stdin), it is copied to a 
+   temporary file.
+
+   16.10.26 Original   By: agent
+*/
+BOOL StreamRNAAndNear(FILE *in, FILE *out, BOOL resLevel)
+{
+   CHAINREADER reader;
+   ATOMHASH    hash;
+   CHAININFO   *rnaBoxes = NULL,
+               box;
+   PDB         *chain,
+               *p, *q,
+               *nextRes;
+   FILE        *tmp = NULL;
+   int         nRNA = 0,
+               i;
+
+   /* Make sure we can read the file twice                              */
+   if(fseek(in, 0L, SEEK_SET))
+   {
+      char buffer[MAXBUFF];
+      
+      if((tmp = tmpfile())==NULL)
+      {
+         fprintf(stderr, "Unable to open temporary file\n");
+         return(FALSE);
+      }
+      while(fgets(buffer, MAXBUFF, in))
+         fputs(buffer, tmp);
+      in = tmp;
+   }
+   rewind(in);
+
+   /* First pass: index the RNA                                         */
+   if(!FindRNAInStream(in, &hash, &rnaBoxes, &nRNA))
+   {
+      fprintf(stderr, "No memory for RNA atom hash\n");
+      if(tmp != NULL) fclose(tmp);
+      return(FALSE);
+   }
+   
+   /* Second pass: one chain at a time                                  */
+   rewind(in);
+   reader.fp       = in;
+   reader.haveLine = FALSE;
+   reader.done     = FALSE;
+   
+   while((chain = ReadNextChain(&reader))!=NULL)
+   {
+      if(FindChainType(chain, NULL, FALSE, FALSE) == TYPE_RNA)
+      {
+         for(q=chain; q!=NULL; NEXT(q))
+            WritePDBRecord(out, q);
+      }
+      else
+      {
+         SetBounds(chain, NULL, &box.xmin, &box.xmax, &box.ymin, 
+                   &box.ymax, &box.zmin, &box.zmax);
+         for(i=0; i<nRNA; i++)
+         {
+            if(BoxesClose(&(rnaBoxes[i]), &box))
+               break;
+         }
+
+         if(i < nRNA)
+         {
+            if(resLevel)
+            {
+               for(p=chain; p!=NULL; p=nextRes)
+               {
+                  nextRes = FindNextResidue(p);
+                  for(q=p; q!=nextRes; NEXT(q))
+                  {
+                     if(NearHashedAtom(&hash, q))
+                        break;
+                  }
+                  if(q != nextRes)
+                  {
+                     fprintf(stderr, "Near Residue %s %c%d%c\n",
+                             p->resnam, p->chain[0], p->resnum, 
+                             p->insert[0]);
+                     for(q=p; q!=nextRes; NEXT(q))
+                        WritePDBRecord(out, q);
+                  }
+               }
+            }
+            else
+            {
+               for(q=chain; q!=NULL; NEXT(q))
+               {
+                  if(NearHashedAtom(&hash, q))
+                     break;
+               }
+               if(q != NULL)
+               {
+                  fprintf(stderr,"Near Chain %s\n", chain->chain);
+                  for(q=chain; q!=NULL; NEXT(q))
+                     WritePDBRecord(out, q);
+               }
+            }
+         }
+      }
+      
+      FREELIST(chain, PDB);
+   }
+   
+   FreeAtomHash(&hash);
+   if(rnaBoxes != NULL)
+      free(rnaBoxes);
+   if(tmp != NULL)
+      fclose(tmp);
+   
+   return(TRUE);
+}
+
+
+/************************************************************************/
+/*>BOOL FindRNAInStream(FILE *in, ATOMHASH *hash, CHAININFO **rnaBoxes,
+                        int *nRNA)
+   --------------------------------------------------------------------
+   Input:   FILE      *in        Input PDB file
+   Output:  ATOMHASH  *hash      Spatial hash of the RNA atoms
+            CHAININFO **rnaBoxes Malloc'd bounding boxes of the RNA 
+                                 chains
+            int       *nRNA      Number of RNA chains
+   Returns: BOOL                 Success (FALSE if no memory)
+
+   First pass of StreamRNAAndNear(). Reads the file a chain at a time,
+   keeping only the coordinates and bounding box of each RNA chain.
+
+   16.10.26 Original   By: agent
+*/
+BOOL FindRNAInStream(FILE *in, ATOMHASH *hash, CHAININFO **rnaBoxes,
+                     int *nRNA)
+{
+   CHAINREADER reader;
+   PDB         *chain;
+   BOOL        ok = TRUE;
+
+   hash->cellSize   = (REAL)DISTCUTOFF;
+   hash->xyz        = NULL;
+   hash->bucketHead = NULL;
+   hash->atomNext   = NULL;
+   hash->nAtoms     = 0;
+   hash->maxAtoms   = 0;
+   *rnaBoxes        = NULL;
+   *nRNA            = 0;
+
+   reader.fp        = in;
+   reader.haveLine  = FALSE;
+   reader.done      = FALSE;
+
+   while(ok && ((chain = ReadNextChain(&reader))!=NULL))
+   {
+      if(FindChainType(chain, NULL, FALSE, FALSE) == TYPE_RNA)
+      {
+         CHAININFO *boxes;
+
+         fprintf(stderr,"RNA Chain %s\n", chain->chain);
+         if((boxes = (CHAININFO *)realloc(*rnaBoxes, 
+                                          (*nRNA+1) * sizeof(CHAININFO)))
+            ==NULL)
+         {
+            ok = FALSE;
+         }
+         else
+         {
+            *rnaBoxes = boxes;
+            boxes[*nRNA].type = CHAIN_RNA;
+            SetBounds(chain, NULL, 
+                      &(boxes[*nRNA].xmin), &(boxes[*nRNA].xmax),
+                      &(boxes[*nRNA].ymin), &(boxes[*nRNA].ymax),
+                      &(boxes[*nRNA].zmin), &(boxes[*nRNA].zmax));
+            (*nRNA)++;
+            ok = AddHashAtoms(hash, chain, NULL);
+         }
+      }
+      FREELIST(chain, PDB);
+   }
+
+   if(ok)
+      ok = IndexAtomHash(hash);
+   
+   if(!ok)
+   {
+      FreeAtomHash(hash);
+      if(*rnaBoxes != NULL)
+         free(*rnaBoxes);
+      *rnaBoxes = NULL;
+      *nRNA     = 0;
+   }
+   
+   return(ok);
+}
+
+
+/************************************************************************/
+/*>PDB *ReadNextChain(CHAINREADER *reader)
+   ---------------------------------------
+   I/O:     CHAINREADER *reader  The file and the first record of the
+                                 next chain
+   Returns: PDB *                The next chain (NULL at the end of the
+                                 file or first model)
+
+   Reads the ATOM and HETATM records of the next run of records with the
+   same chain label, as AllocPDBStructure() would split them, and 
+   returns them as a PDB linked list. The records are passed to ReadPDB()
+   via a temporary file so they are read exactly as a whole file is.
+
+   16.10.26 Original   By: agent
+*/
+PDB *ReadNextChain(CHAINREADER *reader)
+{
+   FILE *tmp;
+   PDB  *pdb = NULL;
+   char chain;
+   int  natoms,
+        nRecords;
+
+   /* Skip any run of records from which no atoms are read              */
+   while((pdb == NULL) && (!reader->done || reader->haveLine))
+   {
+      if((tmp = tmpfile())==NULL)
+         return(NULL);
+
+      chain    = '\0';
+      nRecords = 0;
+      if(reader->haveLine)
+      {
+         fputs(reader->line, tmp);
+         chain = reader->line[21];
+         reader->haveLine = FALSE;
+         nRecords++;
+      }
+
+      while(!reader->done && fgets(reader->line, MAXBUFF, reader->fp))
+      {
+         if(!strncmp(reader->line, "ENDMDL", 6))
+         {
+            reader->done = TRUE;
+            break;
+         }
+      
+         if(strncmp(reader->line, "ATOM  ", 6) && 
+            strncmp(reader->line, "HETATM", 6))
+            continue;
+
+         if(nRecords && (reader->line[21] != chain))
+         {
+            reader->haveLine = TRUE;
+            break;
+         }
+         chain = reader->line[21];
+         fputs(reader->line, tmp);
+         nRecords++;
+      }
+      if(feof(reader->fp))
+         reader->done = TRUE;
+
+      rewind(tmp);
+      if(nRecords)
+         pdb = ReadPDB(tmp, &natoms);
+      fclose(tmp);
+   }
+   
+   return(pdb);
+}
+
+
+/************************************************************************/
+/*>BOOL FindChainDistances(PDBSTRUCT *pdbs, REAL maxCutoff, 
+                           CHAINDISTS *dists)
+   --------------------------------------------------------
+   Input:   PDBSTRUCT  *pdbs      PDB structure
+            REAL       maxCutoff  Largest distance of interest
+   Output:  CHAINDISTS *dists     Chain types and the minimum distance 
+                                  between each pair of chains
+   Returns: BOOL                  Success (FALSE if no memory)
+
+   Finds the minimum distance between every pair of chains which come 
+   closer than maxCutoff, in one pass over a spatial hash of all the 
+   atoms with cells of side maxCutoff. Whether two chains are closer 
+   than any smaller cutoff can then be answered with ChainDistance().
+   As elsewhere, a distance equal to a cutoff is not a contact.
+
+   Chains are typed with FindChainType() counting peptides as a separate
+   type, and protein chains which are mostly non-standard amino acids
+   (e.g. ligands) as non-standard.
+
+   16.10.26 Original   By: agent
+   17.10.26 Contacts are strictly closer than maxCutoff   By: agent
+*/
+BOOL FindChainDistances(PDBSTRUCT *pdbs, REAL maxCutoff, 
+                        CHAINDISTS *dists)
+{
+   PDBCHAIN *chain;
+   ATOMHASH hash;
+   REAL     maxCutoffSq = maxCutoff * maxCutoff;
+   int      *atomChain = NULL,
+            i, j;
+
+   dists->labels    = NULL;
+   dists->types     = NULL;
+   dists->minDist   = NULL;
+   dists->nChains   = 0;
+   dists->maxCutoff = maxCutoff;
+
+   hash.cellSize    = maxCutoff;
+   hash.xyz         = NULL;
+   hash.bucketHead  = NULL;
+   hash.atomNext    = NULL;
+   hash.nAtoms      = 0;
+   hash.maxAtoms    = 0;
+
+   for(chain=pdbs->chains; chain!=NULL; NEXT(chain))
+      dists->nChains++;
+
+   if(((dists->labels = (char (*)[8])malloc((dists->nChains+1) * 8))
+       ==NULL) ||
+      ((dists->types = (int *)malloc((dists->nChains+1) * sizeof(int)))
+       ==NULL) ||
+      ((dists->minDist = (REAL *)malloc((dists->nChains * dists->nChains
+                                         + 1) * sizeof(REAL)))==NULL))
+   {
+      FreeChainDistances(dists);
+      return(FALSE);
+   }
+   for(i=0; i<dists->nChains * dists->nChains; i++)
+      dists->minDist[i] = NOCONTACT;
+
+   /* Type the chains and hash their atoms, noting the chain of each    */
+   for(chain=pdbs->chains, i=0; chain!=NULL; NEXT(chain), i++)
+   {
+      int first = hash.nAtoms;
+      
+      strncpy(dists->labels[i], chain->chain, 8);
+      dists->labels[i][7] = '\0';
+      dists->types[i] = FindChainType(chain->start, chain->stop, 
+                                      TRUE, FALSE);
+      if((dists->types[i] == TYPE_PROTEIN) || 
+         (dists->types[i] == TYPE_PEPTIDE))
+      {
+         dists->types[i] = FindChainType(chain->start, chain->stop, 
+                                         TRUE, TRUE);
+      }
+      if(!AddHashAtoms(&hash, chain->start, chain->stop))
+         break;
+
+      if(hash.nAtoms > first)
+      {
+         int *newChain;
+         
+         if((newChain = (int *)realloc(atomChain, 
+                                       hash.nAtoms * sizeof(int)))==NULL)
+            break;
+         atomChain = newChain;
+         for(j=first; j<hash.nAtoms; j++)
+            atomChain[j] = i;
+      }
+   }
+   if((chain != NULL) || !IndexAtomHash(&hash))
+   {
+      FreeAtomHash(&hash);
+      if(atomChain != NULL)
+         free(atomChain);
+      FreeChainDistances(dists);
+      return(FALSE);
+   }
+
+   /* Compare each atom with the atoms of later chains in the cells
+      around it
+   */
+   for(i=0; i<hash.nAtoms; i++)
+   {
+      REAL *a  = hash.xyz + 3*i;
+      int  ix  = HASHCELL(a[0], hash.cellSize),
+           iy  = HASHCELL(a[1], hash.cellSize),
+           iz  = HASHCELL(a[2], hash.cellSize),
+           ci  = atomChain[i],
+           x, y, z;
+
+      for(x=ix-1; x<=ix+1; x++)
+      {
+         for(y=iy-1; y<=iy+1; y++)
+         {
+            for(z=iz-1; z<=iz+1; z++)
+            {
+               for(j=hash.bucketHead[HashCell(x, y, z, hash.nBuckets)];
+                   j>=0;
+                   j=hash.atomNext[j])
+               {
+                  REAL *b = hash.xyz + 3*j,
+                       *d,
+                       dSq;
+                  
+                  if(atomChain[j] <= ci)
+                     continue;
+
+                  dSq = (a[0]-b[0])*(a[0]-b[0]) +
+                        (a[1]-b[1])*(a[1]-b[1]) +
+                        (a[2]-b[2])*(a[2]-b[2]);
+                  d   = &(dists->minDist[ci*dists->nChains + 
+                                         atomChain[j]]);
+                  if((dSq < maxCutoffSq) && 
+                     ((*d == NOCONTACT) || (dSq < *d)))
+                     *d = dSq;
+               }
+            }
+         }
+      }
+   }
+
+   /* Store as distances, filling in both halves of the matrix          */
+   for(i=0; i<dists->nChains; i++)
+   {
+      for(j=i+1; j<dists->nChains; j++)
+      {
+         REAL d = dists->minDist[i*dists->nChains + j];
+         
+         if(d != NOCONTACT)
+            d = (REAL)sqrt(d);
+         dists->minDist[i*dists->nChains + j] = d;
+         dists->minDist[j*dists->nChains + i] = d;
+      }
+   }
+
+   FreeAtomHash(&hash);
+   if(atomChain != NULL)
+      free(atomChain);
+   return(TRUE);
+}
+
+
+/************************************************************************/
+/*>void FreeChainDistances(CHAINDISTS *dists)
+   ------------------------------------------
+   16.10.26 Original   By: agent
+*/
+void FreeChainDistances(CHAINDISTS *dists)
+{
+   if(dists->labels != NULL)
+      free(dists->labels);
+   if(dists->types != NULL)
+      free(dists->types);
+   if(dists->minDist != NULL)
+      free(dists->minDist);
+   dists->labels  = NULL;
+   dists->types   = NULL;
+   dists->minDist = NULL;
+   dists->nChains = 0;
+}
+
+
+/************************************************************************/
+/*>REAL ChainDistance(CHAINDISTS *dists, int chain1, int chain2)
+   -------------------------------------------------------------
+   Input:   CHAINDISTS *dists    From FindChainDistances()
+            int        chain1    Chain index
+            int        chain2    Chain index
+   Returns: REAL                 Minimum distance between the chains or
+                                 NOCONTACT if further apart than 
+                                 dists->maxCutoff
+
+   16.10.26 Original   By: agent
+*/
+REAL ChainDistance(CHAINDISTS *dists, int chain1, int chain2)
+{
+   return(dists->minDist[chain1*dists->nChains + chain2]);
+}
+
+
+/************************************************************************/
+/*>void PrintChainDistances(FILE *out, CHAINDISTS *dists, REAL *cutoffs, 
+                            int nCutoffs)
+   ----------------------------------------------------------------------
+   Input:   FILE       *out      Output file
+            CHAINDISTS *dists    From FindChainDistances()
+            REAL       *cutoffs  Cutoffs
+            int        nCutoffs  Number of cutoffs
+
+   Prints the chain types, the minimum distance between each pair of 
+   chains within the largest cutoff and, for each pair of chain types,
+   the minimum distance and the number of chain pairs closer than each
+   cutoff. Chains are numbered from 1 in the CHAIN and PAIR records
+   since several chains (e.g. ATOM and HETATM) may share a label.
+
+   16.10.26 Original   By: agent
+   17.10.26 Chain numbers in CHAIN and PAIR records   By: agent
+*/
+void PrintChainDistances(FILE *out, CHAINDISTS *dists, REAL *cutoffs, 
+                         int nCutoffs)
+{
+   int  i, j, k, t1, t2;
+   
+   for(i=0; i<dists->nChains; i++)
+   {
+      fprintf(out, "CHAIN %d %s %s\n", i+1,
+              dists->labels[i], ChainTypeName(dists->types[i]));
+   }
+   
+   for(i=0; i<dists->nChains; i++)
+   {
+      for(j=i+1; j<dists->nChains; j++)
+      {
+         if(ChainDistance(dists, i, j) != NOCONTACT)
+         {
+            fprintf(out, "PAIR %d %d %s %s %.3f\n", i+1, j+1,
+                    dists->labels[i], dists->labels[j],
+                    ChainDistance(dists, i, j));
+         }
+      }
+   }
+   
+   for(t1=0; t1<NCHAINTYPES; t1++)
+   {
+      for(t2=t1; t2<NCHAINTYPES; t2++)
+      {
+         REAL minDist = NOCONTACT;
+         int  counts[MAXCUTOFFS];
+
+         for(k=0; k<nCutoffs; k++)
+            counts[k] = 0;
+         
+         for(i=0; i<dists->nChains; i++)
+         {
+            for(j=i+1; j<dists->nChains; j++)
+            {
+               REAL d = ChainDistance(dists, i, j);
+               
+               if((d == NOCONTACT) ||
+                  !(((dists->types[i] == t1) && (dists->types[j] == t2)) ||
+                    ((dists->types[i] == t2) && (dists->types[j] == t1))))
+                  continue;
+
+               if((minDist == NOCONTACT) || (d < minDist))
+                  minDist = d;
+               for(k=0; k<nCutoffs; k++)
+               {
+                  if(d < cutoffs[k])
+                     counts[k]++;
+               }
+            }
+         }
+
+         if(minDist != NOCONTACT)
+         {
+            fprintf(out, "TYPES %s %s %.3f", 
+                    ChainTypeName(t1), ChainTypeName(t2), minDist);
+            for(k=0; k<nCutoffs; k++)
+               fprintf(out, " %.2f:%d", cutoffs[k], counts[k]);
+            fprintf(out, "\n");
+         }
+      }
+   }
+}
+
+
+/************************************************************************/
+/*>char *ChainTypeName(int type)
+   -----------------------------
+   Input:   int   type      Chain type from FindChainType()
+   Returns: char  *         Name of the type
+
+   16.10.26 Original   By: agent
+*/
+char *ChainTypeName(int type)
+{
+   static char *names[] = {"undefined", "RNA", "DNA", "protein", 
+                           "hybrid", "peptide", "nonstandard"};
+
+   if((type < 0) || (type >= NCHAINTYPES))
+      return("unknown");
+   return(names[type]);
+}
@@ -3,8 +3,8 @@
    Program:    pdbsphere
    File:       pdbsphere.c
    
-   Version:    V1.1
-   Date:       05.11.07
+   Version:    V1.3
+   Date:       16.10.26
    Function:   Output all aminoacids within range from central aminoacid in
                a PDB file
    
@@ -40,6 +40,9 @@
    Inputs ID of a central residue and a PDB file. 
    Outputs all residues from that PDB file, within 8 angstroms (default 
    range) of central residue's coordinates.
+   With -q, reads a list of central residues (each optionally with its
+   own range) and answers them all from one read of the PDB file, using
+   a grid of the atoms built once.
 
 **************************************************************************
 
@@ -54,11 +57,17 @@
    V1.1  05.11.07  Added -r, -s, -h command line options
    V1.2  17.12.07  Changed output format to [chain]:resnum:[insert]
                    By: Anja
+   V1.3  16.10.26  FlagResiduesInRange() stops at the first atom in 
+                   range. Added -q for many central residues per run
+                   By: agent
 
 **************************************************************************/
 /* Includes
 */
 #include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
 #include "bioplib/pdb.h"
 #include "bioplib/SysDefs.h"
 #include "bioplib/MathType.h"
@@ -68,6 +77,25 @@
 /* Defines and macros
 */
 #define MAXBUFF 160
+#define CELLSIZE  4.0         /* Grid cell size for -q                 */
+#define MAXCELLS  1000000     /* Cells are enlarged to stay below this */
+#define CELLINDEX(g,x,y,z) (((z) * (g)->ny + (y)) * (g)->nx + (x))
+
+/* Grid of all atoms, with the residue of each, for -q                  */
+typedef struct
+{
+   PDB    **atoms,
+          **resStart,         /* First atom of each residue            */
+          **resStop;          /* First atom of the next residue        */
+   int    *atomRes,           /* Residue index of each atom            */
+          *atomNext,          /* Next atom in the same cell            */
+          *cellHead,          /* First atom in each cell               */
+          nAtoms,
+          nRes,
+          nx, ny, nz;
+   double xmin, ymin, zmin,
+          cellSize;
+} SPHEREGRID;
 
 /************************************************************************/
 /* Globals
@@ -81,8 +109,19 @@ void FlagResiduesInRange(PDB *pdb, PDB *central, double radiusSq);
 void WriteAtoms(PDB *pdb, FILE *out);
 void WriteResidues(PDB *pdb, FILE *out);
 BOOL ParseCmdLine(int argc, char **argv,char *resspec, char *InFile, 
-                  char *OutFile, BOOL *summary, double *radiusSq);
+                  char *OutFile, BOOL *summary, double *radiusSq,
+                  char *QueryFile);
 void Usage(void);
+BOOL RunQueries(PDB *pdb, FILE *qfp, FILE *out, BOOL summary,
+                double radiusSq);
+BOOL BuildSphereGrid(PDB *pdb, int natom, SPHEREGRID *grid);
+void FreeSphereGrid(SPHEREGRID *grid);
+int FindGridResidue(SPHEREGRID *grid, char *resspec);
+int FindResiduesInRange(SPHEREGRID *grid, int central, double radiusSq,
+                        int *mark, int queryNum, int *found);
+void WriteFoundResidues(SPHEREGRID *grid, int *found, int nFound, 
+                        FILE *out);
+int CompareInts(const void *a, const void *b);
 
 /* ******************************************************************* */
 
@@ -95,7 +134,11 @@ void Usage(void);
                      range from central residue.
            -r radius:Changes range to radius
            -s       :Summary, outputs only a list of residues' IDs
+           -q file  :Read central residue IDs (and optional ranges) 
+                     from a file rather than the command line
            -h       :Prints out help
+
+   16.10.26 Added -q   By: agent
 */
 
 
@@ -109,11 +152,13 @@ int main(int argc, char **argv)
    double radiusSq;
    char   resspec[MAXBUFF],
           InFile[MAXBUFF],
-          OutFile[MAXBUFF];
+          OutFile[MAXBUFF],
+          QueryFile[MAXBUFF];
     BOOL  summary;
 
 
-   if (ParseCmdLine(argc, argv, resspec, InFile, OutFile, &summary, &radiusSq))
+   if (ParseCmdLine(argc, argv, resspec, InFile, OutFile, &summary, &radiusSq,
+                    QueryFile))
    {
       if (OpenStdFiles(InFile, OutFile, &in, &out))
       {
@@ -123,6 +168,21 @@ int main(int argc, char **argv)
             return(1);
          }
          
+         else if (QueryFile[0])
+         {
+            FILE *qfp;
+            
+            if ((qfp=fopen(QueryFile, "r"))==NULL)
+            {
+               fprintf(stderr,"pdbsphere: Unable to open query file %s\n",
+                       QueryFile);
+               return(1);
+            }
+            if (!RunQueries(pdb, qfp, out, summary, radiusSq))
+               return(1);
+            fclose(qfp);
+         }
+         
          else
          {        
             if ((central=FindResidueSpec(pdb, resspec))==NULL)
@@ -171,6 +231,8 @@ Input:   PDB    *pdb
                             range (radius is squared for speed)
 Output:  If any atom in a residue is within range from *central, marks all 
          atoms in that residue (sets occ parameter to 2.00) 
+
+   16.10.26 Stops at the first atom in range   By: agent
 */
 
 void FlagResiduesInRange(PDB *pdb, PDB *central, double radiusSq)
@@ -190,15 +252,14 @@ void FlagResiduesInRange(PDB *pdb, PDB *central, double radiusSq)
      aaInRange=FALSE;
      nextCurrentRes=FindNextResidue(current);
 
-     for (q=current; q!=nextCurrentRes; NEXT(q))
+     for (q=current; (q!=nextCurrentRes) && !aaInRange; NEXT(q))
      {            
         for (p=central; p!=nextPRes; NEXT(p))
         {
            if (DISTSQ(p, q)<radiusSq)
            {
               aaInRange=TRUE;
-              /*q=nextCurrentRes;
-                break;*/
+              break;
            }
         }
       }
@@ -218,6 +279,356 @@ void FlagResiduesInRange(PDB *pdb, PDB *central, double radiusSq)
 
 
 
+/************************************************************************/
+/*>BOOL RunQueries(PDB *pdb, FILE *qfp, FILE *out, BOOL summary,
+                   double radiusSq)
+   -----------------------------------------------------------------
+   Input:   PDB    *pdb       PDB linked list
+            FILE   *qfp       Query file
+            FILE   *out       Output file
+            BOOL   summary    Output residue IDs rather than atoms
+            double radiusSq   Default range (squared)
+   Returns: BOOL              Success (FALSE if no memory)
+
+   Each line of the query file is a central residue ID, optionally 
+   followed by a range for that residue. Blank lines and lines starting
+   with # are skipped. A grid of the atoms is built once and the residues
+   in range of each central residue are found from the nearby cells.
+
+   The output for each query is as for a single residue, but with a 
+   REMARK record giving the central residue and range before the atoms 
+   or, for -s, with the central residue ID before each residue ID.
+
+   16.10.26 Original   By: agent
+*/
+BOOL RunQueries(PDB *pdb, FILE *qfp, FILE *out, BOOL summary,
+                double radiusSq)
+{
+   SPHEREGRID grid;
+   PDB        *p;
+   char       buffer[MAXBUFF],
+              resspec[MAXBUFF];
+   int        *mark  = NULL,
+              *found = NULL,
+              natom  = 0,
+              queryNum = 0,
+              central, nFound, i;
+
+   for (p=pdb; p!=NULL; NEXT(p))
+      natom++;
+   
+   if (!BuildSphereGrid(pdb, natom, &grid) ||
+       ((mark=(int *)malloc(grid.nRes * sizeof(int)))==NULL) ||
+       ((found=(int *)malloc(grid.nRes * sizeof(int)))==NULL))
+   {
+      fprintf(stderr,"pdbsphere: No memory for atom grid\n");
+      FreeSphereGrid(&grid);
+      if (mark!=NULL) free(mark);
+      return(FALSE);
+   }
+   for (i=0; i<grid.nRes; i++)
+      mark[i] = (-1);
+
+   while (fgets(buffer, MAXBUFF, qfp))
+   {
+      double radius, 
+             queryRadiusSq = radiusSq;
+      int    nFields;
+      
+      nFields = sscanf(buffer, "%s %lf", resspec, &radius);
+      if ((nFields < 1) || (resspec[0] == '#'))
+         continue;
+      if (nFields == 2)
+         queryRadiusSq = radius * radius;
+
+      if ((central=FindGridResidue(&grid, resspec)) < 0)
+      {
+         fprintf(stderr,"pdbsphere: Aminoacid %s not found\n", resspec);
+         continue;
+      }
+
+      nFound = FindResiduesInRange(&grid, central, queryRadiusSq, mark,
+                                   queryNum++, found);
+
+      if (summary)
+      {
+         for (i=0; i<nFound; i++)
+         {
+            p = grid.resStart[found[i]];
+            fprintf(out, "%s %s:%d:%s\n", resspec, 
+                    p->chain, p->resnum, p->insert);
+         }
+      }
+      else
+      {
+         fprintf(out, "REMARK   1 PDBSPHERE %s %.3f\n", resspec, 
+                 sqrt(queryRadiusSq));
+         WriteFoundResidues(&grid, found, nFound, out);
+      }
+   }
+
+   FreeSphereGrid(&grid);
+   free(mark);
+   free(found);
+   return(TRUE);
+}
+
+
+/************************************************************************/
+/*>BOOL BuildSphereGrid(PDB *pdb, int natom, SPHEREGRID *grid)
+   ------------------------------------------------------------
+   Input:   PDB        *pdb    PDB linked list
+            int        natom   Number of atoms
+   Output:  SPHEREGRID *grid   Grid of the atoms and list of residues
+   Returns: BOOL               Success (FALSE if no memory)
+
+   Places every atom on a grid of CELLSIZE cubic cells (enlarged if 
+   needed to keep below MAXCELLS cells) and records the residue that 
+   each atom is in.
+
+   16.10.26 Original   By: agent
+*/
+BOOL BuildSphereGrid(PDB *pdb, int natom, SPHEREGRID *grid)
+{
+   PDB    *p,
+          *nextRes;
+   double xmax, ymax, zmax;
+   int    nCells, i, n;
+
+   memset(grid, 0, sizeof(SPHEREGRID));
+
+   for (p=pdb; p!=NULL; p=FindNextResidue(p))
+      grid->nRes++;
+   
+   if (((grid->atoms=(PDB **)malloc((natom+1) * sizeof(PDB *)))==NULL) ||
+       ((grid->atomRes=(int *)malloc((natom+1) * sizeof(int)))==NULL) ||
+       ((grid->atomNext=(int *)malloc((natom+1) * sizeof(int)))==NULL) ||
+       ((grid->resStart=(PDB **)malloc((grid->nRes+1) * sizeof(PDB *)))
+        ==NULL) ||
+       ((grid->resStop=(PDB **)malloc((grid->nRes+1) * sizeof(PDB *)))
+        ==NULL))
+      return(FALSE);
+
+   /* List the residues and atoms, finding the bounds                   */
+   xmax = ymax = zmax = 0.0;
+   for (p=pdb, i=0, n=0; p!=NULL; p=nextRes, i++)
+   {
+      nextRes = FindNextResidue(p);
+      grid->resStart[i] = p;
+      grid->resStop[i]  = nextRes;
+      
+      for ( ; p!=nextRes; NEXT(p), n++)
+      {
+         if (n==0)
+         {
+            grid->xmin = xmax = p->x;
+            grid->ymin = ymax = p->y;
+            grid->zmin = zmax = p->z;
+         }
+         grid->xmin = MIN(grid->xmin, p->x);  xmax = MAX(xmax, p->x);
+         grid->ymin = MIN(grid->ymin, p->y);  ymax = MAX(ymax, p->y);
+         grid->zmin = MIN(grid->zmin, p->z);  zmax = MAX(zmax, p->z);
+         grid->atoms[n]   = p;
+         grid->atomRes[n] = i;
+      }
+   }
+   grid->nAtoms = n;
+
+   grid->cellSize = CELLSIZE;
+   for (;;)
+   {
+      grid->nx = 1 + (int)((xmax - grid->xmin) / grid->cellSize);
+      grid->ny = 1 + (int)((ymax - grid->ymin) / grid->cellSize);
+      grid->nz = 1 + (int)((zmax - grid->zmin) / grid->cellSize);
+      if ((double)grid->nx * grid->ny * grid->nz <= MAXCELLS)
+         break;
+      grid->cellSize *= 2;
+   }
+   nCells = grid->nx * grid->ny * grid->nz;
+   
+   if ((grid->cellHead=(int *)malloc(nCells * sizeof(int)))==NULL)
+      return(FALSE);
+   for (i=0; i<nCells; i++)
+      grid->cellHead[i] = (-1);
+   
+   for (n=0; n<grid->nAtoms; n++)
+   {
+      int cell;
+
+      p    = grid->atoms[n];
+      cell = CELLINDEX(grid,
+                       (int)((p->x - grid->xmin) / grid->cellSize),
+                       (int)((p->y - grid->ymin) / grid->cellSize),
+                       (int)((p->z - grid->zmin) / grid->cellSize));
+      grid->atomNext[n]    = grid->cellHead[cell];
+      grid->cellHead[cell] = n;
+   }
+   
+   return(TRUE);
+}
+
+
+/************************************************************************/
+/*>void FreeSphereGrid(SPHEREGRID *grid)
+   -------------------------------------
+   16.10.26 Original   By: agent
+*/
+void FreeSphereGrid(SPHEREGRID *grid)
+{
+   if (grid->atoms!=NULL)    free(grid->atoms);
+   if (grid->atomRes!=NULL)  free(grid->atomRes);
+   if (grid->atomNext!=NULL) free(grid->atomNext);
+   if (grid->cellHead!=NULL) free(grid->cellHead);
+   if (grid->resStart!=NULL) free(grid->resStart);
+   if (grid->resStop!=NULL)  free(grid->resStop);
+   memset(grid, 0, sizeof(SPHEREGRID));
+}
+
+
+/************************************************************************/
+/*>int FindGridResidue(SPHEREGRID *grid, char *resspec)
+   ----------------------------------------------------
+   Input:   SPHEREGRID *grid     Grid with its list of residues
+            char       *resspec  Residue ID
+   Returns: int                  Index of the residue (-1 if not found)
+
+   16.10.26 Original   By: agent
+*/
+int FindGridResidue(SPHEREGRID *grid, char *resspec)
+{
+   char chain[8],
+        insert[8];
+   int  resnum, 
+        i;
+
+   if (!ParseResSpec(resspec, chain, &resnum, insert))
+      return(-1);
+
+   for (i=0; i<grid->nRes; i++)
+   {
+      PDB *p = grid->resStart[i];
+      
+      if ((p->resnum==resnum) && 
+          !strcmp(p->chain, chain) && 
+          !strcmp(p->insert, insert))
+         return(i);
+   }
+   return(-1);
+}
+
+
+/************************************************************************/
+/*>int FindResiduesInRange(SPHEREGRID *grid, int central, double radiusSq,
+                           int *mark, int queryNum, int *found)
+   -----------------------------------------------------------------------
+   Input:   SPHEREGRID *grid      Grid of the atoms
+            int        central    Index of the central residue
+            double     radiusSq   Range (squared)
+            int        queryNum   Query number
+   I/O:     int        *mark      Per-residue flags. Set to queryNum for
+                                  each residue found
+   Output:  int        *found     Indexes of the residues in range, in
+                                  file order
+   Returns: int                   Number of residues found
+
+   Finds the residues with any atom within range of any atom of the 
+   central residue, looking only at grid cells which could hold such
+   atoms. As with FlagResiduesInRange(), the central residue is itself
+   included.
+
+   16.10.26 Original   By: agent
+*/
+int FindResiduesInRange(SPHEREGRID *grid, int central, double radiusSq,
+                        int *mark, int queryNum, int *found)
+{
+   PDB *p;
+   int reach  = (int)ceil(sqrt(radiusSq) / grid->cellSize),
+       nFound = 0;
+
+   for (p=grid->resStart[central]; p!=grid->resStop[central]; NEXT(p))
+   {
+      int ix = (int)((p->x - grid->xmin) / grid->cellSize),
+          iy = (int)((p->y - grid->ymin) / grid->cellSize),
+          iz = (int)((p->z - grid->zmin) / grid->cellSize),
+          x, y, z, a;
+
+      for (z=MAX(iz-reach, 0); z<=MIN(iz+reach, grid->nz-1); z++)
+      {
+         for (y=MAX(iy-reach, 0); y<=MIN(iy+reach, grid->ny-1); y++)
+         {
+            for (x=MAX(ix-reach, 0); x<=MIN(ix+reach, grid->nx-1); x++)
+            {
+               for (a=grid->cellHead[CELLINDEX(grid, x, y, z)];
+                    a>=0;
+                    a=grid->atomNext[a])
+               {
+                  int r = grid->atomRes[a];
+                  
+                  if ((mark[r]!=queryNum) && 
+                      (DISTSQ(p, grid->atoms[a])<radiusSq))
+                  {
+                     mark[r]         = queryNum;
+                     found[nFound++] = r;
+                  }
+               }
+            }
+         }
+      }
+   }
+
+   if (nFound > 1)
+      qsort(found, nFound, sizeof(int), CompareInts);
+   return(nFound);
+}
+
+
+/************************************************************************/
+/*>void WriteFoundResidues(SPHEREGRID *grid, int *found, int nFound, 
+                           FILE *out)
+   -----------------------------------------------------------------
+   Input:   SPHEREGRID *grid      Grid with its list of residues
+            int        *found     Indexes of the residues to write
+            int        nFound     Number of residues
+            FILE       *out       Output file
+
+   Writes the atoms of the residues found for a query, with occupancy 
+   set to 1.00 as WriteAtoms() does
+
+   16.10.26 Original   By: agent
+*/
+void WriteFoundResidues(SPHEREGRID *grid, int *found, int nFound, 
+                        FILE *out)
+{
+   PDB *p;
+   int i;
+
+   for (i=0; i<nFound; i++)
+   {
+      for (p=grid->resStart[found[i]]; p!=grid->resStop[found[i]]; NEXT(p))
+      {
+         p->occ=1.00;
+         WritePDBRecord(out, p);
+      }
+   }
+}
+
+
+/************************************************************************/
+/*>int CompareInts(const void *a, const void *b)
+   ---------------------------------------------
+   qsort() comparison function for integers
+
+   16.10.26 Original   By: agent
+*/
+int CompareInts(const void *a, const void *b)
+{
+   int i = *(const int *)a,
+       j = *(const int *)b;
+
+   return((i > j) - (i < j));
+}
+
+
 /************************************************************************/
 /*>void WriteAtoms(PDB *pdb, FILE *out)
 -----------------------------------------
@@ -281,12 +692,17 @@ Writes help.
 void Usage(void)
 {
    fprintf(stderr,"\n");
-   fprintf(stderr,"PDBsphere V1.2 (c) Anja Baresic, UCL.\n");
-   fprintf(stderr,"Last modified 17/12/07 by Anja Baresic, UCL.\n");
+   fprintf(stderr,"PDBsphere V1.3 (c) Anja Baresic, UCL.\n");
+   fprintf(stderr,"Last modified 16/10/26 by Andrew Martin, UCL.\n");
    fprintf(stderr,"\nUsage: \
 PDBsphere [-s] [-r radius] [-h] resID [in.txt [out.txt]]\n");
+   fprintf(stderr,"       \
+PDBsphere [-s] [-r radius] [-h] -q queries [in.txt [out.txt]]\n");
    fprintf(stderr,"       -s  Output summary: only list of residue IDs.\n");
    fprintf(stderr,"       -r  Set your own allowed range to radius. \n");   
+   fprintf(stderr,"       -q  Read the resIDs from a file, one per line, \
+each optionally\n");
+   fprintf(stderr,"           followed by its own range.\n");
    fprintf(stderr,"Default behaviour is to output all atoms of \
 a residue containing at least\n");
    fprintf(stderr,"one atom in range (from residue defined by resID), in a \
@@ -297,6 +713,10 @@ PDB format.\n");
 specification, num\n");
    fprintf(stderr,"is a residue number and [i] is an optional insertion \
 code.\n");
+   fprintf(stderr,"With -q, each query's atoms follow a REMARK record \
+naming the resID and\n");
+   fprintf(stderr,"range, or with -s each residue ID is preceded by the \
+query resID.\n");
    fprintf(stderr,"\nPDBsphere writes all the residues within range of a \
 residue with resID.\n");
    fprintf(stderr,"I/O through standard input/output if files not \
@@ -308,7 +728,8 @@ specified.\n\n");
 
 /**********************************************************************/
 /*>BOOL ParseCmdLine(int argc, char **argv, char *resspec, char *InFile, 
-                    char *OutFile, BOOL *summary, double *radiusSq)
+                    char *OutFile, BOOL *summary, double *radiusSq,
+                    char *QueryFile)
    ----------------------------------------------------------------------
    Input:   int    argc         Argument count
             char   **argv       Argument array
@@ -321,19 +742,24 @@ specified.\n\n");
             double *radiusSq    Maximum allowed distance of residues' 
                                 coordinates - squared
                                 (Default:64, max range:8 angstroms)
+            char   *QueryFile   File of central residue IDs (or blank
+                                string)
    Returns: BOOL                Success?
 
    Parse the command line
    
    26.10.07 Original    By: Anya
+   16.10.26 Added -q. With -q there is no resID on the command line
+            By: agent
 */
 BOOL ParseCmdLine(int argc, char **argv,char *resspec, char *InFile, 
-                  char *OutFile, BOOL *summary, double *radiusSq)
+                  char *OutFile, BOOL *summary, double *radiusSq,
+                  char *QueryFile)
 {
    argc--;
    argv++;
 
-   InFile[0] = OutFile[0] = '\0';
+   InFile[0] = OutFile[0] = QueryFile[0] = '\0';
    *summary = FALSE;
    *radiusSq = 64.00;
  
@@ -360,6 +786,14 @@ BOOL ParseCmdLine(int argc, char **argv,char *resspec, char *InFile,
             case 's':
                *summary = TRUE;
                break;
+            case 'q':
+               argc--;
+               argv++;
+               if(argc < 1)
+                  return(FALSE);
+               strncpy(QueryFile, argv[0], MAXBUFF);
+               QueryFile[MAXBUFF-1] = '\0';
+               break;
             case 'r':
                argc--;
                argv++;
@@ -377,12 +811,16 @@ BOOL ParseCmdLine(int argc, char **argv,char *resspec, char *InFile,
       }
       else
       {
-         /* Check that there are 1, 2 or 3 arguments left               */
-         if(argc<1 || argc > 3)
+         /* Check that there are 1, 2 or 3 arguments left (0, 1 or 2 
+            with -q)
+         */
+         if(argc<1 || argc > (QueryFile[0] ? 2 : 3))
             return(FALSE);
 
          /* Copy the first to resspec                                    */
-         if(argc)
+         if(QueryFile[0])
+            resspec[0] = '\0';
+         else if(argc)
          {
             strncpy(resspec, argv[0], MAXBUFF);
             argc--;
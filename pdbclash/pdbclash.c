@@ -47,13 +47,27 @@
    Revision History:
    =================
    12.01.19 V1.0    Original   By: ACRM
+   16.10.26 V1.1    Uses a cell list rather than testing all residue
+                    pairs   By: agent
+   16.10.26 V1.2    Added -j to run multi-threaded   By: agent
+   16.10.26 V1.3    Added -s summary mode   By: agent
+   16.10.26 V1.4    Added -C and -R for compiled radius tables   By: agent
+   16.10.26 V1.5    Added -i interface mode   By: agent
+   16.10.26 V1.6    Added -S server mode for incremental checking
+                    By: agent
 
 *************************************************************************/
 /* Includes
 */
+#define _POSIX_C_SOURCE 200112L
 #include <stdio.h>
 #include <stdlib.h>
 #include <math.h>
+#include <pthread.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 
 #include "bioplib/pdb.h"
 #include "bioplib/macros.h"
@@ -67,189 +81,2186 @@
 #define DEF_BINWIDTH 1.0
 #define DEF_RADFILE "radii.dat"
 #define DATA_ENV    "DATADIR"
+#define MINCELLSIZE  ((REAL)1.0)  /* Smallest cell list cell size        */
+#define MAXCELLS     4000000      /* Most cells we will allocate         */
+#define ALLOCQUANTUM 256          /* Initial size of clash arrays        */
+#define RESCHUNK     16           /* Residues handed to a thread at once */
+#define MAXTHREADS   256
+#define NBINS        20           /* Bins in the summary histogram       */
+#define MAXCMDWORD   16           /* Longest server command word         */
+#define RADMAGIC     "PDBCLRT1"   /* Identifies a compiled radius table  */
+#define MAXSEEDS     1000         /* Hash seeds to try per table size    */
 #define ISBACKBONE(p) (!strncmp((p)->atnam, "N   ", 4) || \
                        !strncmp((p)->atnam, "CA  ", 4) || \
                        !strncmp((p)->atnam, "C   ", 4) || \
                        !strncmp((p)->atnam, "O   ", 4))
+#define ATOM_BACKBONE 0x01      /* Per-atom flags set by ClassifyAtom()  */
+#define ATOM_CYSSG    0x02
+#define ATOM_CYSCB    0x04
+#define CELLINDEX(g, ix, iy, iz) ((ix) + (g)->nx * ((iy) + (g)->ny * (iz)))
+
+typedef struct
+{
+   PDB  **atoms;         /* Atoms in linked list order                  */
+   unsigned char *atomFlags, /* ATOM_ flags for each atom               */
+                 *chainPairs,/* nChains x nChains flags for chain pairs 
+                                to be tested (NULL to test all)         */
+                 *chainUsed; /* Chains that are in any tested pair      */
+   int  *atomRes,        /* Residue index of each atom                  */
+        *resChain,       /* Chain index of each residue                 */
+        *chainRes,       /* First residue with each chain label         */
+        *atomCell,       /* Cell index of each atom                     */
+        *resStart,       /* First atom of each residue (nRes+1 entries) */
+        *cellHead,       /* First atom in each cell (-1 if empty)       */
+        *atomNext;       /* Next atom in the same cell (-1 at the end)  */
+   REAL xmin, ymin, zmin,
+        cellSize;
+   int  nAtoms, nRes, nChains,
+        nx, ny, nz;
+}  CELLGRID;
+
+typedef struct
+{
+   int  res2,            /* Residue index of the second atom            */
+        atom1, atom2;    /* Atom indexes of the clashing atoms          */
+   REAL dist,
+        sumVDWR;
+}  CLASH;
+
+typedef struct
+{
+   CLASH *clashes;
+   int   nClashes,
+         maxClashes;
+}  CLASHLIST;
+
+typedef struct
+{
+   char         magic[8];        /* RADMAGIC                             */
+   unsigned int nSlots,          /* Hash table size (a power of 2)       */
+                seed,            /* Seed that makes the hash perfect     */
+                nEntries,
+                spare;
+}  RADHEADER;
+
+typedef struct
+{
+   char resnam[4],               /* Empty slot if resnam[0] is '\0'      */
+        atnam[4];                /* Atom name as in atnam_raw            */
+   REAL radius;
+}  RADSLOT;
+
+typedef struct
+{
+   void      *map;               /* The mmap()ed file                    */
+   size_t    size;
+   RADHEADER *header;
+   RADSLOT   *slots;
+}  RADTABLE;
+
+typedef struct
+{
+   REAL binWidth,
+        binMin,          /* Lower limit of the first histogram bin      */
+        worst;           /* Largest clash overlap                       */
+   int  bins[NBINS],     /* Last bin also takes anything beyond it      */
+        *resCounts,      /* Clashes involving each residue              */
+        *chainCounts,    /* Clashes involving each chain                */
+        nClashes;
+}  SUMMARY;
+
+typedef struct
+{
+   int  atom;            /* Atom index                                  */
+   REAL x, y, z;         /* New coordinates                             */
+}  ATOMMOVE;
+
+typedef struct
+{
+   CELLGRID        *grid;
+   CLASHLIST       *chunks;      /* One clash list per chunk of residues */
+   REAL            tol;
+   int             nChunks,
+                   nextChunk;    /* Next chunk to be handed out          */
+   BOOL            checkBB,
+                   ok;
+   pthread_mutex_t lock;
+}  WORKQUEUE;
+
+/************************************************************************/
+/* Globals
+*/
+
+/************************************************************************/
+/* Prototypes
+*/
+BOOL ParseCmdLine(int argc, char **argv, char *infile, char *outfile,
+                  char *radFile, BOOL *checkBB, REAL *tol, int *nThreads,
+                  BOOL *doSummary, REAL *binWidth, char *tableFile,
+                  char *compileFile, char *chains1, char *chains2,
+                  BOOL *serverMode);
+FILE *OpenRadiusFile(char *radFile);
+BOOL CompileRadiusTable(FILE *fpRad, char *compileFile);
+unsigned int HashRadKey(char *resnam, char *atnam, unsigned int seed,
+                        unsigned int nSlots);
+RADTABLE *LoadRadiusTable(char *tableFile);
+void FreeRadiusTable(RADTABLE *table);
+BOOL SetRadiiFromTable(PDB *pdb, RADTABLE *table);
+void Usage(void);
+int main(int argc, char **argv);
+BOOL Analyze(FILE *outfile, PDB *pdb, BOOL checkBB, REAL tol,
+             int nThreads, BOOL doSummary, REAL binWidth, char *chains1,
+             char *chains2);
+BOOL AnalyzeThreaded(FILE *out, CELLGRID *grid, BOOL checkBB, REAL tol,
+                     int nThreads, SUMMARY *summary);
+void *ClashWorker(void *arg);
+CELLGRID *SetupCellGrid(PDB *pdb, REAL tol, char *chains1, char *chains2,
+                        BOOL cullChains);
+BOOL Serve(FILE *cmd, FILE *out, PDB *pdb, BOOL checkBB, REAL tol,
+           char *chains1, char *chains2);
+BOOL FindMovedClashes(CELLGRID *grid, int *movedRes, int nMoved,
+                      BOOL checkBB, REAL tol, CLASHLIST *list);
+int CompareAtomPairs(const void *a, const void *b);
+int PrintClashDelta(FILE *out, CELLGRID *grid, CLASHLIST *oldList,
+                    CLASHLIST *newList, int *nAdded);
+int FindGridResidue(CELLGRID *grid, char *resspec);
+int FindGridAtom(CELLGRID *grid, int res, char *atnam);
+int FindCell(CELLGRID *grid, REAL x, REAL y, REAL z);
+void MoveGridAtom(CELLGRID *grid, int atom, REAL x, REAL y, REAL z);
+REAL FindClashCutoff(PDB *pdb, REAL tol);
+CELLGRID *BuildCellGrid(PDB *pdb, REAL cutoff);
+void FreeCellGrid(CELLGRID *grid);
+int FindChainIndex(CELLGRID *grid, PDB *p);
+BOOL SetInterfaceChains(CELLGRID *grid, char *chains1, char *chains2,
+                        REAL cutoff, BOOL cullChains);
+BOOL InChainList(char *chains, char *chain);
+BOOL FindResidueClashes(CELLGRID *grid, int res1, BOOL bothWays, 
+                        BOOL checkBB, REAL tol, CLASHLIST *list);
+int CompareClashes(const void *a, const void *b);
+void PrintClashList(FILE *out, CELLGRID *grid, CLASHLIST *list);
+void ReportClashList(FILE *out, CELLGRID *grid, CLASHLIST *list,
+                     SUMMARY *summary);
+SUMMARY *InitSummary(CELLGRID *grid, REAL binWidth, REAL tol);
+void FreeSummary(SUMMARY *summary);
+void AccumulateSummary(SUMMARY *summary, CELLGRID *grid, 
+                       CLASHLIST *list);
+void PrintSummary(FILE *out, SUMMARY *summary, CELLGRID *grid);
+BOOL TestClash(PDB *p, PDB *q, int flags1, int flags2, BOOL adjacent,
+               BOOL checkBB, REAL tol, REAL *dist, REAL *sumVDWR);
+int ClassifyAtom(PDB *p);
+void PrintClash(FILE *out, PDB *p, PDB *q, REAL dist, REAL sumVDWR);
+
+
+/************************************************************************/
+int main(int argc, char **argv)
+{
+   char infile[MAXBUFF],
+      outfile[MAXBUFF],
+      radFile[MAXBUFF],
+      tableFile[MAXBUFF],
+      compileFile[MAXBUFF],
+      chains1[MAXBUFF],
+      chains2[MAXBUFF];
+   int  natoms,
+        nThreads = 1;
+   FILE *in  = stdin,
+        *out = stdout,
+        *fpRad = NULL;
+   PDB  *pdb, *pdbin;
+   BOOL checkBB    = FALSE,
+        doSummary  = FALSE,
+        serverMode = FALSE;
+   REAL tol      = (REAL)0.0,
+        binWidth = DEF_BINWIDTH;
+
+   strncpy(radFile, DEF_RADFILE, MAXBUFF);
+   
+   if(ParseCmdLine(argc, argv, infile, outfile, radFile, &checkBB, &tol,
+                   &nThreads, &doSummary, &binWidth, tableFile, 
+                   compileFile, chains1, chains2, &serverMode))
+   {
+      /* Just compile the radius file into a binary table               */
+      if(compileFile[0])
+      {
+         if((fpRad = OpenRadiusFile(radFile))==NULL)
+            return(1);
+         return(CompileRadiusTable(fpRad, compileFile) ? 0 : 1);
+      }
+      
+      /* Open the radius file unless we are using a compiled table      */
+      if(!tableFile[0])
+      {
+         if((fpRad = OpenRadiusFile(radFile))==NULL)
+            return(1);
+      }
+
+      if(blOpenStdFiles(infile, outfile, &in, &out))
+      {
+         if((pdbin = blReadPDB(in, &natoms)) == NULL)
+         {
+            fprintf(stderr, "Unable to read PDB file\n");
+            return(1);
+         }
+
+
+         /* Remove waters                                               */
+         pdb = blStripWatersPDBAsCopy(pdbin, &natoms);
+         FREELIST(pdbin, PDB);
+         
+         /* Set the atom radii in the linked list. If we are using a 
+            compiled table and it doesn't contain all the atoms, fall
+            back to the radius file so that the radii are the same
+         */
+         if(tableFile[0])
+         {
+            RADTABLE *table;
+            BOOL     gotAll;
+            
+            if((table = LoadRadiusTable(tableFile))==NULL)
+               return(1);
+            gotAll = SetRadiiFromTable(pdb, table);
+            FreeRadiusTable(table);
+
+            if(!gotAll)
+            {
+               if((fpRad = OpenRadiusFile(radFile))==NULL)
+                  return(1);
+               blSetAtomRadii(pdb, fpRad);
+            }
+         }
+         else
+         {
+            blSetAtomRadii(pdb, fpRad);
+         }
+         
+         /* Perform the analysis, or take commands from stdin          */
+         if(serverMode)
+         {
+            if(!Serve(stdin, out, pdb, checkBB, tol, chains1, chains2))
+               return(1);
+         }
+         else if(!Analyze(out, pdb, checkBB, tol, nThreads, doSummary, 
+                          binWidth, chains1, chains2))
+         {
+            return(1);
+         }
+      }
+   }
+   else
+   {
+      Usage();
+   }
+
+   return(0);
+}
+
+/************************************************************************/
+/*>BOOL Serve(FILE *cmd, FILE *out, PDB *pdb, BOOL checkBB, REAL tol,
+              char *chains1, char *chains2)
+   -------------------------------------------------------------------
+   Input:   FILE  *cmd       Command input
+            FILE  *out       Output file
+            PDB   *pdb       PDB linked list with radii set
+            BOOL  checkBB    Only skip backbone/backbone contacts between
+                             adjacent residues
+            REAL  tol        Tolerance
+            char  *chains1   Chains for interface mode (or blank)
+            char  *chains2   Chains on the other side of the interface
+   Returns: BOOL             Success (FALSE if out of memory)
+
+   Server mode for incremental clash checking. The cell list is built 
+   once and commands are then read from cmd:
+
+      MOVE resspec atnam x y z   Queue a move of an atom
+      UPDATE                     Apply the queued moves and report the
+                                 change in clashes
+      CLASHES                    Report all current clashes
+      QUIT                       Exit
+
+   Every command ends its reply with a line starting OK or ERROR, and 
+   the output is flushed so a program at the other end of a pipe can 
+   wait for it. UPDATE prints the clashes involving the moved residues 
+   that have gone (prefixed by -) and that are new (prefixed by +) and
+   ends with 'OK removed added'. Only the moved residues are rechecked so
+   the work depends on the size of the move, not of the structure.
+
+   In interface mode only the chain selection is applied; chain pairs
+   are not skipped on their bounding boxes since atoms may be moved 
+   into contact.
+
+   16.10.26 Original   By: agent
+   17.10.26 Interface mode no longer culls chain pairs. Each failure 
+            reports its own error   By: agent
+*/
+BOOL Serve(FILE *cmd, FILE *out, PDB *pdb, BOOL checkBB, REAL tol,
+           char *chains1, char *chains2)
+{
+   CELLGRID      *grid;
+   CLASHLIST     oldList,
+                 newList;
+   ATOMMOVE      *moves     = NULL;
+   unsigned char *isMoved   = NULL;
+   int           *movedRes  = NULL,
+                 nMoves     = 0,
+                 maxMoves   = 0,
+                 nMoved     = 0,
+                 i;
+   char          buffer[MAXBUFF],
+                 command[MAXCMDWORD],
+                 resspec[MAXBUFF],
+                 atnam[MAXBUFF];
+   BOOL          ok         = TRUE;
+
+   if(pdb==NULL)
+      return(TRUE);
+   /* Atoms can move, so the chain bounding boxes can't be used to skip
+      chain pairs
+   */
+   if((grid = SetupCellGrid(pdb, tol, chains1, chains2, FALSE))==NULL)
+      return(FALSE);
+   
+   if(((isMoved  = (unsigned char *)calloc(grid->nRes, 
+                                           sizeof(unsigned char)))
+       ==NULL) ||
+      ((movedRes = (int *)malloc(grid->nRes * sizeof(int)))==NULL))
+   {
+      fprintf(stderr, "Error (pdbclash): No memory for server\n");
+      ok = FALSE;
+   }
+   
+   oldList.clashes = newList.clashes    = NULL;
+   oldList.maxClashes = newList.maxClashes = 0;
+
+   while(ok && fgets(buffer, MAXBUFF, cmd))
+   {
+      if((sscanf(buffer, "%15s", command) != 1) || (command[0] == '#'))
+         continue;
+      
+      if(!strcmp(command, "MOVE"))
+      {
+         ATOMMOVE move;
+         int      res;
+         
+         if(sscanf(buffer, "%*s %s %s %lf %lf %lf", resspec, atnam,
+                   &move.x, &move.y, &move.z) != 5)
+         {
+            fprintf(out, "ERROR MOVE needs resspec atnam x y z\n");
+         }
+         else if((res = FindGridResidue(grid, resspec)) < 0)
+         {
+            fprintf(out, "ERROR No such residue: %s\n", resspec);
+         }
+         else if((move.atom = FindGridAtom(grid, res, atnam)) < 0)
+         {
+            fprintf(out, "ERROR No such atom: %s %s\n", resspec, atnam);
+         }
+         else
+         {
+            if(nMoves >= maxMoves)
+            {
+               ATOMMOVE *newMoves;
+               maxMoves = (maxMoves) ? (2 * maxMoves) : ALLOCQUANTUM;
+               if((newMoves = (ATOMMOVE *)
+                   realloc(moves, maxMoves * sizeof(ATOMMOVE)))==NULL)
+               {
+                  fprintf(stderr, "Error (pdbclash): No memory for \
+moves\n");
+                  ok = FALSE;
+                  break;
+               }
+               moves = newMoves;
+            }
+            moves[nMoves++] = move;
+            if(!isMoved[res])
+            {
+               isMoved[res]       = 1;
+               movedRes[nMoved++] = res;
+            }
+            fprintf(out, "OK\n");
+         }
+      }
+      else if(!strcmp(command, "UPDATE"))
+      {
+         int nRemoved, nAdded;
+         
+         /* Clashes before and after the moves                          */
+         if(!FindMovedClashes(grid, movedRes, nMoved, checkBB, tol,
+                              &oldList))
+         {
+            fprintf(stderr, "Error (pdbclash): No memory for clash \
+list\n");
+            ok = FALSE;
+            break;
+         }
+         for(i=0; i<nMoves; i++)
+            MoveGridAtom(grid, moves[i].atom, 
+                         moves[i].x, moves[i].y, moves[i].z);
+         if(!FindMovedClashes(grid, movedRes, nMoved, checkBB, tol,
+                              &newList))
+         {
+            fprintf(stderr, "Error (pdbclash): No memory for clash \
+list\n");
+            ok = FALSE;
+            break;
+         }
+
+         nRemoved = PrintClashDelta(out, grid, &oldList, &newList, 
+                                    &nAdded);
+         fprintf(out, "OK %d %d\n", nRemoved, nAdded);
+
+         /* Clear the queue                                             */
+         for(i=0; i<nMoved; i++)
+            isMoved[movedRes[i]] = 0;
+         nMoved = nMoves = 0;
+      }
+      else if(!strcmp(command, "CLASHES"))
+      {
+         int res1, 
+             nClashes = 0;
+         
+         for(res1=0; res1<grid->nRes; res1++)
+         {
+            newList.nClashes = 0;
+            if(!FindResidueClashes(grid, res1, FALSE, checkBB, tol, 
+                                   &newList))
+            {
+               fprintf(stderr, "Error (pdbclash): No memory for clash \
+list\n");
+               ok = FALSE;
+               break;
+            }
+            PrintClashList(out, grid, &newList);
+            nClashes += newList.nClashes;
+         }
+         if(ok)
+            fprintf(out, "OK %d\n", nClashes);
+      }
+      else if(!strcmp(command, "QUIT"))
+      {
+         fprintf(out, "OK\n");
+         break;
+      }
+      else
+      {
+         fprintf(out, "ERROR Unknown command: %s\n", command);
+      }
+      
+      fflush(out);
+   }
+
+   if(oldList.clashes != NULL) free(oldList.clashes);
+   if(newList.clashes != NULL) free(newList.clashes);
+   if(moves           != NULL) free(moves);
+   if(isMoved         != NULL) free(isMoved);
+   if(movedRes        != NULL) free(movedRes);
+   FreeCellGrid(grid);
+
+   return(ok);
+}
+
+
+/************************************************************************/
+/*>BOOL FindMovedClashes(CELLGRID *grid, int *movedRes, int nMoved,
+                         BOOL checkBB, REAL tol, CLASHLIST *list)
+   ----------------------------------------------------------------
+   Input:   CELLGRID  *grid       Cell list
+            int       *movedRes   Indexes of the moved residues
+            int       nMoved      Number of moved residues
+            BOOL      checkBB     Only skip backbone/backbone contacts 
+                                  between adjacent residues
+            REAL      tol         Tolerance
+   Output:  CLASHLIST *list       All the clashes involving the residues
+   Returns: BOOL                  Success (FALSE if out of memory)
+
+   Finds the clashes that involve any of the moved residues, sorted by 
+   atom pair. A clash between two moved residues is found from both
+   residues, so duplicates are removed.
+
+   16.10.26 Original   By: agent
+*/
+BOOL FindMovedClashes(CELLGRID *grid, int *movedRes, int nMoved,
+                      BOOL checkBB, REAL tol, CLASHLIST *list)
+{
+   int i, n;
+   
+   list->nClashes = 0;
+   for(i=0; i<nMoved; i++)
+   {
+      if(!FindResidueClashes(grid, movedRes[i], TRUE, checkBB, tol, list))
+         return(FALSE);
+   }
+
+   qsort(list->clashes, list->nClashes, sizeof(CLASH), CompareAtomPairs);
+   for(i=0, n=0; i<list->nClashes; i++)
+   {
+      if((n == 0) || CompareAtomPairs(&(list->clashes[n-1]),
+                                      &(list->clashes[i])))
+         list->clashes[n++] = list->clashes[i];
+   }
+   list->nClashes = n;
+   
+   return(TRUE);
+}
+
+
+/************************************************************************/
+/*>int CompareAtomPairs(const void *a, const void *b)
+   --------------------------------------------------
+   qsort() comparison function to sort clashes by first atom then second
+   atom.
+
+   16.10.26 Original   By: agent
+*/
+int CompareAtomPairs(const void *a, const void *b)
+{
+   const CLASH *c1 = (const CLASH *)a,
+               *c2 = (const CLASH *)b;
+
+   if(c1->atom1 != c2->atom1)
+      return((c1->atom1 < c2->atom1) ? -1 : 1);
+   if(c1->atom2 != c2->atom2)
+      return((c1->atom2 < c2->atom2) ? -1 : 1);
+   return(0);
+}
+
+
+/************************************************************************/
+/*>int PrintClashDelta(FILE *out, CELLGRID *grid, CLASHLIST *oldList,
+                       CLASHLIST *newList, int *nAdded)
+   ------------------------------------------------------------------
+   Input:   FILE      *out       Output file
+            CELLGRID  *grid      Cell list
+            CLASHLIST *oldList   Clashes before the move (sorted by 
+                                 atom pair)
+            CLASHLIST *newList   Clashes after the move (sorted by 
+                                 atom pair)
+   Output:  int       *nAdded    Number of clashes printed as added
+   Returns: int                  Number of clashes printed as removed
+
+   Merges the two lists and prints the clashes that have gone, prefixed
+   by '-', and the new ones, prefixed by '+'. A clash that is in both
+   lists but whose distance has changed is printed as removed and added.
+
+   16.10.26 Original   By: agent
+*/
+int PrintClashDelta(FILE *out, CELLGRID *grid, CLASHLIST *oldList,
+                    CLASHLIST *newList, int *nAdded)
+{
+   int i        = 0,
+       j        = 0,
+       nRemoved = 0;
+
+   *nAdded = 0;
+   
+   while((i < oldList->nClashes) || (j < newList->nClashes))
+   {
+      CLASH *o   = (i < oldList->nClashes) ? &(oldList->clashes[i]) : NULL,
+            *n   = (j < newList->nClashes) ? &(newList->clashes[j]) : NULL;
+      int   cmp  = (o == NULL) ? 1 : ((n == NULL) ? -1 : 
+                                      CompareAtomPairs(o, n));
+
+      if((cmp < 0) || ((cmp == 0) && (o->dist != n->dist)))
+      {
+         fprintf(out, "- ");
+         PrintClash(out, grid->atoms[o->atom1], grid->atoms[o->atom2],
+                    o->dist, o->sumVDWR);
+         nRemoved++;
+      }
+      if((cmp > 0) || ((cmp == 0) && (o->dist != n->dist)))
+      {
+         fprintf(out, "+ ");
+         PrintClash(out, grid->atoms[n->atom1], grid->atoms[n->atom2],
+                    n->dist, n->sumVDWR);
+         (*nAdded)++;
+      }
+
+      if(cmp <= 0) i++;
+      if(cmp >= 0) j++;
+   }
+
+   return(nRemoved);
+}
+
+
+/************************************************************************/
+/*>int FindGridResidue(CELLGRID *grid, char *resspec)
+   --------------------------------------------------
+   Input:   CELLGRID *grid      Cell list
+            char     *resspec   Residue specification
+   Returns: int                 Residue index (-1 if not found)
+
+   16.10.26 Original   By: agent
+*/
+int FindGridResidue(CELLGRID *grid, char *resspec)
+{
+   char chain[MAXBUFF],
+        insert[MAXBUFF];
+   int  resnum,
+        i;
+
+   if(!blParseResSpec(resspec, chain, &resnum, insert))
+      return(-1);
+
+   for(i=0; i<grid->nRes; i++)
+   {
+      PDB *p = grid->atoms[grid->resStart[i]];
+      
+      if((p->resnum == resnum) &&
+         CHAINMATCH(p->chain, chain) &&
+         (p->insert[0] == insert[0]))
+         return(i);
+   }
+   return(-1);
+}
+
+
+/************************************************************************/
+/*>int FindGridAtom(CELLGRID *grid, int res, char *atnam)
+   ------------------------------------------------------
+   Input:   CELLGRID *grid      Cell list
+            int      res        Residue index
+            char     *atnam     Atom name (without padding)
+   Returns: int                 Atom index (-1 if not found)
+
+   16.10.26 Original   By: agent
+*/
+int FindGridAtom(CELLGRID *grid, int res, char *atnam)
+{
+   char padded[8];
+   int  i;
+
+   strncpy(padded, atnam, 4);
+   padded[4] = '\0';
+   for(i=strlen(padded); i<4; i++)
+      padded[i] = ' ';
+
+   for(i=grid->resStart[res]; i<grid->resStart[res+1]; i++)
+   {
+      if(!strncmp(grid->atoms[i]->atnam, padded, 4))
+         return(i);
+   }
+   return(-1);
+}
+
+
+/************************************************************************/
+/*>FILE *OpenRadiusFile(char *radFile)
+   -----------------------------------
+   Input:   char  *radFile   Radius file name
+   Returns: FILE  *          File pointer (NULL on error)
+
+   Opens the radius file, looking in the DATADIR directory if it isn't
+   found in the current directory, and reports an error if it can't be
+   opened.
+
+   12.01.19 Original   By: ACRM
+   16.10.26 Moved out of main()   By: agent
+*/
+FILE *OpenRadiusFile(char *radFile)
+{
+   FILE *fpRad;
+   BOOL noenv;
+   
+   if((fpRad=blOpenFile(radFile, DATA_ENV, "r", &noenv))==NULL)
+   {
+      fprintf(stderr, "Error (pdbclash): Unable to open radius file, \
+%s\n", radFile);
+      if(noenv)
+      {
+         fprintf(stderr, "              Environment variable %s \
+not set\n", DATA_ENV);
+      }
+   }
+   return(fpRad);
+}
+
+
+/************************************************************************/
+/*>BOOL CompileRadiusTable(FILE *fpRad, char *compileFile)
+   -------------------------------------------------------
+   Input:   FILE  *fpRad         Radius file (NACCESS format)
+            char  *compileFile   Binary table file to write
+   Returns: BOOL                 Success
+
+   Reads the radius file and writes the residue/atom radii as a binary
+   hash table that LoadRadiusTable() can mmap() with no parsing. The 
+   file is a RADHEADER followed by nSlots RADSLOTs. The table size and 
+   hash seed are chosen so that every key has its own slot (a perfect 
+   hash), so a lookup is one hash and one comparison. The file is in 
+   native byte order so it is not portable between architectures.
+
+   Residue lines in the radius file contain the residue name, atom count
+   and standard accessibilities; atom lines contain the atom name (with
+   . for spaces) and radius. Only the first radius given for a 
+   residue/atom pair is kept.
+
+   16.10.26 Original   By: agent
+*/
+BOOL CompileRadiusTable(FILE *fpRad, char *compileFile)
+{
+   RADHEADER    header;
+   RADSLOT      *entries = NULL,
+                *slots   = NULL;
+   FILE         *fpOut;
+   char         buffer[MAXBUFF],
+                word[MAXBUFF],
+                resnam[4];
+   int          nEntries   = 0,
+                maxEntries = 0,
+                i, j, nWords;
+   unsigned int nSlots,
+                seed       = 0;
+   REAL         radius,
+                sa1, sa2;
+   BOOL         found      = FALSE;
+
+   resnam[0] = '\0';
+   
+   /* Read the radius file                                              */
+   while(fgets(buffer, MAXBUFF, fpRad))
+   {
+      if((buffer[0] == '#') || (buffer[0] == '\n'))
+         continue;
+
+      nWords = sscanf(buffer, "%s %lf %lf %lf", word, &radius, &sa1, &sa2);
+      if(nWords == 4)
+      {
+         /* A residue line                                              */
+         strncpy(resnam, word, 3);
+         resnam[3] = '\0';
+      }
+      else if((nWords == 2) && resnam[0])
+      {
+         /* An atom line                                                */
+         RADSLOT entry;
+         
+         strcpy(entry.resnam, resnam);
+         for(i=0; i<4; i++)
+            entry.atnam[i] = (word[i] == '.') ? ' ' : word[i];
+         entry.radius = radius;
+
+         for(i=0; i<nEntries; i++)
+         {
+            if(!strncmp(entries[i].resnam, entry.resnam, 4) &&
+               !strncmp(entries[i].atnam,  entry.atnam,  4))
+               break;
+         }
+         if(i < nEntries)
+            continue;
+
+         if(nEntries >= maxEntries)
+         {
+            RADSLOT *newEntries;
+            maxEntries = (maxEntries) ? (2 * maxEntries) : ALLOCQUANTUM;
+            if((newEntries = (RADSLOT *)
+                realloc(entries, maxEntries * sizeof(RADSLOT)))==NULL)
+            {
+               fprintf(stderr, "Error (pdbclash): No memory for radius \
+table\n");
+               free(entries);
+               return(FALSE);
+            }
+            entries = newEntries;
+         }
+         entries[nEntries++] = entry;
+      }
+   }
+
+   /* Find a table size and seed that gives no collisions               */
+   for(nSlots=2; nSlots < (unsigned int)(2 * nEntries); nSlots *= 2);
+   while(!found)
+   {
+      if(slots != NULL)
+         free(slots);
+      if((slots = (RADSLOT *)calloc(nSlots, sizeof(RADSLOT)))==NULL)
+      {
+         fprintf(stderr, "Error (pdbclash): No memory for radius \
+table\n");
+         free(entries);
+         return(FALSE);
+      }
+
+      for(seed=1; seed<=MAXSEEDS; seed++)
+      {
+         for(i=0; i<nEntries; i++)
+         {
+            j = HashRadKey(entries[i].resnam, entries[i].atnam, seed,
+                           nSlots);
+            if(slots[j].resnam[0])
+               break;
+            slots[j] = entries[i];
+         }
+         if(i == nEntries)
+         {
+            found = TRUE;
+            break;
+         }
+         memset(slots, 0, nSlots * sizeof(RADSLOT));
+      }
+      if(!found)
+         nSlots *= 2;
+   }
+   free(entries);
+
+   /* Write the table                                                   */
+   memset(&header, 0, sizeof(RADHEADER));
+   memcpy(header.magic, RADMAGIC, 8);
+   header.nSlots   = nSlots;
+   header.seed     = seed;
+   header.nEntries = nEntries;
+
+   if((fpOut = fopen(compileFile, "wb"))==NULL)
+   {
+      fprintf(stderr, "Error (pdbclash): Unable to write compiled radius \
+table, %s\n", compileFile);
+      free(slots);
+      return(FALSE);
+   }
+   if((fwrite(&header, sizeof(RADHEADER), 1, fpOut) != 1) ||
+      (fwrite(slots, sizeof(RADSLOT), nSlots, fpOut) != nSlots))
+   {
+      fprintf(stderr, "Error (pdbclash): Unable to write compiled radius \
+table, %s\n", compileFile);
+      fclose(fpOut);
+      free(slots);
+      return(FALSE);
+   }
+   fclose(fpOut);
+   free(slots);
+   
+   return(TRUE);
+}
+
+
+/************************************************************************/
+/*>unsigned int HashRadKey(char *resnam, char *atnam, unsigned int seed,
+                           unsigned int nSlots)
+   ---------------------------------------------------------------------
+   Input:   char          *resnam   Residue name (first 3 characters 
+                                    used)
+            char          *atnam    Atom name (4 characters used)
+            unsigned int  seed      Hash seed
+            unsigned int  nSlots    Table size (a power of 2)
+   Returns: unsigned int            Slot number
+
+   Hashes a residue/atom name pair, packed into two integers
+
+   16.10.26 Original   By: agent
+*/
+unsigned int HashRadKey(char *resnam, char *atnam, unsigned int seed,
+                        unsigned int nSlots)
+{
+   unsigned int resKey, atKey, hash;
+   
+   resKey = ((unsigned int)(unsigned char)resnam[0] << 16) |
+            ((unsigned int)(unsigned char)resnam[1] <<  8) |
+             (unsigned int)(unsigned char)resnam[2];
+   atKey  = ((unsigned int)(unsigned char)atnam[0]  << 24) |
+            ((unsigned int)(unsigned char)atnam[1]  << 16) |
+            ((unsigned int)(unsigned char)atnam[2]  <<  8) |
+             (unsigned int)(unsigned char)atnam[3];
+
+   hash  = (resKey * 0x9E3779B1u) ^ (atKey * 0x85EBCA77u) ^ 
+           (seed   * 0xC2B2AE3Du);
+   hash ^= hash >> 15;
+   hash *= 0x27D4EB2Fu;
+   hash ^= hash >> 13;
+   
+   return(hash & (nSlots - 1));
+}
+
+
+/************************************************************************/
+/*>RADTABLE *LoadRadiusTable(char *tableFile)
+   ------------------------------------------
+   Input:   char      *tableFile   Compiled radius table file
+   Returns: RADTABLE  *            The table (NULL on error)
+
+   Maps a radius table written by CompileRadiusTable() into memory. The
+   file is looked for in the DATADIR directory if it isn't found in the
+   current directory.
+
+   16.10.26 Original   By: agent
+*/
+RADTABLE *LoadRadiusTable(char *tableFile)
+{
+   RADTABLE    *table;
+   FILE        *fp;
+   struct stat st;
+   
+   if((fp = OpenRadiusFile(tableFile))==NULL)
+      return(NULL);
+
+   if((table = (RADTABLE *)malloc(sizeof(RADTABLE)))==NULL)
+   {
+      fprintf(stderr, "Error (pdbclash): No memory for radius table\n");
+      fclose(fp);
+      return(NULL);
+   }
+   
+   if((fstat(fileno(fp), &st) != 0) ||
+      (st.st_size < (off_t)sizeof(RADHEADER)) ||
+      ((table->map = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_SHARED,
+                          fileno(fp), 0)) == MAP_FAILED))
+   {
+      fprintf(stderr, "Error (pdbclash): Unable to map radius table, \
+%s\n", tableFile);
+      free(table);
+      fclose(fp);
+      return(NULL);
+   }
+   fclose(fp);
+   
+   table->size   = (size_t)st.st_size;
+   table->header = (RADHEADER *)table->map;
+   table->slots  = (RADSLOT *)((char *)table->map + sizeof(RADHEADER));
+
+   if(memcmp(table->header->magic, RADMAGIC, 8) ||
+      (table->size != sizeof(RADHEADER) + 
+                      table->header->nSlots * sizeof(RADSLOT)))
+   {
+      fprintf(stderr, "Error (pdbclash): Not a compiled radius table, \
+%s\n", tableFile);
+      FreeRadiusTable(table);
+      return(NULL);
+   }
+   
+   return(table);
+}
+
+
+/************************************************************************/
+/*>void FreeRadiusTable(RADTABLE *table)
+   -------------------------------------
+   Input:   RADTABLE  *table    Table from LoadRadiusTable()
+
+   16.10.26 Original   By: agent
+*/
+void FreeRadiusTable(RADTABLE *table)
+{
+   munmap(table->map, table->size);
+   free(table);
+}
+
+
+/************************************************************************/
+/*>BOOL SetRadiiFromTable(PDB *pdb, RADTABLE *table)
+   -------------------------------------------------
+   Input:   PDB       *pdb      PDB linked list
+            RADTABLE  *table    Compiled radius table
+   Returns: BOOL                Were all the atoms found in the table?
+
+   Sets the radius of each atom from the compiled table. Returns FALSE
+   as soon as an atom is not found so that the caller can fall back to
+   blSetAtomRadii() which also handles atoms missing from the radius 
+   file.
+
+   16.10.26 Original   By: agent
+*/
+BOOL SetRadiiFromTable(PDB *pdb, RADTABLE *table)
+{
+   PDB  *p;
+   
+   for(p=pdb; p!=NULL; NEXT(p))
+   {
+      RADSLOT *slot = &(table->slots[HashRadKey(p->resnam, p->atnam_raw,
+                                                table->header->seed,
+                                                table->header->nSlots)]);
+      if(!slot->resnam[0] ||
+         strncmp(slot->resnam, p->resnam, 3) ||
+         strncmp(slot->atnam, p->atnam_raw, 4))
+         return(FALSE);
+      
+      p->radius = slot->radius;
+   }
+
+   return(TRUE);
+}
+
+
+/************************************************************************/
+/*>BOOL Analyze(FILE *out, PDB *pdb, BOOL checkBB, REAL tol, 
+                 int nThreads, BOOL doSummary, REAL binWidth,
+                 char *chains1, char *chains2)
+   ---------------------------------------------------------
+   Input:   FILE  *out       Output file
+            PDB   *pdb       PDB linked list with radii set
+            BOOL  checkBB    Only skip backbone/backbone contacts between
+                             adjacent residues
+            REAL  tol        Tolerance
+            int   nThreads   Number of threads to use
+            BOOL  doSummary  Print a summary rather than every clash
+            REAL  binWidth   Histogram bin width for the summary
+            char  *chains1   Comma-separated chain list for interface
+                             mode (or blank string)
+            char  *chains2   Chains on the other side of the interface
+   Returns: BOOL             Success (FALSE if out of memory)
+
+   Finds and prints the clashes. Rather than testing every residue 
+   against every later residue, the atoms are placed in a cell list with
+   cells large enough that a clash can only occur between atoms in the 
+   same or neighbouring cells. The clashes found for each residue are 
+   sorted back into the order in which the old residue-pair scan found 
+   them so the output is unchanged.
+
+   In interface mode, only clashes between a chain in chains1 and a 
+   chain in chains2 are found.
+
+   12.01.19 Original   By: ACRM
+   16.10.26 Uses a cell list   By: agent
+   16.10.26 Added nThreads   By: agent
+   16.10.26 Added doSummary and binWidth   By: agent
+   16.10.26 Added chains1 and chains2   By: agent
+*/
+BOOL Analyze(FILE *out, PDB *pdb, BOOL checkBB, REAL tol, int nThreads,
+             BOOL doSummary, REAL binWidth, char *chains1, char *chains2)
+{
+   CELLGRID  *grid;
+   CLASHLIST list;
+   SUMMARY   *summary = NULL;
+   int       res1;
+   BOOL      ok = TRUE;
+
+#ifdef DEBUG
+   PDB *p;
+   for(p=pdb; p!=NULL; NEXT(p))
+      p->bval = p->radius;
+   blWritePDB(out, pdb);
+#endif
+
+   if(pdb==NULL)
+      return(TRUE);
+
+   if((grid = SetupCellGrid(pdb, tol, chains1, chains2, TRUE))==NULL)
+      return(FALSE);
+
+   if(doSummary)
+   {
+      if((summary = InitSummary(grid, binWidth, tol))==NULL)
+      {
+         fprintf(stderr, "Error (pdbclash): No memory for summary\n");
+         FreeCellGrid(grid);
+         return(FALSE);
+      }
+   }
+
+   if(nThreads > 1)
+   {
+      ok = AnalyzeThreaded(out, grid, checkBB, tol, nThreads, summary);
+   }
+   else
+   {
+      list.clashes    = NULL;
+      list.maxClashes = 0;
+
+      /* Step through one residue at a time                             */
+      for(res1=0; res1<grid->nRes; res1++)
+      {
+         list.nClashes = 0;
+         if(!FindResidueClashes(grid, res1, FALSE, checkBB, tol, &list))
+         {
+            fprintf(stderr, 
+                    "Error (pdbclash): No memory for clash list\n");
+            ok = FALSE;
+            break;
+         }
+         ReportClashList(out, grid, &list, summary);
+      }
+
+      if(list.clashes != NULL)
+         free(list.clashes);
+   }
+
+   if(summary != NULL)
+   {
+      if(ok)
+         PrintSummary(out, summary, grid);
+      FreeSummary(summary);
+   }
+   FreeCellGrid(grid);
+   
+   return(ok);
+}
+
+
+/************************************************************************/
+/*>CELLGRID *SetupCellGrid(PDB *pdb, REAL tol, char *chains1, 
+                           char *chains2, BOOL cullChains)
+   -------------------------------------------------------------
+   Input:   PDB      *pdb        PDB linked list with radii set
+            REAL     tol         Tolerance
+            char     *chains1    Chains for interface mode (or blank)
+            char     *chains2    Chains on the other side of the 
+                                 interface
+            BOOL     cullChains  Skip interface chain pairs whose 
+                                 bounding boxes are too far apart
+   Returns: CELLGRID *           The cell list (NULL on error)
+
+   Builds the cell list and, if needed, sets it up for interface mode.
+   Reports any error.
+
+   16.10.26 Original   By: agent
+   17.10.26 Added cullChains   By: agent
+*/
+CELLGRID *SetupCellGrid(PDB *pdb, REAL tol, char *chains1, char *chains2,
+                        BOOL cullChains)
+{
+   CELLGRID *grid;
+   REAL     cutoff;
+   
+   cutoff = FindClashCutoff(pdb, tol);
+   if((grid = BuildCellGrid(pdb, cutoff))==NULL)
+   {
+      fprintf(stderr, "Error (pdbclash): No memory for cell list\n");
+      return(NULL);
+   }
+
+   if(chains1[0])
+   {
+      if(!SetInterfaceChains(grid, chains1, chains2, cutoff, cullChains))
+      {
+         fprintf(stderr, "Error (pdbclash): No memory for chain pairs\n");
+         FreeCellGrid(grid);
+         return(NULL);
+      }
+   }
+
+   return(grid);
+}
+
+
+/************************************************************************/
+/*>BOOL AnalyzeThreaded(FILE *out, CELLGRID *grid, BOOL checkBB, REAL tol,
+                        int nThreads, SUMMARY *summary)
+   -----------------------------------------------------------------------
+   Input:   FILE     *out       Output file
+            CELLGRID *grid      Cell list
+            BOOL     checkBB    Only skip backbone/backbone contacts 
+                                between adjacent residues
+            REAL     tol        Tolerance
+            int      nThreads   Number of threads to use
+   I/O:     SUMMARY  *summary   Summary to accumulate (or NULL to print
+                                the clashes)
+   Returns: BOOL                Success (FALSE if out of memory or
+                                threads could not be started)
+
+   Splits the residues into chunks of RESCHUNK residues which are handed
+   out to worker threads as they become free. Each chunk collects its own
+   clash list, and the lists are printed in chunk order once all the
+   threads have finished, so the output is identical to a serial run.
+
+   16.10.26 Original   By: agent
+*/
+BOOL AnalyzeThreaded(FILE *out, CELLGRID *grid, BOOL checkBB, REAL tol,
+                     int nThreads, SUMMARY *summary)
+{
+   WORKQUEUE queue;
+   pthread_t threads[MAXTHREADS];
+   int       nStarted,
+             i;
+
+   queue.grid      = grid;
+   queue.checkBB   = checkBB;
+   queue.tol       = tol;
+   queue.nChunks   = (grid->nRes + RESCHUNK - 1) / RESCHUNK;
+   queue.nextChunk = 0;
+   queue.ok        = TRUE;
+
+   if((queue.chunks = (CLASHLIST *)calloc(queue.nChunks, 
+                                          sizeof(CLASHLIST)))==NULL)
+   {
+      fprintf(stderr, "Error (pdbclash): No memory for clash list\n");
+      return(FALSE);
+   }
+   pthread_mutex_init(&queue.lock, NULL);
+
+   /* Start the workers                                                 */
+   if(nThreads > MAXTHREADS)
+      nThreads = MAXTHREADS;
+   for(nStarted=0; nStarted<nThreads; nStarted++)
+   {
+      if(pthread_create(&(threads[nStarted]), NULL, ClashWorker, 
+                        (void *)&queue))
+         break;
+   }
+   if(nStarted == 0)
+   {
+      fprintf(stderr, "Error (pdbclash): Unable to start threads\n");
+      queue.ok = FALSE;
+   }
+
+   /* Wait for them to finish                                           */
+   for(i=0; i<nStarted; i++)
+      pthread_join(threads[i], NULL);
+
+   if(!queue.ok && (nStarted != 0))
+      fprintf(stderr, "Error (pdbclash): No memory for clash list\n");
+
+   /* Print the results in chunk order and free them                    */
+   for(i=0; i<queue.nChunks; i++)
+   {
+      if(queue.ok)
+         ReportClashList(out, grid, &(queue.chunks[i]), summary);
+      if(queue.chunks[i].clashes != NULL)
+         free(queue.chunks[i].clashes);
+   }
+   free(queue.chunks);
+   pthread_mutex_destroy(&queue.lock);
+
+   return(queue.ok);
+}
+
+
+/************************************************************************/
+/*>void *ClashWorker(void *arg)
+   ----------------------------
+   Input:   void  *arg       The WORKQUEUE, cast to void *
+   Returns: void *           NULL
+
+   Thread function. Repeatedly takes the next chunk of residues from the
+   work queue and finds the clashes for each residue in the chunk.
+
+   16.10.26 Original   By: agent
+*/
+void *ClashWorker(void *arg)
+{
+   WORKQUEUE *queue = (WORKQUEUE *)arg;
+   int       chunk,
+             res1,
+             lastRes;
+
+   for(;;)
+   {
+      pthread_mutex_lock(&queue->lock);
+      chunk = (queue->ok) ? (queue->nextChunk)++ : queue->nChunks;
+      pthread_mutex_unlock(&queue->lock);
+
+      if(chunk >= queue->nChunks)
+         break;
+
+      lastRes = MIN((chunk+1) * RESCHUNK, queue->grid->nRes);
+      for(res1=chunk*RESCHUNK; res1<lastRes; res1++)
+      {
+         if(!FindResidueClashes(queue->grid, res1, FALSE, queue->checkBB,
+                                queue->tol, &(queue->chunks[chunk])))
+         {
+            pthread_mutex_lock(&queue->lock);
+            queue->ok = FALSE;
+            pthread_mutex_unlock(&queue->lock);
+            break;
+         }
+      }
+   }
+
+   return(NULL);
+}
+
+
+/************************************************************************/
+/*>REAL FindClashCutoff(PDB *pdb, REAL tol)
+   ----------------------------------------
+   Input:   PDB   *pdb       PDB linked list with radii set
+            REAL  tol        Tolerance
+   Returns: REAL             Largest distance at which a clash can occur
+
+   Two atoms clash when their squared distance is less than 
+   (r1+r2-tol)^2, so the largest possible clash distance comes from the
+   largest (or, for a big tolerance, smallest) radius assigned from the
+   radius file.
+
+   16.10.26 Original   By: agent
+*/
+REAL FindClashCutoff(PDB *pdb, REAL tol)
+{
+   PDB  *p;
+   REAL minRad = pdb->radius,
+        maxRad = pdb->radius,
+        cutMin,
+        cutMax;
+   
+   for(p=pdb; p!=NULL; NEXT(p))
+   {
+      if(p->radius > maxRad)
+         maxRad = p->radius;
+      if(p->radius < minRad)
+         minRad = p->radius;
+   }
+
+   cutMax = ABS((2.0 * maxRad) - tol);
+   cutMin = ABS((2.0 * minRad) - tol);
+
+   return(MAX(cutMax, cutMin));
+}
+
+
+/************************************************************************/
+/*>CELLGRID *BuildCellGrid(PDB *pdb, REAL cutoff)
+   ----------------------------------------------
+   Input:   PDB      *pdb       PDB linked list
+            REAL     cutoff     Minimum cell size
+   Returns: CELLGRID *          The cell list (NULL if out of memory)
+
+   Indexes the atoms and residues of the linked list and bins the atoms
+   into a uniform grid of cubic cells. Residues are numbered in the order
+   that blFindNextResidue() walks them. Atoms within each cell are kept
+   in a linked list (cellHead/atomNext) in PDB order; being a linked list
+   lets MoveGridAtom() move an atom to a new cell cheaply. If the 
+   structure is so spread out that there
+   would be more than MAXCELLS cells, the cell size is increased.
+   Each atom is also classified once with ClassifyAtom() so that the 
+   pair tests need no string comparisons.
+
+   16.10.26 Original   By: agent
+*/
+CELLGRID *BuildCellGrid(PDB *pdb, REAL cutoff)
+{
+   CELLGRID *grid;
+   PDB      *p, 
+            *nextRes;
+   REAL     xmax, ymax, zmax;
+   int      nCells, 
+            i;
+
+   if((grid = (CELLGRID *)malloc(sizeof(CELLGRID)))==NULL)
+      return(NULL);
+   grid->atoms     = NULL;
+   grid->atomFlags = NULL;
+   grid->atomRes   = NULL;
+   grid->resChain  = NULL;
+   grid->chainRes  = NULL;
+   grid->chainPairs = NULL;
+   grid->chainUsed  = NULL;
+   grid->resStart  = NULL;
+   grid->atomCell  = NULL;
+   grid->cellHead  = NULL;
+   grid->atomNext  = NULL;
+   
+   /* Count the atoms and residues and find the bounding box            */
+   grid->nAtoms = grid->nRes = 0;
+   grid->xmin   = xmax = pdb->x;
+   grid->ymin   = ymax = pdb->y;
+   grid->zmin   = zmax = pdb->z;
+   for(p=pdb; p!=NULL; p=nextRes)
+   {
+      nextRes = blFindNextResidue(p);
+      for(; p!=nextRes; NEXT(p))
+      {
+         if(p->x < grid->xmin) grid->xmin = p->x;
+         if(p->y < grid->ymin) grid->ymin = p->y;
+         if(p->z < grid->zmin) grid->zmin = p->z;
+         if(p->x > xmax)       xmax       = p->x;
+         if(p->y > ymax)       ymax       = p->y;
+         if(p->z > zmax)       zmax       = p->z;
+         grid->nAtoms++;
+      }
+      grid->nRes++;
+   }
+
+   /* Choose the cell size and grid dimensions                          */
+   grid->cellSize = MAX(cutoff, MINCELLSIZE);
+   do
+   {
+      grid->nx = 1 + (int)((xmax - grid->xmin) / grid->cellSize);
+      grid->ny = 1 + (int)((ymax - grid->ymin) / grid->cellSize);
+      grid->nz = 1 + (int)((zmax - grid->zmin) / grid->cellSize);
+      if(((double)grid->nx * grid->ny * grid->nz) <= (double)MAXCELLS)
+         break;
+      grid->cellSize *= 2.0;
+   }  while(TRUE);
+   nCells = grid->nx * grid->ny * grid->nz;
+
+   /* Allocate the index arrays                                         */
+   if(((grid->atoms     = (PDB **)malloc(grid->nAtoms * sizeof(PDB *)))
+       ==NULL) ||
+      ((grid->atomFlags = (unsigned char *)malloc(grid->nAtoms * 
+                                                  sizeof(unsigned char)))
+       ==NULL) ||
+      ((grid->atomRes   = (int *)malloc(grid->nAtoms * sizeof(int)))
+       ==NULL) ||
+      ((grid->atomCell  = (int *)malloc(grid->nAtoms * sizeof(int)))
+       ==NULL) ||
+      ((grid->atomNext  = (int *)malloc(grid->nAtoms * sizeof(int)))
+       ==NULL) ||
+      ((grid->resStart  = (int *)malloc((grid->nRes+1) * sizeof(int)))
+       ==NULL) ||
+      ((grid->resChain  = (int *)malloc(grid->nRes * sizeof(int)))
+       ==NULL) ||
+      ((grid->chainRes  = (int *)malloc(grid->nRes * sizeof(int)))
+       ==NULL) ||
+      ((grid->cellHead  = (int *)malloc(nCells * sizeof(int)))
+       ==NULL))
+   {
+      FreeCellGrid(grid);
+      return(NULL);
+   }
+
+   /* Fill in the atom, residue and chain indexes                     */
+   grid->nAtoms = grid->nRes = grid->nChains = 0;
+   for(p=pdb; p!=NULL; p=nextRes)
+   {
+      nextRes = blFindNextResidue(p);
+      grid->resStart[grid->nRes] = grid->nAtoms;
+      grid->resChain[grid->nRes] = FindChainIndex(grid, p);
+      for(; p!=nextRes; NEXT(p))
+      {
+         grid->atoms[grid->nAtoms]     = p;
+         grid->atomFlags[grid->nAtoms] = (unsigned char)ClassifyAtom(p);
+         grid->atomRes[grid->nAtoms]   = grid->nRes;
+         grid->atomCell[grid->nAtoms]  = FindCell(grid, p->x, p->y, p->z);
+         grid->nAtoms++;
+      }
+      grid->nRes++;
+   }
+   grid->resStart[grid->nRes] = grid->nAtoms;
+
+   /* Bin the atoms. Working backwards leaves each cell in PDB order    */
+   for(i=0; i<nCells; i++)
+      grid->cellHead[i] = -1;
+   for(i=grid->nAtoms-1; i>=0; i--)
+   {
+      grid->atomNext[i]                 = grid->cellHead[grid->atomCell[i]];
+      grid->cellHead[grid->atomCell[i]] = i;
+   }
+
+   return(grid);
+}
+
+
+/************************************************************************/
+/*>int FindCell(CELLGRID *grid, REAL x, REAL y, REAL z)
+   ----------------------------------------------------
+   Input:   CELLGRID *grid      Cell list
+            REAL     x, y, z    Coordinates
+   Returns: int                 Cell index
+
+   Finds the cell for a point. Points outside the grid (which can happen
+   when atoms are moved in server mode) go in the nearest edge cell; 
+   since every atom in the grid is inside it, this still finds all the
+   atoms within the cell size of the point.
+
+   16.10.26 Original   By: agent
+*/
+int FindCell(CELLGRID *grid, REAL x, REAL y, REAL z)
+{
+   REAL fx = (x - grid->xmin) / grid->cellSize,
+        fy = (y - grid->ymin) / grid->cellSize,
+        fz = (z - grid->zmin) / grid->cellSize;
+   int  ix, iy, iz;
+
+   ix = (fx < (REAL)0.0) ? 0 : ((fx >= grid->nx) ? grid->nx-1 : (int)fx);
+   iy = (fy < (REAL)0.0) ? 0 : ((fy >= grid->ny) ? grid->ny-1 : (int)fy);
+   iz = (fz < (REAL)0.0) ? 0 : ((fz >= grid->nz) ? grid->nz-1 : (int)fz);
+
+   return(CELLINDEX(grid, ix, iy, iz));
+}
+
+
+/************************************************************************/
+/*>void MoveGridAtom(CELLGRID *grid, int atom, REAL x, REAL y, REAL z)
+   -------------------------------------------------------------------
+   Input:   CELLGRID *grid      Cell list
+            int      atom       Atom index
+            REAL     x, y, z    New coordinates
+
+   Moves an atom, updating the PDB coordinates and moving it to its new
+   cell if it has changed cell. The cell's list is kept in PDB order.
+
+   16.10.26 Original   By: agent
+*/
+void MoveGridAtom(CELLGRID *grid, int atom, REAL x, REAL y, REAL z)
+{
+   PDB *p       = grid->atoms[atom];
+   int oldCell  = grid->atomCell[atom],
+       newCell  = FindCell(grid, x, y, z),
+       *link;
+
+   p->x = x;
+   p->y = y;
+   p->z = z;
+   if(newCell == oldCell)
+      return;
+
+   /* Unlink from the old cell                                          */
+   for(link=&(grid->cellHead[oldCell]); *link!=atom; 
+       link=&(grid->atomNext[*link]));
+   *link = grid->atomNext[atom];
+
+   /* Link into the new cell                                            */
+   for(link=&(grid->cellHead[newCell]); (*link>=0) && (*link<atom); 
+       link=&(grid->atomNext[*link]));
+   grid->atomNext[atom] = *link;
+   *link                = atom;
+   grid->atomCell[atom] = newCell;
+}
+
+
+/************************************************************************/
+/*>int FindChainIndex(CELLGRID *grid, PDB *p)
+   ------------------------------------------
+   Input:   CELLGRID *grid      Cell list being built
+            PDB      *p         First atom of the current residue 
+                                (grid->nRes)
+   Returns: int                 Chain index
+
+   Looks up the chain label of a residue among the chains seen so far,
+   adding it as a new chain if it has not been seen before. Called by
+   BuildCellGrid() once per residue.
+
+   16.10.26 Original   By: agent
+*/
+int FindChainIndex(CELLGRID *grid, PDB *p)
+{
+   int i;
+
+   /* Most likely the same chain as the previous residue                */
+   if((grid->nRes > 0) &&
+      CHAINMATCH(grid->atoms[grid->resStart[grid->nRes-1]]->chain,
+                 p->chain))
+      return(grid->resChain[grid->nRes-1]);
+
+   for(i=0; i<grid->nChains; i++)
+   {
+      if(CHAINMATCH(grid->atoms[grid->resStart[grid->chainRes[i]]]->chain,
+                    p->chain))
+         return(i);
+   }
+
+   grid->chainRes[grid->nChains] = grid->nRes;
+   return((grid->nChains)++);
+}
+
 
 /************************************************************************/
-/* Globals
+/*>BOOL SetInterfaceChains(CELLGRID *grid, char *chains1, char *chains2,
+                           REAL cutoff, BOOL cullChains)
+   ---------------------------------------------------------------------
+   Input:   CELLGRID *grid       Cell list
+            char     *chains1    Comma-separated list of chain labels
+            char     *chains2    Comma-separated list of chain labels
+            REAL     cutoff      Largest possible clash distance
+            BOOL     cullChains  Skip chain pairs whose bounding boxes 
+                                 are too far apart
+   Returns: BOOL                 Success (FALSE if out of memory)
+
+   Sets up the cell list so that only clashes between a chain in chains1
+   and a chain in chains2 are tested. With cullChains, the bounding box
+   of each chain is found (as in getrnaandnear) and chain pairs whose 
+   boxes are more than the clash cutoff apart are not tested at all.
+   This is only valid while the atoms don't move.
+
+   16.10.26 Original   By: agent
+   17.10.26 Added cullChains   By: agent
+*/
+BOOL SetInterfaceChains(CELLGRID *grid, char *chains1, char *chains2,
+                        REAL cutoff, BOOL cullChains)
+{
+   REAL *bounds;                 /* xmin,xmax,ymin,ymax,zmin,zmax       */
+   int  i, j, k;
+
+   if(((grid->chainPairs = (unsigned char *)
+        calloc(grid->nChains * grid->nChains, sizeof(unsigned char)))
+       ==NULL) ||
+      ((grid->chainUsed = (unsigned char *)
+        calloc(grid->nChains, sizeof(unsigned char)))==NULL) ||
+      ((bounds = (REAL *)malloc(6 * grid->nChains * sizeof(REAL)))
+       ==NULL))
+      return(FALSE);
+
+   /* Find the chain bounding boxes                                     */
+   for(i=0; i<grid->nChains; i++)
+   {
+      /* xmin > xmax flags that the box has not been started            */
+      bounds[6*i]   = (REAL)1.0;
+      bounds[6*i+1] = (REAL)(-1.0);
+   }
+   for(i=0; i<grid->nAtoms; i++)
+   {
+      PDB  *p  = grid->atoms[i];
+      REAL *bb = bounds + 6 * grid->resChain[grid->atomRes[i]];
+      
+      if(bb[0] > bb[1])
+      {
+         bb[0] = bb[1] = p->x;
+         bb[2] = bb[3] = p->y;
+         bb[4] = bb[5] = p->z;
+      }
+      else
+      {
+         if(p->x < bb[0]) bb[0] = p->x;
+         if(p->x > bb[1]) bb[1] = p->x;
+         if(p->y < bb[2]) bb[2] = p->y;
+         if(p->y > bb[3]) bb[3] = p->y;
+         if(p->z < bb[4]) bb[4] = p->z;
+         if(p->z > bb[5]) bb[5] = p->z;
+      }
+   }
+
+   /* Flag the chain pairs that span the interface and are close enough*/
+   for(i=0; i<grid->nChains; i++)
+   {
+      char *chain1 = grid->atoms[grid->resStart[grid->chainRes[i]]]->chain;
+      
+      for(j=0; j<grid->nChains; j++)
+      {
+         char *chain2 = 
+            grid->atoms[grid->resStart[grid->chainRes[j]]]->chain;
+         REAL *bb1    = bounds + 6*i,
+              *bb2    = bounds + 6*j;
+         BOOL close   = TRUE;
+         
+         if(!((InChainList(chains1, chain1) &&
+               InChainList(chains2, chain2)) ||
+              (InChainList(chains2, chain1) &&
+               InChainList(chains1, chain2))))
+            continue;
+
+         for(k=0; cullChains && (k<6); k+=2)
+         {
+            if(((bb1[k+1] + cutoff) < bb2[k]) ||
+               ((bb2[k+1] + cutoff) < bb1[k]))
+               close = FALSE;
+         }
+
+         if(close)
+         {
+            grid->chainPairs[i * grid->nChains + j] = 1;
+            grid->chainUsed[i] = 1;
+         }
+      }
+   }
+
+   free(bounds);
+   return(TRUE);
+}
+
+
+/************************************************************************/
+/*>BOOL InChainList(char *chains, char *chain)
+   -------------------------------------------
+   Input:   char  *chains    Comma-separated list of chain labels
+            char  *chain     Chain label
+   Returns: BOOL             Is the chain in the list?
+
+   16.10.26 Original   By: agent
 */
+BOOL InChainList(char *chains, char *chain)
+{
+   char *c = chains;
+   int  len = strlen(chain);
+   
+   while(*c)
+   {
+      if(!strncmp(c, chain, len) && ((c[len] == ',') || (c[len] == '\0')))
+         return(TRUE);
+      while(*c && (*c != ','))
+         c++;
+      if(*c == ',')
+         c++;
+   }
+   return(FALSE);
+}
+
 
 /************************************************************************/
-/* Prototypes
+/*>void FreeCellGrid(CELLGRID *grid)
+   ---------------------------------
+   Input:   CELLGRID *grid      Cell list to free
+
+   Frees a cell list created by BuildCellGrid()
+
+   16.10.26 Original   By: agent
 */
-BOOL ParseCmdLine(int argc, char **argv, char *infile, char *outfile,
-                  char *radFile, BOOL *checkBB, REAL *tol);
-void Usage(void);
-int main(int argc, char **argv);
-BOOL Analyze(FILE *outfile, PDB *pdb, BOOL checkBB, REAL tol);
-void CheckClashes(FILE *out,
-                  PDB *res1, PDB *nextRes1,
-                  PDB *res2, PDB *nextRes2,
-                  BOOL checkBB, REAL tol);
+void FreeCellGrid(CELLGRID *grid)
+{
+   if(grid == NULL)
+      return;
+   if(grid->atoms     != NULL) free(grid->atoms);
+   if(grid->atomFlags != NULL) free(grid->atomFlags);
+   if(grid->atomRes   != NULL) free(grid->atomRes);
+   if(grid->atomCell  != NULL) free(grid->atomCell);
+   if(grid->atomNext  != NULL) free(grid->atomNext);
+   if(grid->resStart  != NULL) free(grid->resStart);
+   if(grid->resChain  != NULL) free(grid->resChain);
+   if(grid->chainRes  != NULL) free(grid->chainRes);
+   if(grid->chainPairs != NULL) free(grid->chainPairs);
+   if(grid->chainUsed  != NULL) free(grid->chainUsed);
+   if(grid->cellHead  != NULL) free(grid->cellHead);
+   free(grid);
+}
 
 
 /************************************************************************/
-int main(int argc, char **argv)
+/*>BOOL FindResidueClashes(CELLGRID *grid, int res1, BOOL bothWays,
+                           BOOL checkBB, REAL tol, CLASHLIST *list)
+   -------------------------------------------------------------------
+   Input:   CELLGRID  *grid       Cell list
+            int       res1        Residue index
+            BOOL      bothWays    Look at earlier as well as later 
+                                  residues
+            BOOL      checkBB     Only skip backbone/backbone contacts 
+                                  between adjacent residues
+            REAL      tol         Tolerance
+   I/O:     CLASHLIST *list       Clash list (grown as required)
+   Returns: BOOL                  Success (FALSE if out of memory)
+
+   Finds the clashes between atoms of residue res1 and atoms of all later
+   residues (or all other residues if bothWays is set) by looking only 
+   in the neighbouring cells of each atom. The clashes are appended to 
+   the list and sorted into residue-pair order. If the cell list has 
+   been set up for interface mode, only atoms in the selected chain pairs
+   are tested.
+
+   16.10.26 Original   By: agent
+   16.10.26 Added bothWays   By: agent
+*/
+BOOL FindResidueClashes(CELLGRID *grid, int res1, BOOL bothWays, 
+                        BOOL checkBB, REAL tol, CLASHLIST *list)
 {
-   char infile[MAXBUFF],
-      outfile[MAXBUFF],
-      radFile[MAXBUFF];
-   int  natoms;
-   FILE *in  = stdin,
-        *out = stdout,
-        *fpRad = NULL;
-   PDB  *pdb, *pdbin;
-   BOOL noenv,
-        checkBB = FALSE;
-   REAL tol = (REAL)0.0;
+   unsigned char *chainPairs = NULL;
+   int           first       = list->nClashes,
+                 i;
 
-   strncpy(radFile, DEF_RADFILE, MAXBUFF);
+   /* In interface mode, find the chains that pair with this chain      */
+   if(grid->chainPairs != NULL)
+   {
+      int chain1 = grid->resChain[res1];
+      
+      if(!grid->chainUsed[chain1])
+         return(TRUE);
+      chainPairs = grid->chainPairs + chain1 * grid->nChains;
+   }
    
-   if(ParseCmdLine(argc, argv, infile, outfile, radFile, &checkBB, &tol))
+   for(i=grid->resStart[res1]; i<grid->resStart[res1+1]; i++)
    {
-      /* Open the radius file                                           */
-      if((fpRad=blOpenFile(radFile, DATA_ENV, "r", &noenv))==NULL)
+      int cell = grid->atomCell[i],
+          ix   = cell % grid->nx,
+          iy   = (cell / grid->nx) % grid->ny,
+          iz   = cell / (grid->nx * grid->ny),
+          jx, jy, jz;
+
+      for(jx=MAX(ix-1, 0); jx<=MIN(ix+1, grid->nx-1); jx++)
       {
-         fprintf(stderr, "Error (pdbclash): Unable to open radius file, \
-%s\n", radFile);
-         if(noenv)
+         for(jy=MAX(iy-1, 0); jy<=MIN(iy+1, grid->ny-1); jy++)
          {
-            fprintf(stderr, "              Environment variable %s \
-not set\n", DATA_ENV);
+            for(jz=MAX(iz-1, 0); jz<=MIN(iz+1, grid->nz-1); jz++)
+            {
+               int j;
+               
+               for(j=grid->cellHead[CELLINDEX(grid, jx, jy, jz)]; 
+                   j>=0; 
+                   j=grid->atomNext[j])
+               {
+                  int   res2 = grid->atomRes[j];
+                  REAL  dist, sumVDWR;
+                  CLASH *clash;
+                  
+                  if((res2 == res1) || (!bothWays && (res2 < res1)))
+                     continue;
+                  if((chainPairs != NULL) && 
+                     !chainPairs[grid->resChain[res2]])
+                     continue;
+                  
+                  if(TestClash(grid->atoms[i], grid->atoms[j],
+                               grid->atomFlags[i], grid->atomFlags[j],
+                               ((res2 == res1+1) || (res2 == res1-1)),
+                               checkBB, tol, &dist, &sumVDWR))
+                  {
+                     if(list->nClashes >= list->maxClashes)
+                     {
+                        CLASH *newClashes;
+                        int   newMax = (list->maxClashes) ? 
+                                       2 * list->maxClashes : ALLOCQUANTUM;
+                        if((newClashes = (CLASH *)
+                            realloc(list->clashes, newMax*sizeof(CLASH)))
+                           == NULL)
+                           return(FALSE);
+                        list->clashes    = newClashes;
+                        list->maxClashes = newMax;
+                     }
+                     /* Always store with the atoms in PDB order      */
+                     clash = &(list->clashes[(list->nClashes)++]);
+                     clash->res2    = MAX(res1, res2);
+                     clash->atom1   = MIN(i, j);
+                     clash->atom2   = MAX(i, j);
+                     clash->dist    = dist;
+                     clash->sumVDWR = sumVDWR;
+                  }
+               }
+            }
          }
-         return(1);
       }
+   }
 
-      if(blOpenStdFiles(infile, outfile, &in, &out))
-      {
-         if((pdbin = blReadPDB(in, &natoms)) == NULL)
-         {
-            fprintf(stderr, "Unable to read PDB file\n");
-            return(1);
-         }
+   /* Put them back into residue-pair order                             */
+   qsort(list->clashes + first, list->nClashes - first, sizeof(CLASH),
+         CompareClashes);
 
+   return(TRUE);
+}
 
-         /* Remove waters                                               */
-         pdb = blStripWatersPDBAsCopy(pdbin, &natoms);
-         FREELIST(pdbin, PDB);
-         
-         /* Set the atom radii in the linked list                       */
-         blSetAtomRadii(pdb, fpRad);
-         
-         /* Perform the analysis                                        */
-         if(!Analyze(out, pdb, checkBB, tol))
-            return(1);
+
+/************************************************************************/
+/*>int CompareClashes(const void *a, const void *b)
+   ------------------------------------------------
+   qsort() comparison function to put clashes for a residue into the 
+   order in which the residue-pair scan visits them: by second residue,
+   then by first atom, then by second atom.
+
+   16.10.26 Original   By: agent
+*/
+int CompareClashes(const void *a, const void *b)
+{
+   const CLASH *c1 = (const CLASH *)a,
+               *c2 = (const CLASH *)b;
+
+   if(c1->res2  != c2->res2)
+      return((c1->res2  < c2->res2)  ? -1 : 1);
+   if(c1->atom1 != c2->atom1)
+      return((c1->atom1 < c2->atom1) ? -1 : 1);
+   if(c1->atom2 != c2->atom2)
+      return((c1->atom2 < c2->atom2) ? -1 : 1);
+   return(0);
+}
+
+
+/************************************************************************/
+/*>int ClassifyAtom(PDB *p)
+   ------------------------
+   Input:   PDB   *p         Atom
+   Returns: int              ATOM_ flags for the atom
+
+   Works out the properties of an atom that TestClash() needs so that
+   the string comparisons are only done once per atom rather than once
+   per atom pair.
+
+   16.10.26 Original   By: agent
+*/
+int ClassifyAtom(PDB *p)
+{
+   int flags = 0;
+   
+   if(ISBACKBONE(p))
+      flags |= ATOM_BACKBONE;
+
+   if(!strncmp(p->resnam, "CYS", 3))
+   {
+      if(!strncmp(p->atnam, "SG  ", 4))
+         flags |= ATOM_CYSSG;
+      else if(!strncmp(p->atnam, "CB  ", 4))
+         flags |= ATOM_CYSCB;
+   }
+   
+   return(flags);
+}
+
+
+/************************************************************************/
+/*>BOOL TestClash(PDB *p, PDB *q, int flags1, int flags2, BOOL adjacent,
+                  BOOL checkBB, REAL tol, REAL *dist, REAL *sumVDWR)
+   ---------------------------------------------------------------------
+   Input:   PDB   *p         First atom
+            PDB   *q         Second atom
+            int   flags1     ATOM_ flags for the first atom
+            int   flags2     ATOM_ flags for the second atom
+            BOOL  adjacent   Atoms are in sequence-adjacent residues
+            BOOL  checkBB    Only skip backbone/backbone contacts between
+                             adjacent residues
+            REAL  tol        Tolerance
+   Output:  REAL  *dist      Distance between the atoms
+            REAL  *sumVDWR   Sum of the VDW radii
+   Returns: BOOL             Do the atoms clash?
+
+   Tests whether a pair of atoms clash. Split out of the old 
+   CheckClashes()
+
+   12.01.19 Original   By: ACRM
+   16.10.26 Split out as a separate routine   By: agent
+   16.10.26 Uses precalculated atom flags   By: agent
+*/
+BOOL TestClash(PDB *p, PDB *q, int flags1, int flags2, BOOL adjacent,
+               BOOL checkBB, REAL tol, REAL *dist, REAL *sumVDWR)
+{
+   REAL sumVDWRSq, distSq;
+
+   /* If we are looking at sequence-adjacent residues                   */
+   if(adjacent)
+   {
+      if(checkBB)
+      {
+         /* If we are looking at two backbone atoms then skip it        */
+         if(flags1 & flags2 & ATOM_BACKBONE)
+            return(FALSE);
+      }
+      else
+      {
+         return(FALSE);
       }
    }
+
+   /* Ignore Cys-(SG/CB) - Cys-(SG/CB) as this is probably a disulphide 
+      if the distance is low. (CB-CB is not skipped.)
+   */
+   if(((flags1 & ATOM_CYSSG) && (flags2 & (ATOM_CYSSG|ATOM_CYSCB))) ||
+      ((flags1 & ATOM_CYSCB) && (flags2 & ATOM_CYSSG)))
+      return(FALSE);
+
+   *sumVDWR  = (p->radius + q->radius);
+   sumVDWRSq = (*sumVDWR-tol) * (*sumVDWR-tol);
+   distSq    = DISTSQ(p, q);
+   
+   if(distSq < sumVDWRSq)
+   {
+      *dist = sqrt(distSq);
+      return(TRUE);
+   }
+   
+   return(FALSE);
+}
+
+
+/************************************************************************/
+/*>void PrintClashList(FILE *out, CELLGRID *grid, CLASHLIST *list)
+   ---------------------------------------------------------------
+   Input:   FILE      *out      Output file
+            CELLGRID  *grid     Cell list
+            CLASHLIST *list     Clash list
+
+   Prints all the clashes in a clash list
+
+   16.10.26 Original   By: agent
+*/
+void PrintClashList(FILE *out, CELLGRID *grid, CLASHLIST *list)
+{
+   int i;
+   
+   for(i=0; i<list->nClashes; i++)
+   {
+      PrintClash(out, grid->atoms[list->clashes[i].atom1], 
+                 grid->atoms[list->clashes[i].atom2],
+                 list->clashes[i].dist, list->clashes[i].sumVDWR);
+   }
+}
+
+
+/************************************************************************/
+/*>void ReportClashList(FILE *out, CELLGRID *grid, CLASHLIST *list,
+                        SUMMARY *summary)
+   ----------------------------------------------------------------
+   Input:   FILE      *out      Output file
+            CELLGRID  *grid     Cell list
+            CLASHLIST *list     Clash list
+   I/O:     SUMMARY   *summary  Summary (or NULL)
+
+   Adds the clashes to the summary if we are summarizing, otherwise 
+   prints them
+
+   16.10.26 Original   By: agent
+*/
+void ReportClashList(FILE *out, CELLGRID *grid, CLASHLIST *list,
+                     SUMMARY *summary)
+{
+   if(summary != NULL)
+      AccumulateSummary(summary, grid, list);
    else
+      PrintClashList(out, grid, list);
+}
+
+
+/************************************************************************/
+/*>SUMMARY *InitSummary(CELLGRID *grid, REAL binWidth, REAL tol)
+   -------------------------------------------------------------
+   Input:   CELLGRID *grid      Cell list
+            REAL     binWidth   Histogram bin width
+            REAL     tol        Tolerance
+   Returns: SUMMARY *           Empty summary (NULL if out of memory)
+
+   Creates an empty summary with per-residue and per-chain counts for 
+   the structure. Clash overlaps are always greater than the tolerance,
+   so the histogram starts at zero unless the tolerance is negative.
+
+   16.10.26 Original   By: agent
+*/
+SUMMARY *InitSummary(CELLGRID *grid, REAL binWidth, REAL tol)
+{
+   SUMMARY *summary;
+   int     i;
+
+   if((summary = (SUMMARY *)malloc(sizeof(SUMMARY)))==NULL)
+      return(NULL);
+
+   summary->resCounts   = (int *)calloc(grid->nRes,    sizeof(int));
+   summary->chainCounts = (int *)calloc(grid->nChains, sizeof(int));
+   if((summary->resCounts == NULL) || (summary->chainCounts == NULL))
    {
-      Usage();
+      FreeSummary(summary);
+      return(NULL);
    }
 
-   return(0);
+   summary->binWidth = binWidth;
+   summary->binMin   = (tol < (REAL)0.0) ? 
+                       binWidth * floor(tol / binWidth) : (REAL)0.0;
+   summary->worst    = (REAL)0.0;
+   summary->nClashes = 0;
+   for(i=0; i<NBINS; i++)
+      summary->bins[i] = 0;
+
+   return(summary);
 }
 
+
 /************************************************************************/
-BOOL Analyze(FILE *out, PDB *pdb, BOOL checkBB, REAL tol)
+/*>void FreeSummary(SUMMARY *summary)
+   ----------------------------------
+   Input:   SUMMARY  *summary   Summary to free
+
+   16.10.26 Original   By: agent
+*/
+void FreeSummary(SUMMARY *summary)
 {
-   PDB *res1, *res2, *nextRes1, *nextRes2;
+   if(summary->resCounts   != NULL) free(summary->resCounts);
+   if(summary->chainCounts != NULL) free(summary->chainCounts);
+   free(summary);
+}
 
-#ifdef DEBUG
-   PDB *p;
-   for(p=pdb; p!=NULL; NEXT(p))
-      p->bval = p->radius;
-   blWritePDB(out, pdb);
-#endif
 
-   /* Step through one residue at a time                                */
-   for(res1=pdb; res1!=NULL; res1=nextRes1)
+/************************************************************************/
+/*>void AccumulateSummary(SUMMARY *summary, CELLGRID *grid, 
+                          CLASHLIST *list)
+   --------------------------------------------------------
+   Input:   CELLGRID  *grid     Cell list
+            CLASHLIST *list     Clash list
+   I/O:     SUMMARY   *summary  Summary
+
+   Adds a list of clashes to the histogram and residue and chain counts.
+   A clash counts once for each of the two residues, and once for each 
+   chain involved.
+
+   16.10.26 Original   By: agent
+*/
+void AccumulateSummary(SUMMARY *summary, CELLGRID *grid, 
+                       CLASHLIST *list)
+{
+   int i;
+   
+   for(i=0; i<list->nClashes; i++)
    {
-      /* Find the next residue                                          */
-      nextRes1 = blFindNextResidue(res1);
+      CLASH *clash  = &(list->clashes[i]);
+      REAL  overlap = clash->sumVDWR - clash->dist;
+      int   res1    = grid->atomRes[clash->atom1],
+            chain1  = grid->resChain[res1],
+            chain2  = grid->resChain[clash->res2],
+            bin;
 
-      /* Step through subsequent residues one at a time                 */
-      for(res2=nextRes1; res2!=NULL; res2=nextRes2)
-      {
-         /* Find the next residue                                       */
-         nextRes2 = blFindNextResidue(res2);
+      bin = (int)((overlap - summary->binMin) / summary->binWidth);
+      if(bin >= NBINS)
+         bin = NBINS-1;
+      if(bin < 0)
+         bin = 0;
+      summary->bins[bin]++;
+      
+      if((summary->nClashes == 0) || (overlap > summary->worst))
+         summary->worst = overlap;
+      summary->nClashes++;
 
-         /* And check for clashes...                                    */
-         CheckClashes(out, res1, nextRes1, res2, nextRes2, checkBB, tol);
-      }
+      summary->resCounts[res1]++;
+      summary->resCounts[clash->res2]++;
+      summary->chainCounts[chain1]++;
+      if(chain2 != chain1)
+         summary->chainCounts[chain2]++;
    }
-   
-   return(TRUE);
 }
 
-void CheckClashes(FILE *out,
-                  PDB *res1, PDB *nextRes1,
-                  PDB *res2, PDB *nextRes2,
-                  BOOL checkBB, REAL tol)
+
+/************************************************************************/
+/*>void PrintSummary(FILE *out, SUMMARY *summary, CELLGRID *grid)
+   --------------------------------------------------------------
+   Input:   FILE     *out       Output file
+            SUMMARY  *summary   Summary
+            CELLGRID *grid      Cell list
+
+   Prints the summary tables: the histogram of clash overlaps, clashes
+   per chain and clashes per residue (residues with no clashes are not
+   listed).
+
+   16.10.26 Original   By: agent
+*/
+void PrintSummary(FILE *out, SUMMARY *summary, CELLGRID *grid)
 {
-   PDB *p, *q;
+   int  i;
+   char resspec[RESBUFF];
    
-   for(p=res1; p!=nextRes1; NEXT(p))
+   fprintf(out, "Clashes: %d Worst: %.2f\n", 
+           summary->nClashes, summary->worst);
+
+   fprintf(out, "\nHistogram of clash overlaps\n");
+   for(i=0; i<NBINS; i++)
+   {
+      REAL low = summary->binMin + (i * summary->binWidth);
+      
+      if(i < NBINS-1)
+         fprintf(out, "%6.2f - %6.2f %8d\n", 
+                 low, low + summary->binWidth, summary->bins[i]);
+      else
+         fprintf(out, "%6.2f -        %8d\n", low, summary->bins[i]);
+   }
+
+   fprintf(out, "\nClashes by chain\n");
+   for(i=0; i<grid->nChains; i++)
    {
-      for(q=res2; q!=nextRes2; NEXT(q))
+      fprintf(out, "%5s %8d\n", 
+              grid->atoms[grid->resStart[grid->chainRes[i]]]->chain,
+              summary->chainCounts[i]);
+   }
+
+   fprintf(out, "\nClashes by residue\n");
+   for(i=0; i<grid->nRes; i++)
+   {
+      if(summary->resCounts[i])
       {
-         REAL sumVDWR   = (p->radius + q->radius);
-         REAL sumVDWRSq = (sumVDWR-tol) * (sumVDWR-tol);
-         REAL distSq    = DISTSQ(p, q);
+         PDB *p = grid->atoms[grid->resStart[i]];
+         blBuildResSpec(p, resspec);
+         fprintf(out, "%5s %-4s %8d\n", 
+                 resspec, p->resnam, summary->resCounts[i]);
+      }
+   }
+}
 
-         /* If we are looking at sequence-adjacent residues             */
-         if((res2 == nextRes1) &&
-            CHAINMATCH(res2->chain, nextRes1->chain))
-         {
-            if(checkBB)
-            {
-               /* If we are looking at two backbone atoms then skip it  */
-               if(ISBACKBONE(p) && ISBACKBONE(q))
-                  continue;
-            }
-            else
-            {
-               continue;
-            }
-         }
 
-         /* Ignore Cys-(SG/CB) - Cys-(SG/CB) as this is probably a disulphide if the
-            distance is low
-         */
-         if(!strncmp(p->resnam, "CYS", 3) &&
-            !strncmp(q->resnam, "CYS", 3))
-         {
-            if(!strncmp(p->atnam, "SG  ", 4) && !strncmp(q->atnam, "SG  ", 4))
-               continue;
-            if(!strncmp(p->atnam, "SG  ", 4) && !strncmp(q->atnam, "CB  ", 4))
-               continue;
-            if(!strncmp(p->atnam, "CB  ", 4) && !strncmp(q->atnam, "SG  ", 4))
-               continue;
-         }
-         
-         
-         if(distSq < sumVDWRSq)
-         {
-            REAL dist = sqrt(distSq);
-            char resspec1[16],
-                 resspec2[16];
-            blBuildResSpec(p, resspec1);
-            blBuildResSpec(q, resspec2);
+/************************************************************************/
+/*>void PrintClash(FILE *out, PDB *p, PDB *q, REAL dist, REAL sumVDWR)
+   -------------------------------------------------------------------
+   Input:   FILE  *out       Output file
+            PDB   *p         First atom
+            PDB   *q         Second atom
+            REAL  dist       Distance between the atoms
+            REAL  sumVDWR    Sum of the VDW radii
+
+   Prints a clash
+
+   12.01.19 Original   By: ACRM
+   16.10.26 Split out as a separate routine   By: agent
+*/
+void PrintClash(FILE *out, PDB *p, PDB *q, REAL dist, REAL sumVDWR)
+{
+   char resspec1[RESBUFF],
+        resspec2[RESBUFF];
+
+   blBuildResSpec(p, resspec1);
+   blBuildResSpec(q, resspec2);
             
-            fprintf(out, "%5s:%s clash with %5s:%s \
+   fprintf(out, "%5s:%s clash with %5s:%s \
 Dist: %.2f Allowed: %.2f Clash: %.2f\n",
-                    resspec1, p->atnam,
-                    resspec2, q->atnam,
-                    dist, sumVDWR, (sumVDWR-dist));
-         }
-      }
-   }
+           resspec1, p->atnam,
+           resspec2, q->atnam,
+           dist, sumVDWR, (sumVDWR-dist));
 }
 
 /************************************************************************/
 /*>BOOL ParseCmdLine(int argc, char **argv, char *infile, char *outfile,
-                     char *radFile, BOOL *checkBB, REAL *tol) 
+                     char *radFile, BOOL *checkBB, REAL *tol,
+                     int *nThreads, BOOL *doSummary, REAL *binWidth,
+                     char *tableFile, char *compileFile, char *chains1,
+                     char *chains2, BOOL *serverMode) 
    ---------------------------------------------------------------------
    Input:   int    argc         Argument count
             char   **argv       Argument array
@@ -260,19 +2271,38 @@ Dist: %.2f Allowed: %.2f Clash: %.2f\n",
                                 should we also check that atoms are
                                 both backbone
             REAL   *tol         Tolerance
+            int    *nThreads    Number of threads
+            BOOL   *doSummary   Print a summary rather than every clash
+            REAL   *binWidth    Summary histogram bin width
+            char   *tableFile   Compiled radius table (or blank string)
+            char   *compileFile File to compile the radius file into
+                                (or blank string)
+            char   *chains1     Chains on one side of the interface
+                                (or blank string)
+            char   *chains2     Chains on the other side of the interface
+            BOOL   *serverMode  Take move commands from stdin
    Returns: BOOL                Success?
 
    Parse the command line
    
    12.01.19 Original    By: ACRM
+   16.10.26 Added -j   By: agent
+   16.10.26 Added -s and -w   By: agent
+   16.10.26 Added -R and -C   By: agent
+   16.10.26 Added -i   By: agent
+   16.10.26 Added -S   By: agent
 */
 BOOL ParseCmdLine(int argc, char **argv, char *infile, char *outfile,
-                  char *radFile, BOOL *checkBB, REAL *tol)
+                  char *radFile, BOOL *checkBB, REAL *tol, int *nThreads,
+                  BOOL *doSummary, REAL *binWidth, char *tableFile,
+                  char *compileFile, char *chains1, char *chains2,
+                  BOOL *serverMode)
 {
    argc--;
    argv++;
 
-   infile[0] = outfile[0] = '\0';
+   infile[0] = outfile[0] = tableFile[0] = compileFile[0] = '\0';
+   chains1[0] = chains2[0] = '\0';
 
    while(argc)
    {
@@ -287,6 +2317,30 @@ BOOL ParseCmdLine(int argc, char **argv, char *infile, char *outfile,
                return(FALSE);
             strncpy(radFile, argv[0], MAXBUFF);
             break;
+         case 'R':
+            argc--;
+            argv++;
+            if(!argc)
+               return(FALSE);
+            strncpy(tableFile, argv[0], MAXBUFF);
+            break;
+         case 'C':
+            argc--;
+            argv++;
+            if(!argc)
+               return(FALSE);
+            strncpy(compileFile, argv[0], MAXBUFF);
+            break;
+         case 'i':
+            argc--;
+            argv++;
+            if(argc < 2)
+               return(FALSE);
+            strncpy(chains1, argv[0], MAXBUFF);
+            argc--;
+            argv++;
+            strncpy(chains2, argv[0], MAXBUFF);
+            break;
          case 't':
             argc--;
             argv++;
@@ -297,6 +2351,29 @@ BOOL ParseCmdLine(int argc, char **argv, char *infile, char *outfile,
          case 'b':
             *checkBB = TRUE;
             break;
+         case 'j':
+            argc--;
+            argv++;
+            if(!argc)
+               return(FALSE);
+            if((sscanf(argv[0], "%d", nThreads) != 1) || (*nThreads < 1))
+               return(FALSE);
+            break;
+         case 's':
+            *doSummary = TRUE;
+            break;
+         case 'S':
+            *serverMode = TRUE;
+            break;
+         case 'w':
+            argc--;
+            argv++;
+            if(!argc)
+               return(FALSE);
+            if((sscanf(argv[0], "%lf", binWidth) != 1) || 
+               (*binWidth <= (REAL)0.0))
+               return(FALSE);
+            break;
          case 'h':
          default:
             return(FALSE);
@@ -321,12 +2398,17 @@ BOOL ParseCmdLine(int argc, char **argv, char *infile, char *outfile,
                strcpy(outfile, argv[0]);
          }
             
-         return(TRUE);
+         break;
       }
       
       argc--;
       argv++;
    }
+
+   /* Server mode reads commands from stdin so needs a PDB file         */
+   if(*serverMode && !infile[0])
+      return(FALSE);
+   
    return(TRUE);
 }
 
@@ -338,14 +2420,51 @@ BOOL ParseCmdLine(int argc, char **argv, char *infile, char *outfile,
 */
 void Usage(void)
 {
-   printf("\npdbclash V1.0 (c) 2019 UCL, Andrew C.R. Martin\n");
-   printf("\nUsage: pdbclash [-b][-r radii.dat][-t x] [input.pdb \
+   printf("\npdbclash V1.6 (c) 2019 UCL, Andrew C.R. Martin\n");
+   printf("\nUsage: pdbclash [-b][-r radii.dat][-R radii.bin][-t x][-j n]\
+[-s [-w x]]\n");
+   printf("                [-i chains chains] [input.pdb \
 [output.txt]]\n");
+   printf("   or: pdbclash [-b][-r radii.dat][-R radii.bin][-t x]\
+[-i chains chains] -S\n");
+   printf("                input.pdb [output.txt]\n");
+   printf("   or: pdbclash [-r radii.dat] -C radii.bin\n");
    printf("         -b When skipping 'bad' contacts between adjacent \
 residues,\n");
    printf("            should we only skip bad contacts between \
 backbone atoms?\n");
+   printf("         -r Specify the radius file [%s]\n", DEF_RADFILE);
+   printf("         -R Use a radius table compiled with -C. The radius \
+file is\n");
+   printf("            only read if the table doesn't contain all the \
+atoms\n");
+   printf("         -C Compile the radius file into a binary table and \
+exit\n");
    printf("         -t Specify tolerence for allowed clashes [0.0]\n");
+   printf("         -i Only look for clashes between the two sets of \
+chains (each\n");
+   printf("            a comma-separated list of chain labels, e.g. \
+-i H,L A).\n");
+   printf("            With -S, all chain pairs across the interface \
+are checked\n");
+   printf("         -S Server mode. Reads commands from stdin:\n");
+   printf("               MOVE resspec atnam x y z - queue an atom \
+move\n");
+   printf("               UPDATE  - apply the moves and print clashes \
+that have\n");
+   printf("                         gone (-) or appeared (+) for the \
+moved residues\n");
+   printf("               CLASHES - print all clashes\n");
+   printf("               QUIT\n");
+   printf("            Each reply ends with a line starting OK or \
+ERROR\n");
+   printf("         -j Number of threads to use [1]\n");
+   printf("         -s Print a summary (histogram of clash overlaps and \
+clashes\n");
+   printf("            per chain and per residue) rather than every \
+clash\n");
+   printf("         -w Specify the bin width for the summary histogram \
+[%.1f]\n", DEF_BINWIDTH);
 
    printf("\nTakes a PDB file and looks for clashes between atoms \
 taking into account\n");
@@ -4,8 +4,8 @@
    Program:    saltbridge
    \file       saltbridge.c
    
-   \version    V0.1
-   \date       26.03.18   
+   \version    V0.5
+   \date       17.10.26   
    \brief      Identify salt bridges and, optionally, CA distance
    
    \copyright  (c) UCL / Dr. Andrew C. R. Martin 2018
@@ -36,16 +36,54 @@
 
    Description:
    ============
+   Finds salt bridges between the charged atoms of GLU/ASP and ARG/LYS
+   (and, optionally, HIS) side chains which are within 4.0A of one
+   another. For each bridge the distance between the closest charged
+   atoms and the distance between the C-alphas are reported:
+
+   SB: ARG  L61  NE   | ASP  L82  OD2  Dist: 2.727 CA: 10.197
 
 **************************************************************************
 
    Usage:
    ======
+   pdbsaltbridge [-H] [-s [-L]] [-m] [in.pdb [out.txt]]
+   -H Include histidines as bases
+   -s Only consider residues with a total accessibility of at least
+      50A^2 (probe radius 1.4A). Needs the radius file (radii.dat)
+      here or in $DATADIR
+   -L With -s, use the old full blCalcAccess() calculation
+   -m Read the MODELs of an ensemble or trajectory one at a time and
+      report how often each salt bridge is made:
+
+   FRAMES: 100
+   SB: ARG  L61  | ASP  L82  Occupancy: 0.870 (87) MeanDist: 3.104
+
+      Occupancy is the fraction (and number) of frames in which the
+      bridge is made and MeanDist its mean distance over those frames.
+      The first model defines the atoms; every model must match it.
+      With -s, accessibility is recalculated for each frame.
+
+   By default, -s uses a grid-based Shrake & Rupley calculation for
+   just the charged residues. The accessibilities differ slightly from
+   those of blCalcAccess() so residues close to the 50A^2 cut-off may
+   be kept or dropped differently and bridges can appear or disappear.
+   Use -L to reproduce the results of versions before V0.3.
 
 **************************************************************************
 
    Revision History:
    =================
+-  V0.1   26.03.18  Original
+-  V0.2   16.10.26  Uses a grid of charged atoms rather than testing all
+                    residue pairs
+-  V0.3   16.10.26  -s uses a grid-based Shrake & Rupley accessibility
+                    calculation for just the charged residues. -L gives
+                    the old full blCalcAccess() calculation
+-  V0.4   16.10.26  -m gives salt bridge occupancy over the models of an
+                    ensemble or trajectory
+-  V0.5   17.10.26  Filled in Usage(). The output file name was being
+                    copied over the input file name. Documented -m
 
 *************************************************************************/
 /* Includes
@@ -67,6 +105,54 @@
 #define SBDISTSQ   (REAL)16.0
 #define DATADIR    "DATADIR"
 #define DEF_RESRADFILE "radii.dat"
+#define SBCELLSIZE (REAL)4.0     /* sqrt(SBDISTSQ)                       */
+#define MAXCELLS   4000000
+#define PROBERADIUS (REAL)1.4
+#define NSPHEREPTS 256           /* Points per atom for accessibility    */
+#define NBRBLOCK   8             /* Occluding atoms tested together      */
+#define CELLINDEX(g, ix, iy, iz) ((ix) + (g)->nx * ((iy) + (g)->ny * (iz)))
+
+typedef struct
+{
+   PDB  *res,                    /* First atom of the residue            */
+        *atom;                   /* The charged atom                     */
+   int  resIndex,                /* Residue number in the linked list    */
+        sbRes;                   /* Index among the charged residues     */
+   BOOL acid;
+}  SBATOM;
+
+typedef struct
+{
+   PDB  *res,                    /* First atom of the residue            */
+        *atoms[MAXSBATOMS];      /* Its charged atoms                    */
+   int  nAtoms;
+}  SBRES;
+
+typedef struct
+{
+   PDB    **atoms;
+   int    *cellHead,             /* First atom in each cell (-1 if none) */
+          *atomNext,             /* Next atom in the same cell           */
+          *atomCell,
+          nAtoms,
+          nx, ny, nz;
+   REAL   xmin, ymin, zmin,
+          cellSize;
+}  ATOMGRID;
+
+typedef struct
+{
+   PDB *p, *q;                   /* First atoms of the two residues      */
+   int pIndex, qIndex,           /* Residue numbers in the linked list   */
+       pRes, qRes;               /* Indexes among the charged residues   */
+}  SBPAIR;
+
+typedef struct
+{
+   SBPAIR pair;
+   int    nFrames;               /* Frames in which the bridge is made   */
+   REAL   sumDist;               /* Sum of its length over those frames  */
+}  SBOCC;
 
 /************************************************************************/
 /* Globals
@@ -77,16 +163,37 @@
 */
 int main(int argc, char **argv);
 BOOL ParseCmdLine(int argc, char **argv, char *infile, char *outfile, 
-                  BOOL *doHis, BOOL *doSA);
+                  BOOL *doHis, BOOL *doSA, BOOL *oldAccess, 
+                  BOOL *doFrames);
 void Usage(void);
-void CalculateAndDisplaySaltbridges(FILE *out, PDB *pdb, BOOL doHis,
+BOOL CalculateAndDisplaySaltbridges(FILE *out, PDB *pdb, BOOL doHis,
                                     BOOL doSA);
+ATOMGRID *BuildAtomGrid(PDB **atoms, int nAtoms, REAL cellSize);
+void FreeAtomGrid(ATOMGRID *grid);
+SBATOM *FindChargedAtoms(PDB *pdb, BOOL doHis, int *nAtoms);
+SBPAIR *FindSBCandidates(ATOMGRID *grid, SBATOM *sbAtoms, int *nPairs);
+int CompareSBPairs(const void *a, const void *b);
+BOOL IsChargedResidue(PDB *p, BOOL doHis);
+BOOL CalcChargedAccess(PDB *pdb, BOOL doHis, REAL probe);
+REAL *MakeSpherePoints(int nPoints);
+REAL CalcAtomAccess(ATOMGRID *grid, int atom, REAL probe, REAL *points,
+                    int nPoints, REAL *nbrX, REAL *nbrY, REAL *nbrZ, 
+                    REAL *nbrRSq);
 BOOL PrintSaltBridge(FILE *out, PDB *p, PDB *q, BOOL doHis, BOOL doSA);
 int FindSBAtoms(PDB *p, PDB **atoms, int maxsbatoms);
 BOOL TestSBDistance(PDB **pAtoms, int NAtomsP, PDB **qAtoms, int NAtomsQ,
                     PDB **pAtom, PDB **qAtom, REAL *distance);
 REAL CalcCADistance(PDB *p, PDB *q);
 REAL SumSolv(PDB *start);
+FILE *OpenRadiusFile(char *resradFile);
+BOOL CalculateOccupancy(FILE *out, FILE *in, BOOL doHis, BOOL doSA,
+                        BOOL oldAccess, char *resradFile);
+PDB *ReadNextFrame(FILE *in, int *natoms, BOOL *error);
+BOOL CopyFrameCoords(PDB *pdb, PDB *frame);
+SBRES *ResolveSBResidues(SBATOM *sbAtoms, int nAtoms, int *nRes);
+BOOL AccumulateOccupancy(SBOCC **occ, int *nOcc, SBPAIR *pairs, 
+                         int nPairs, REAL *dists);
+void PrintOccupancy(FILE *out, SBOCC *occ, int nOcc, int nFrames);
 
 
 
@@ -99,38 +206,53 @@ int main(int argc, char **argv)
         *out = stdout;
    BOOL doHis = FALSE,
       doSA = FALSE,
-      noEnv = FALSE;
+      oldAccess = FALSE,
+      doFrames = FALSE;
    int  natoms;
    PDB  *pdb;
    char resradFile[MAXBUFF];
 
    strcpy(resradFile, DEF_RESRADFILE);
    
-   if(ParseCmdLine(argc, argv, inFile, outFile, &doHis, &doSA))
+   if(ParseCmdLine(argc, argv, inFile, outFile, &doHis, &doSA, 
+                   &oldAccess, &doFrames))
    {
       if(blOpenStdFiles(inFile, outFile, &in, &out))
       {
-         if((pdb=blReadPDB(in, &natoms))!=NULL)
+         if(doFrames)
+         {
+            if(!CalculateOccupancy(out, in, doHis, doSA, oldAccess,
+                                   resradFile))
+               return(1);
+         }
+         else if((pdb=blReadPDB(in, &natoms))!=NULL)
          {
             if(doSA)
             {
                FILE   *fpRad  = NULL;
 
-               if((fpRad = blOpenFile(resradFile, DATADIR, "r", &noEnv))==NULL)
-               {
-                  fprintf(stderr,"pdbsaltbridge: Unable to open residue radius file (%s)\n", resradFile);
-                  if(noEnv)
-                  {
-                     fprintf(stderr,"               Environment variable (%s) notg set\n", DATADIR);
-                  }
+               if((fpRad = OpenRadiusFile(resradFile))==NULL)
                   return(1);
-               }
                
                blSetAtomRadii(pdb, fpRad);
-               blCalcAccess(pdb, natoms, (REAL)0.0, (REAL)1.4, TRUE);
+               if(oldAccess)
+               {
+                  blCalcAccess(pdb, natoms, (REAL)0.0, PROBERADIUS, TRUE);
+               }
+               else if(!CalcChargedAccess(pdb, doHis, PROBERADIUS))
+               {
+                  fprintf(stderr,"pdbsaltbridge: Error - no memory for \
+accessibility calculation\n");
+                  return(1);
+               }
             }
 
-            CalculateAndDisplaySaltbridges(out, pdb, doHis, doSA);
+            if(!CalculateAndDisplaySaltbridges(out, pdb, doHis, doSA))
+            {
+               fprintf(stderr,"pdbsaltbridge: Error - no memory for \
+charged atom grid\n");
+               return(1);
+            }
          }
          else
          {
@@ -156,22 +278,1077 @@ output file\n");
 
 
 
-void CalculateAndDisplaySaltbridges(FILE *out, PDB *pdb, BOOL doHis,
+/************************************************************************/
+/*>BOOL CalculateAndDisplaySaltbridges(FILE *out, PDB *pdb, BOOL doHis,
+                                       BOOL doSA)
+   --------------------------------------------------------------------
+*//**
+   \param[in]     *out     Output file
+   \param[in]     *pdb     PDB linked list
+   \param[in]     doHis    Include histidines
+   \param[in]     doSA     Only keep accessible residues
+   \return                 Success (FALSE if out of memory)
+
+   Finds and prints the salt bridges. Rather than testing every pair of
+   residues, the charged atoms found by FindSBAtoms() are put in a grid
+   of SBCELLSIZE cells and only acid/base residue pairs with charged 
+   atoms within SBDISTSQ are passed to PrintSaltBridge(). These are 
+   sorted into the order in which the all-pairs scan found them, so the 
+   output is unchanged.
+
+-  26.03.18 Original    By: ACRM
+-  16.10.26 Uses a grid of charged atoms   By: agent
+*/
+BOOL CalculateAndDisplaySaltbridges(FILE *out, PDB *pdb, BOOL doHis,
                                     BOOL doSA)
 {
-   PDB *p, *pNextRes,
-       *q, *qNextRes;
+   ATOMGRID *grid;
+   SBATOM   *sbAtoms;
+   SBPAIR   *pairs;
+   PDB      **atoms;
+   int      nAtoms, nPairs, i;
+
+   if((sbAtoms = FindChargedAtoms(pdb, doHis, &nAtoms))==NULL)
+      return(nAtoms == 0);
+
+   /* Grid the charged atoms                                            */
+   if((atoms = (PDB **)malloc(nAtoms * sizeof(PDB *)))==NULL)
+   {
+      free(sbAtoms);
+      return(FALSE);
+   }
+   for(i=0; i<nAtoms; i++)
+      atoms[i] = sbAtoms[i].atom;
+   if((grid = BuildAtomGrid(atoms, nAtoms, SBCELLSIZE))==NULL)
+   {
+      free(sbAtoms);
+      return(FALSE);
+   }
+
+   pairs = FindSBCandidates(grid, sbAtoms, &nPairs);
+   FreeAtomGrid(grid);
+   free(sbAtoms);
+   if(nPairs < 0)
+      return(FALSE);
    
-   for(p=pdb; p!=NULL; p=pNextRes)
+   for(i=0; i<nPairs; i++)
    {
-      pNextRes = blFindNextResidue(p);
+      PrintSaltBridge(out, pairs[i].p, pairs[i].q, doHis, doSA);
+   }
+
+   if(pairs != NULL)
+      free(pairs);
+   return(TRUE);
+}
+
+
+/************************************************************************/
+/*>ATOMGRID *BuildAtomGrid(PDB **atoms, int nAtoms, REAL cellSize)
+   ---------------------------------------------------------------
+*//**
+   \param[in]     **atoms    Array of atoms (malloc()ed)
+   \param[in]     nAtoms     Number of atoms (>0)
+   \param[in]     cellSize   Minimum cell size
+   \return                   Grid (NULL if out of memory)
+
+   Bins an array of atoms into a grid of cubic cells. Atoms in the same
+   or neighbouring cells include all pairs closer than cellSize. The 
+   grid takes over the atoms array, which is freed with the grid (or 
+   here on failure). The cell size is increased if there would be more
+   than MAXCELLS cells.
+
+-  16.10.26 Original   By: agent
+*/
+ATOMGRID *BuildAtomGrid(PDB **atoms, int nAtoms, REAL cellSize)
+{
+   ATOMGRID *grid;
+   REAL     xmax, ymax, zmax;
+   int      nCells,
+            i;
+
+   if((grid = (ATOMGRID *)malloc(sizeof(ATOMGRID)))==NULL)
+   {
+      free(atoms);
+      return(NULL);
+   }
+   grid->atoms    = atoms;
+   grid->nAtoms   = nAtoms;
+   grid->cellHead = NULL;
+   grid->atomNext = NULL;
+   grid->atomCell = NULL;
+   
+   /* Find the bounding box                                             */
+   grid->xmin = xmax = atoms[0]->x;
+   grid->ymin = ymax = atoms[0]->y;
+   grid->zmin = zmax = atoms[0]->z;
+   for(i=1; i<nAtoms; i++)
+   {
+      if(atoms[i]->x < grid->xmin) grid->xmin = atoms[i]->x;
+      if(atoms[i]->y < grid->ymin) grid->ymin = atoms[i]->y;
+      if(atoms[i]->z < grid->zmin) grid->zmin = atoms[i]->z;
+      if(atoms[i]->x > xmax)       xmax       = atoms[i]->x;
+      if(atoms[i]->y > ymax)       ymax       = atoms[i]->y;
+      if(atoms[i]->z > zmax)       zmax       = atoms[i]->z;
+   }
+
+   /* Choose the grid dimensions                                        */
+   grid->cellSize = cellSize;
+   do
+   {
+      grid->nx = 1 + (int)((xmax - grid->xmin) / grid->cellSize);
+      grid->ny = 1 + (int)((ymax - grid->ymin) / grid->cellSize);
+      grid->nz = 1 + (int)((zmax - grid->zmin) / grid->cellSize);
+      if(((double)grid->nx * grid->ny * grid->nz) <= (double)MAXCELLS)
+         break;
+      grid->cellSize *= 2.0;
+   }  while(TRUE);
+   nCells = grid->nx * grid->ny * grid->nz;
+
+   if(((grid->cellHead = (int *)malloc(nCells * sizeof(int)))==NULL) ||
+      ((grid->atomNext = (int *)malloc(nAtoms * sizeof(int)))==NULL) ||
+      ((grid->atomCell = (int *)malloc(nAtoms * sizeof(int)))==NULL))
+   {
+      FreeAtomGrid(grid);
+      return(NULL);
+   }
+
+   /* Bin the atoms                                                     */
+   for(i=0; i<nCells; i++)
+      grid->cellHead[i] = -1;
+   for(i=0; i<nAtoms; i++)
+   {
+      int ix  = (int)((atoms[i]->x - grid->xmin) / grid->cellSize),
+          iy  = (int)((atoms[i]->y - grid->ymin) / grid->cellSize),
+          iz  = (int)((atoms[i]->z - grid->zmin) / grid->cellSize);
+      if(ix >= grid->nx) ix = grid->nx - 1;
+      if(iy >= grid->ny) iy = grid->ny - 1;
+      if(iz >= grid->nz) iz = grid->nz - 1;
+
+      grid->atomCell[i]                 = CELLINDEX(grid, ix, iy, iz);
+      grid->atomNext[i]                 = grid->cellHead[grid->atomCell[i]];
+      grid->cellHead[grid->atomCell[i]] = i;
+   }
+
+   return(grid);
+}
+
+
+/************************************************************************/
+/*>void FreeAtomGrid(ATOMGRID *grid)
+   ---------------------------------
+*//**
+   \param[in]     *grid    Grid to free
+
+-  16.10.26 Original   By: agent
+*/
+void FreeAtomGrid(ATOMGRID *grid)
+{
+   if(grid->atoms    != NULL) free(grid->atoms);
+   if(grid->cellHead != NULL) free(grid->cellHead);
+   if(grid->atomNext != NULL) free(grid->atomNext);
+   if(grid->atomCell != NULL) free(grid->atomCell);
+   free(grid);
+}
+
+
+/************************************************************************/
+/*>BOOL IsChargedResidue(PDB *p, BOOL doHis)
+   -----------------------------------------
+*//**
+   \param[in]     *p       Start of residue
+   \param[in]     doHis    Include histidines
+   \return                 Is it a residue that can form a salt bridge?
+
+-  16.10.26 Original   By: agent
+*/
+BOOL IsChargedResidue(PDB *p, BOOL doHis)
+{
+   if(!strncmp(p->resnam, "ASP", 3) ||
+      !strncmp(p->resnam, "GLU", 3) ||
+      !strncmp(p->resnam, "ARG", 3) ||
+      !strncmp(p->resnam, "LYS", 3) ||
+      (doHis && !strncmp(p->resnam, "HIS", 3)))
+      return(TRUE);
+   return(FALSE);
+}
+
+
+/************************************************************************/
+/*>SBATOM *FindChargedAtoms(PDB *pdb, BOOL doHis, int *nAtoms)
+   -----------------------------------------------------------
+*//**
+   \param[in]     *pdb     PDB linked list
+   \param[in]     doHis    Include histidines
+   \param[out]    *nAtoms  Number of charged atoms (-1 if out of memory)
+   \return                 Array of charged atoms (NULL if none)
+
+   Collects the charged atoms of ASP, GLU, ARG, LYS (and HIS if doHis)
+   using FindSBAtoms()
+
+-  16.10.26 Original   By: agent
+*/
+SBATOM *FindChargedAtoms(PDB *pdb, BOOL doHis, int *nAtoms)
+{
+   SBATOM *sbAtoms = NULL;
+   PDB    *p, *nextRes,
+          *resAtoms[MAXSBATOMS];
+   int    maxAtoms = 0,
+          resIndex,
+          sbRes = 0,
+          i, n;
+
+   *nAtoms = 0;
+   
+   for(p=pdb, resIndex=0; p!=NULL; p=nextRes, resIndex++)
+   {
+      BOOL acid = (!strncmp(p->resnam, "ASP", 3) ||
+                   !strncmp(p->resnam, "GLU", 3));
       
-      for(q=pNextRes; q!=NULL; q=qNextRes)
+      nextRes = blFindNextResidue(p);
+      if(!IsChargedResidue(p, doHis))
+         continue;
+
+      n = FindSBAtoms(p, resAtoms, MAXSBATOMS);
+      if(n && (*nAtoms > 0) && (sbAtoms[*nAtoms-1].sbRes == sbRes))
+         sbRes++;
+      for(i=0; i<n; i++)
+      {
+         SBATOM *a;
+         
+         if(resAtoms[i] == NULL)
+            continue;
+
+         if(*nAtoms >= maxAtoms)
+         {
+            SBATOM *newAtoms;
+            maxAtoms = (maxAtoms) ? (2 * maxAtoms) : 256;
+            if((newAtoms = (SBATOM *)realloc(sbAtoms, 
+                                             maxAtoms * sizeof(SBATOM)))
+               == NULL)
+            {
+               free(sbAtoms);
+               *nAtoms = -1;
+               return(NULL);
+            }
+            sbAtoms = newAtoms;
+         }
+
+         a           = &(sbAtoms[(*nAtoms)++]);
+         a->res      = p;
+         a->atom     = resAtoms[i];
+         a->resIndex = resIndex;
+         a->sbRes    = sbRes;
+         a->acid     = acid;
+      }
+   }
+
+   return(sbAtoms);
+}
+
+
+/************************************************************************/
+/*>SBPAIR *FindSBCandidates(ATOMGRID *grid, SBATOM *sbAtoms, int *nPairs)
+   ----------------------------------------------------------------------
+*//**
+   \param[in]     *grid     Grid of charged atoms
+   \param[in]     *sbAtoms  The charged atoms in grid order
+   \param[out]    *nPairs   Number of residue pairs (-1 if out of memory)
+   \return                  Residue pairs (NULL if none)
+
+   Finds acid/base residue pairs which have charged atoms within
+   SBDISTSQ of each other by looking in neighbouring grid cells. The
+   pairs are returned in linked list order with the earlier residue 
+   first, and each pair appears once.
+
+-  16.10.26 Original   By: agent
+*/
+SBPAIR *FindSBCandidates(ATOMGRID *grid, SBATOM *sbAtoms, int *nPairs)
+{
+   SBPAIR *pairs = NULL;
+   int    maxPairs = 0,
+          i, n;
+
+   *nPairs = 0;
+   
+   for(i=0; i<grid->nAtoms; i++)
+   {
+      SBATOM *a    = &(sbAtoms[i]);
+      int    cell  = grid->atomCell[i],
+             ix    = cell % grid->nx,
+             iy    = (cell / grid->nx) % grid->ny,
+             iz    = cell / (grid->nx * grid->ny),
+             jx, jy, jz, j;
+
+      /* Look from the acid atoms only so each pair is found once       */
+      if(!a->acid)
+         continue;
+
+      for(jx=MAX(ix-1, 0); jx<=MIN(ix+1, grid->nx-1); jx++)
       {
-         qNextRes = blFindNextResidue(q);
-         PrintSaltBridge(out, p, q, doHis, doSA);
+         for(jy=MAX(iy-1, 0); jy<=MIN(iy+1, grid->ny-1); jy++)
+         {
+            for(jz=MAX(iz-1, 0); jz<=MIN(iz+1, grid->nz-1); jz++)
+            {
+               for(j=grid->cellHead[CELLINDEX(grid, jx, jy, jz)];
+                   j>=0;
+                   j=grid->atomNext[j])
+               {
+                  SBATOM *b = &(sbAtoms[j]);
+                  SBPAIR *pair;
+                  
+                  if(b->acid || (DISTSQ(a->atom, b->atom) > SBDISTSQ))
+                     continue;
+
+                  if(*nPairs >= maxPairs)
+                  {
+                     SBPAIR *newPairs;
+                     maxPairs = (maxPairs) ? (2 * maxPairs) : 256;
+                     if((newPairs = (SBPAIR *)
+                         realloc(pairs, maxPairs * sizeof(SBPAIR)))==NULL)
+                     {
+                        if(pairs != NULL)
+                           free(pairs);
+                        *nPairs = -1;
+                        return(NULL);
+                     }
+                     pairs = newPairs;
+                  }
+
+                  pair = &(pairs[(*nPairs)++]);
+                  if(a->resIndex < b->resIndex)
+                  {
+                     pair->p      = a->res;
+                     pair->pIndex = a->resIndex;
+                     pair->pRes   = a->sbRes;
+                     pair->q      = b->res;
+                     pair->qIndex = b->resIndex;
+                     pair->qRes   = b->sbRes;
+                  }
+                  else
+                  {
+                     pair->p      = b->res;
+                     pair->pIndex = b->resIndex;
+                     pair->pRes   = b->sbRes;
+                     pair->q      = a->res;
+                     pair->qIndex = a->resIndex;
+                     pair->qRes   = a->sbRes;
+                  }
+               }
+            }
+         }
       }
    }
+
+   /* Sort into residue order and remove duplicates                     */
+   qsort(pairs, *nPairs, sizeof(SBPAIR), CompareSBPairs);
+   for(i=0, n=0; i<*nPairs; i++)
+   {
+      if((n == 0) || CompareSBPairs(&(pairs[n-1]), &(pairs[i])))
+         pairs[n++] = pairs[i];
+   }
+   *nPairs = n;
+   
+   return(pairs);
+}
+
+
+/************************************************************************/
+/*>int CompareSBPairs(const void *a, const void *b)
+   ------------------------------------------------
+*//**
+   qsort() comparison function to sort residue pairs by first then 
+   second residue
+
+-  16.10.26 Original   By: agent
+*/
+int CompareSBPairs(const void *a, const void *b)
+{
+   const SBPAIR *p1 = (const SBPAIR *)a,
+                *p2 = (const SBPAIR *)b;
+
+   if(p1->pIndex != p2->pIndex)
+      return((p1->pIndex < p2->pIndex) ? -1 : 1);
+   if(p1->qIndex != p2->qIndex)
+      return((p1->qIndex < p2->qIndex) ? -1 : 1);
+   return(0);
+}
+
+
+/************************************************************************/
+/*>BOOL CalcChargedAccess(PDB *pdb, BOOL doHis, REAL probe)
+   --------------------------------------------------------
+*//**
+   \param[in,out] *pdb     PDB linked list with radii set. The access
+                           field is set.
+   \param[in]     doHis    Include histidines
+   \param[in]     probe    Probe radius
+   \return                 Success (FALSE if out of memory)
+
+   A Shrake & Rupley accessibility calculation used instead of 
+   blCalcAccess() for the -s filter. Only SumSolv() of the charged 
+   residues is ever needed, so accessibility is only calculated for the
+   atoms of those residues; all other atoms are given zero. Every atom 
+   can still occlude. A grid with cells of twice the largest expanded 
+   radius gives the atoms that can occlude each atom.
+
+-  16.10.26 Original   By: agent
+*/
+BOOL CalcChargedAccess(PDB *pdb, BOOL doHis, REAL probe)
+{
+   ATOMGRID *grid;
+   PDB      *p, *nextRes,
+            **atoms;
+   REAL     *points,
+            *nbrX, *nbrY, *nbrZ, *nbrRSq,
+            maxRad = (REAL)0.0;
+   int      nAtoms = 0,
+            i;
+
+   for(p=pdb; p!=NULL; NEXT(p))
+   {
+      p->access = (REAL)0.0;
+      if(p->radius > maxRad)
+         maxRad = p->radius;
+      nAtoms++;
+   }
+   if(nAtoms == 0)
+      return(TRUE);
+
+   if((atoms = (PDB **)malloc(nAtoms * sizeof(PDB *)))==NULL)
+      return(FALSE);
+   for(p=pdb, i=0; p!=NULL; NEXT(p))
+      atoms[i++] = p;
+   if((grid = BuildAtomGrid(atoms, nAtoms, 2.0 * (maxRad + probe)))==NULL)
+      return(FALSE);
+
+   /* Neighbour lists are padded to a multiple of NBRBLOCK              */
+   nbrX   = (REAL *)malloc((nAtoms + NBRBLOCK) * sizeof(REAL));
+   nbrY   = (REAL *)malloc((nAtoms + NBRBLOCK) * sizeof(REAL));
+   nbrZ   = (REAL *)malloc((nAtoms + NBRBLOCK) * sizeof(REAL));
+   nbrRSq = (REAL *)malloc((nAtoms + NBRBLOCK) * sizeof(REAL));
+   points = MakeSpherePoints(NSPHEREPTS);
+
+   if((nbrX != NULL) && (nbrY != NULL) && (nbrZ != NULL) &&
+      (nbrRSq != NULL) && (points != NULL))
+   {
+      /* Step through the residues, doing the charged ones              */
+      for(p=pdb, i=0; p!=NULL; p=nextRes)
+      {
+         BOOL charged = IsChargedResidue(p, doHis);
+         
+         nextRes = blFindNextResidue(p);
+         for(; p!=nextRes; NEXT(p), i++)
+         {
+            if(charged)
+               p->access = CalcAtomAccess(grid, i, probe, 
+                                          points, NSPHEREPTS,
+                                          nbrX, nbrY, nbrZ, nbrRSq);
+         }
+      }
+   }
+   else
+   {
+      nAtoms = 0;                /* Flags the error                      */
+   }
+
+   if(nbrX   != NULL) free(nbrX);
+   if(nbrY   != NULL) free(nbrY);
+   if(nbrZ   != NULL) free(nbrZ);
+   if(nbrRSq != NULL) free(nbrRSq);
+   if(points != NULL) free(points);
+   FreeAtomGrid(grid);
+   
+   return(nAtoms != 0);
+}
+
+
+/************************************************************************/
+/*>REAL *MakeSpherePoints(int nPoints)
+   -----------------------------------
+*//**
+   \param[in]     nPoints  Number of points
+   \return                 x,y,z triplets (NULL if out of memory)
+
+   Places points evenly over a unit sphere using a golden section 
+   spiral.
+
+-  16.10.26 Original   By: agent
+*/
+REAL *MakeSpherePoints(int nPoints)
+{
+   REAL *points;
+   REAL goldenAngle = PI * (3.0 - sqrt(5.0));
+   int  i;
+   
+   if((points = (REAL *)malloc(3 * nPoints * sizeof(REAL)))==NULL)
+      return(NULL);
+
+   for(i=0; i<nPoints; i++)
+   {
+      REAL z   = 1.0 - (2.0 * i + 1.0) / nPoints,
+           r   = sqrt(1.0 - z*z),
+           phi = goldenAngle * i;
+      
+      points[3*i]   = r * cos(phi);
+      points[3*i+1] = r * sin(phi);
+      points[3*i+2] = z;
+   }
+   return(points);
+}
+
+
+/************************************************************************/
+/*>REAL CalcAtomAccess(ATOMGRID *grid, int atom, REAL probe, 
+                       REAL *points, int nPoints, REAL *nbrX, 
+                       REAL *nbrY, REAL *nbrZ, REAL *nbrRSq)
+   ---------------------------------------------------------------
+*//**
+   \param[in]     *grid     Grid of all atoms
+   \param[in]     atom      Index of the atom
+   \param[in]     probe     Probe radius
+   \param[in]     *points   Unit sphere points from MakeSpherePoints()
+   \param[in]     nPoints   Number of sphere points
+   \param[out]    *nbrX     Workspace for the neighbour list (nAtoms +
+   \param[out]    *nbrY       NBRBLOCK long)
+   \param[out]    *nbrZ
+   \param[out]    *nbrRSq
+   \return                  Accessibility
+
+   Finds the atoms whose expanded spheres overlap that of this atom and
+   stores their positions, relative to this atom, and squared expanded 
+   radii. Each sphere point is then tested against the neighbours 
+   NBRBLOCK at a time with no branches inside a block so the compiler 
+   can vectorise the test; a point stops being tested once a block 
+   buries it, and the block that buried the last point is tried first 
+   since neighbouring points are usually buried by the same atoms.
+
+-  16.10.26 Original   By: agent
+*/
+REAL CalcAtomAccess(ATOMGRID *grid, int atom, REAL probe, REAL *points,
+                    int nPoints, REAL *nbrX, REAL *nbrY, REAL *nbrZ, 
+                    REAL *nbrRSq)
+{
+   PDB  *p     = grid->atoms[atom];
+   REAL rad    = p->radius + probe;
+   int  cell   = grid->atomCell[atom],
+        ix     = cell % grid->nx,
+        iy     = (cell / grid->nx) % grid->ny,
+        iz     = cell / (grid->nx * grid->ny),
+        nNbr   = 0,
+        nExposed = 0,
+        lastBlock = 0,
+        jx, jy, jz, j, k;
+
+   /* Build the neighbour list                                          */
+   for(jx=MAX(ix-1, 0); jx<=MIN(ix+1, grid->nx-1); jx++)
+   {
+      for(jy=MAX(iy-1, 0); jy<=MIN(iy+1, grid->ny-1); jy++)
+      {
+         for(jz=MAX(iz-1, 0); jz<=MIN(iz+1, grid->nz-1); jz++)
+         {
+            for(j=grid->cellHead[CELLINDEX(grid, jx, jy, jz)];
+                j>=0;
+                j=grid->atomNext[j])
+            {
+               PDB  *q    = grid->atoms[j];
+               REAL qRad  = q->radius + probe,
+                    reach = rad + qRad;
+               
+               if((j != atom) && (DISTSQ(p, q) < reach * reach))
+               {
+                  nbrX[nNbr]   = q->x - p->x;
+                  nbrY[nNbr]   = q->y - p->y;
+                  nbrZ[nNbr]   = q->z - p->z;
+                  nbrRSq[nNbr] = qRad * qRad;
+                  nNbr++;
+               }
+            }
+         }
+      }
+   }
+
+   /* Pad to a whole block with neighbours that can't bury anything     */
+   while(nNbr % NBRBLOCK)
+   {
+      nbrX[nNbr] = nbrY[nNbr] = nbrZ[nNbr] = (REAL)0.0;
+      nbrRSq[nNbr] = (REAL)(-1.0);
+      nNbr++;
+   }
+
+   /* Test each sphere point                                            */
+   for(k=0; k<nPoints; k++)
+   {
+      REAL px     = rad * points[3*k],
+           py     = rad * points[3*k+1],
+           pz     = rad * points[3*k+2];
+      BOOL buried = FALSE;
+      int  tries,
+           block;
+
+      for(tries=0, block=lastBlock; 
+          (tries < nNbr) && !buried; 
+          tries+=NBRBLOCK)
+      {
+         int  inside = 0,
+              m;
+         
+         for(m=block; m<block+NBRBLOCK; m++)
+         {
+            REAL dx = px - nbrX[m],
+                 dy = py - nbrY[m],
+                 dz = pz - nbrZ[m];
+            inside |= ((dx*dx + dy*dy + dz*dz) < nbrRSq[m]);
+         }
+         
+         if(inside)
+         {
+            buried    = TRUE;
+            lastBlock = block;
+         }
+         else
+         {
+            block += NBRBLOCK;
+            if(block >= nNbr)
+               block = 0;
+         }
+      }
+
+      if(!buried)
+         nExposed++;
+   }
+
+   return((4.0 * PI * rad * rad * nExposed) / nPoints);
+}
+
+
+/************************************************************************/
+/*>FILE *OpenRadiusFile(char *resradFile)
+   --------------------------------------
+*//**
+   \param[in]     *resradFile   Radius file name
+   \return                      File pointer (NULL on failure)
+
+   Opens the radius file, looking in DATADIR if it isn't found here, and
+   reports any error
+
+-  16.10.26 Original   By: agent
+*/
+FILE *OpenRadiusFile(char *resradFile)
+{
+   FILE *fpRad;
+   BOOL noEnv = FALSE;
+   
+   if((fpRad = blOpenFile(resradFile, DATADIR, "r", &noEnv))==NULL)
+   {
+      fprintf(stderr,"pdbsaltbridge: Unable to open residue radius file (%s)\n", resradFile);
+      if(noEnv)
+      {
+         fprintf(stderr,"               Environment variable (%s) notg set\n", DATADIR);
+      }
+   }
+   return(fpRad);
+}
+
+
+/************************************************************************/
+/*>BOOL CalculateOccupancy(FILE *out, FILE *in, BOOL doHis, BOOL doSA,
+                           BOOL oldAccess, char *resradFile)
+   -------------------------------------------------------------------
+*//**
+   \param[in]     *out          Output file
+   \param[in]     *in           Input multi-MODEL PDB file
+   \param[in]     doHis         Include histidines
+   \param[in]     doSA          Only keep accessible residues
+   \param[in]     oldAccess     Use blCalcAccess() for accessibility
+   \param[in]     *resradFile   Radius file for accessibility
+   \return                      Success (errors are reported here)
+
+   Salt bridge occupancy over an NMR ensemble or MD trajectory. The
+   models are read one at a time. The first defines the topology: its 
+   charged atoms are found with FindSBAtoms() just once and later 
+   frames only supply new coordinates. For each frame the salt bridges
+   are found as in CalculateAndDisplaySaltbridges() and counted against
+   their residue pair, so only the first frame, the current frame and
+   the pairs seen so far are held in memory.
+
+-  16.10.26 Original   By: agent
+*/
+BOOL CalculateOccupancy(FILE *out, FILE *in, BOOL doHis, BOOL doSA,
+                        BOOL oldAccess, char *resradFile)
+{
+   PDB      *pdb, *frame,
+            **atoms;
+   SBATOM   *sbAtoms;
+   SBRES    *sbRes    = NULL;
+   SBOCC    *occ      = NULL;
+   SBPAIR   *pairs;
+   ATOMGRID *grid;
+   REAL     *dists    = NULL;
+   BOOL     error     = FALSE;
+   int      natoms, nAtoms, nRes, nOcc = 0, nPairs, nFrames, i;
+
+   if((pdb = ReadNextFrame(in, &natoms, &error))==NULL)
+   {
+      if(!error)
+         fprintf(stderr,"pdbsaltbridge: Error - no atoms read from PDB \
+file\n");
+      else
+         fprintf(stderr,"pdbsaltbridge: Error - no memory for frame\n");
+      return(FALSE);
+   }
+
+   if(doSA)
+   {
+      FILE *fpRad;
+      
+      if((fpRad = OpenRadiusFile(resradFile))==NULL)
+         return(FALSE);
+      blSetAtomRadii(pdb, fpRad);
+      fclose(fpRad);
+   }
+
+   /* Resolve the charged atoms once                                    */
+   sbAtoms = FindChargedAtoms(pdb, doHis, &nAtoms);
+   if(nAtoms > 0)
+   {
+      if((sbRes = ResolveSBResidues(sbAtoms, nAtoms, &nRes))==NULL)
+         nAtoms = -1;
+   }
+   if(nAtoms < 0)
+   {
+      fprintf(stderr,"pdbsaltbridge: Error - no memory for charged atoms\n");
+      return(FALSE);
+   }
+   
+   for(nFrames=1; ; nFrames++)
+   {
+      if(nAtoms > 0)
+      {
+         if(doSA)
+         {
+            if(oldAccess)
+            {
+               blCalcAccess(pdb, natoms, (REAL)0.0, PROBERADIUS, TRUE);
+            }
+            else if(!CalcChargedAccess(pdb, doHis, PROBERADIUS))
+            {
+               error = TRUE;
+               break;
+            }
+         }
+
+         if((atoms = (PDB **)malloc(nAtoms * sizeof(PDB *)))==NULL)
+         {
+            error = TRUE;
+            break;
+         }
+         for(i=0; i<nAtoms; i++)
+            atoms[i] = sbAtoms[i].atom;
+         if((grid = BuildAtomGrid(atoms, nAtoms, SBCELLSIZE))==NULL)
+         {
+            error = TRUE;
+            break;
+         }
+         pairs = FindSBCandidates(grid, sbAtoms, &nPairs);
+         FreeAtomGrid(grid);
+         if((nPairs < 0) ||
+            ((nPairs > 0) &&
+             ((dists = (REAL *)malloc(nPairs * sizeof(REAL)))==NULL)))
+         {
+            error = TRUE;
+            break;
+         }
+
+         /* Test the candidates as PrintSaltBridge() does, using the
+            charged atoms found for the first frame
+         */
+         for(i=0; i<nPairs; i++)
+         {
+            SBRES *p = &(sbRes[pairs[i].pRes]),
+                  *q = &(sbRes[pairs[i].qRes]);
+            PDB   *pAtom, *qAtom;
+            
+            dists[i] = (REAL)(-1.0);
+            if(doSA && ((SumSolv(p->res) < (REAL)50.0) ||
+                        (SumSolv(q->res) < (REAL)50.0)))
+               continue;
+            TestSBDistance(p->atoms, p->nAtoms, q->atoms, q->nAtoms,
+                           &pAtom, &qAtom, &(dists[i]));
+         }
+
+         if(!AccumulateOccupancy(&occ, &nOcc, pairs, nPairs, dists))
+            error = TRUE;
+         if(pairs != NULL)
+         {
+            free(pairs);
+            free(dists);
+         }
+         if(error)
+            break;
+      }
+
+      /* Move on to the next frame                                      */
+      if((frame = ReadNextFrame(in, &i, &error))==NULL)
+         break;
+      if(!CopyFrameCoords(pdb, frame))
+      {
+         fprintf(stderr,"pdbsaltbridge: Error - atoms in frame %d do not \
+match the first frame\n", nFrames+1);
+         FREELIST(frame, PDB);
+         return(FALSE);
+      }
+      FREELIST(frame, PDB);
+   }
+
+   if(error)
+   {
+      fprintf(stderr,"pdbsaltbridge: Error - no memory for frame %d\n",
+              nFrames);
+      return(FALSE);
+   }
+
+   PrintOccupancy(out, occ, nOcc, nFrames);
+
+   if(sbAtoms != NULL) free(sbAtoms);
+   if(sbRes   != NULL) free(sbRes);
+   if(occ     != NULL) free(occ);
+   FREELIST(pdb, PDB);
+   return(TRUE);
+}
+
+
+/************************************************************************/
+/*>PDB *ReadNextFrame(FILE *in, int *natoms, BOOL *error)
+   ------------------------------------------------------
+*//**
+   \param[in]     *in       Input PDB file
+   \param[out]    *natoms   Number of atoms read
+   \param[out]    *error    Set if out of memory
+   \return                  PDB linked list (NULL at end of file)
+
+   Reads the coordinate records of the next MODEL (up to ENDMDL) through
+   a temporary file into a PDB linked list. A file without MODEL records
+   is a single frame.
+
+-  16.10.26 Original   By: agent
+*/
+PDB *ReadNextFrame(FILE *in, int *natoms, BOOL *error)
+{
+   FILE *fp;
+   PDB  *frame = NULL;
+   char buffer[MAXBUFF];
+   BOOL gotAtoms = FALSE;
+   
+   *natoms = 0;
+   if((fp = tmpfile())==NULL)
+   {
+      *error = TRUE;
+      return(NULL);
+   }
+   
+   while(fgets(buffer, MAXBUFF, in))
+   {
+      if(!strncmp(buffer, "ATOM  ", 6) || !strncmp(buffer, "HETATM", 6))
+      {
+         fputs(buffer, fp);
+         gotAtoms = TRUE;
+      }
+      else if(!strncmp(buffer, "ENDMDL", 6) && gotAtoms)
+      {
+         break;
+      }
+   }
+
+   if(gotAtoms)
+   {
+      rewind(fp);
+      if((frame = blReadPDB(fp, natoms))==NULL)
+         *error = TRUE;
+   }
+   fclose(fp);
+   
+   return(frame);
+}
+
+
+/************************************************************************/
+/*>BOOL CopyFrameCoords(PDB *pdb, PDB *frame)
+   ------------------------------------------
+*//**
+   \param[in,out] *pdb      Topology (first frame) linked list
+   \param[in]     *frame    New frame
+   \return                  Do the atoms match?
+
+   Copies the coordinates of a frame into the first frame, checking
+   that the atoms are the same
+
+-  16.10.26 Original   By: agent
+*/
+BOOL CopyFrameCoords(PDB *pdb, PDB *frame)
+{
+   PDB *p, *q;
+   
+   for(p=pdb, q=frame; (p!=NULL) && (q!=NULL); NEXT(p), NEXT(q))
+   {
+      if((p->resnum != q->resnum) || strcmp(p->atnam, q->atnam))
+         return(FALSE);
+      p->x = q->x;
+      p->y = q->y;
+      p->z = q->z;
+   }
+   
+   return((p == NULL) && (q == NULL));
+}
+
+
+/************************************************************************/
+/*>SBRES *ResolveSBResidues(SBATOM *sbAtoms, int nAtoms, int *nRes)
+   ----------------------------------------------------------------
+*//**
+   \param[in]     *sbAtoms  Charged atoms from FindChargedAtoms()
+   \param[in]     nAtoms    Number of charged atoms
+   \param[out]    *nRes     Number of charged residues
+   \return                  Charged residues, indexed by sbAtoms[].sbRes
+                            (NULL if out of memory)
+
+   Groups the charged atoms by residue
+
+-  16.10.26 Original   By: agent
+*/
+SBRES *ResolveSBResidues(SBATOM *sbAtoms, int nAtoms, int *nRes)
+{
+   SBRES *sbRes;
+   int   i;
+
+   *nRes = sbAtoms[nAtoms-1].sbRes + 1;
+   if((sbRes = (SBRES *)malloc(*nRes * sizeof(SBRES)))==NULL)
+      return(NULL);
+   for(i=0; i<*nRes; i++)
+      sbRes[i].nAtoms = 0;
+
+   for(i=0; i<nAtoms; i++)
+   {
+      SBRES *r = &(sbRes[sbAtoms[i].sbRes]);
+      r->res                 = sbAtoms[i].res;
+      r->atoms[r->nAtoms++]  = sbAtoms[i].atom;
+   }
+   
+   return(sbRes);
+}
+
+
+/************************************************************************/
+/*>BOOL AccumulateOccupancy(SBOCC **occ, int *nOcc, SBPAIR *pairs, 
+                            int nPairs, REAL *dists)
+   ---------------------------------------------------------------
+*//**
+   \param[in,out] **occ     Occupancy counts, sorted by residue pair
+   \param[in,out] *nOcc     Number of residue pairs in occ
+   \param[in]     *pairs    Sorted candidate pairs for this frame
+   \param[in]     nPairs    Number of candidate pairs
+   \param[in]     *dists    Salt bridge length for each candidate 
+                            (<= 0 if not made)
+   \return                  Success (FALSE if out of memory)
+
+   Merges the salt bridges made in this frame into the occupancy counts.
+   Both lists are in CompareSBPairs() order so this is a single merge.
+
+-  16.10.26 Original   By: agent
+*/
+BOOL AccumulateOccupancy(SBOCC **occ, int *nOcc, SBPAIR *pairs, 
+                         int nPairs, REAL *dists)
+{
+   SBOCC *merged;
+   int   i, j, n;
+
+   if(nPairs == 0)
+      return(TRUE);
+   if((merged = (SBOCC *)malloc((*nOcc + nPairs) * sizeof(SBOCC)))==NULL)
+      return(FALSE);
+
+   for(i=0, j=0, n=0; (i < *nOcc) || (j < nPairs); )
+   {
+      int cmp;
+      
+      if(i >= *nOcc)
+         cmp = 1;
+      else if(j >= nPairs)
+         cmp = -1;
+      else
+         cmp = CompareSBPairs(&((*occ)[i].pair), &(pairs[j]));
+
+      if(cmp < 0)
+      {
+         merged[n++] = (*occ)[i++];
+      }
+      else
+      {
+         if(cmp > 0)
+         {
+            if(dists[j] <= (REAL)0.0)
+            {
+               j++;
+               continue;
+            }
+            merged[n].pair    = pairs[j];
+            merged[n].nFrames = 0;
+            merged[n].sumDist = (REAL)0.0;
+         }
+         else
+         {
+            merged[n] = (*occ)[i++];
+         }
+         
+         if(dists[j] > (REAL)0.0)
+         {
+            merged[n].nFrames++;
+            merged[n].sumDist += dists[j];
+         }
+         n++;
+         j++;
+      }
+   }
+
+   if(*occ != NULL)
+      free(*occ);
+   *occ  = merged;
+   *nOcc = n;
+   return(TRUE);
+}
+
+
+/************************************************************************/
+/*>void PrintOccupancy(FILE *out, SBOCC *occ, int nOcc, int nFrames)
+   -----------------------------------------------------------------
+*//**
+   \param[in]     *out      Output file
+   \param[in]     *occ      Occupancy counts
+   \param[in]     nOcc      Number of residue pairs
+   \param[in]     nFrames   Number of frames
+
+   Prints the fraction of frames in which each salt bridge is made and
+   its mean length over those frames
+
+-  16.10.26 Original   By: agent
+*/
+void PrintOccupancy(FILE *out, SBOCC *occ, int nOcc, int nFrames)
+{
+   int i;
+
+   fprintf(out, "FRAMES: %d\n", nFrames);
+   for(i=0; i<nOcc; i++)
+   {
+      PDB *p = occ[i].pair.p,
+          *q = occ[i].pair.q;
+      
+      fprintf(out,
+              "SB: %s %s%d%s | %s %s%d%s Occupancy: %.3f (%d) \
+MeanDist: %.3f\n",
+              p->resnam, p->chain, p->resnum, p->insert,
+              q->resnam, q->chain, q->resnum, q->insert,
+              (REAL)occ[i].nFrames / nFrames, occ[i].nFrames,
+              occ[i].sumDist / occ[i].nFrames);
+   }
 }
 
 
@@ -426,7 +1603,8 @@ BOOL TestSBDistance(PDB **pAtoms, int NAtomsP, PDB **qAtoms, int NAtomsQ,
 -  27.02.14 V2.0
 */
 BOOL ParseCmdLine(int argc, char **argv, char *infile, char *outfile, 
-                  BOOL *doHis, BOOL *doSA)
+                  BOOL *doHis, BOOL *doSA, BOOL *oldAccess, 
+                  BOOL *doFrames)
 {
    argc--;
    argv++;
@@ -445,6 +1623,12 @@ BOOL ParseCmdLine(int argc, char **argv, char *infile, char *outfile,
          case 's':
             *doSA = TRUE;
             break;
+         case 'L':
+            *oldAccess = TRUE;
+            break;
+         case 'm':
+            *doFrames = TRUE;
+            break;
          default:
             return(FALSE);
             break;
@@ -464,9 +1648,10 @@ BOOL ParseCmdLine(int argc, char **argv, char *infile, char *outfile,
          }
          
          /* Copy the second to outfile                                  */
+         argv++;
          if(argc)
          {
-            strcpy(infile, argv[0]);
+            strcpy(outfile, argv[0]);
             argc--;
          }
          
@@ -481,6 +1666,58 @@ BOOL ParseCmdLine(int argc, char **argv, char *infile, char *outfile,
 
 void Usage(void)
 {
+   fprintf(stderr,"\npdbsaltbridge V0.5 (c) 2018-2026 UCL, Dr. Andrew \
+C.R. Martin\n");
+
+   fprintf(stderr,"\nUsage: pdbsaltbridge [-H] [-s [-L]] [-m] \
+[in.pdb [out.txt]]\n");
+   fprintf(stderr,"       -H Include histidines as bases\n");
+   fprintf(stderr,"       -s Only consider residues with a total \
+accessibility of at least\n");
+   fprintf(stderr,"          50A^2 (probe radius 1.4A). Needs the \
+radius file (%s)\n", DEF_RESRADFILE);
+   fprintf(stderr,"          here or in $%s\n", DATADIR);
+   fprintf(stderr,"       -L With -s, use the old full blCalcAccess() \
+calculation\n");
+   fprintf(stderr,"       -m Report salt bridge occupancy over the \
+MODELs of an ensemble\n");
+   fprintf(stderr,"          or trajectory\n");
+
+   fprintf(stderr,"\nFinds salt bridges between GLU/ASP and ARG/LYS \
+(and, with -H, HIS)\n");
+   fprintf(stderr,"side chains whose charged atoms are within 4.0A. \
+Each bridge is\n");
+   fprintf(stderr,"written as:\n");
+   fprintf(stderr,"   SB: resnam chain resnum atnam | resnam chain \
+resnum atnam Dist: d CA: d\n");
+   fprintf(stderr,"where Dist is the distance between the charged \
+atoms and CA the\n");
+   fprintf(stderr,"distance between the C-alphas.\n");
+
+   fprintf(stderr,"\nWith -m, the models are read one at a time. The \
+first defines the\n");
+   fprintf(stderr,"atoms and every other model must match it. The \
+output is:\n");
+   fprintf(stderr,"   FRAMES: n\n");
+   fprintf(stderr,"   SB: resnam chain resnum | resnam chain resnum \
+Occupancy: f (c) MeanDist: d\n");
+   fprintf(stderr,"where f is the fraction of frames in which the \
+bridge is made, c the\n");
+   fprintf(stderr,"number of those frames and d the mean distance \
+between the charged\n");
+   fprintf(stderr,"atoms over them.\n");
+
+   fprintf(stderr,"\nBy default, -s uses a grid-based Shrake & Rupley \
+calculation for just\n");
+   fprintf(stderr,"the charged residues. The accessibilities differ \
+slightly from those of\n");
+   fprintf(stderr,"blCalcAccess() so residues close to the 50A^2 \
+cut-off may be kept or\n");
+   fprintf(stderr,"dropped differently and bridges can appear or \
+disappear. Use -L to\n");
+   fprintf(stderr,"reproduce the results of versions before V0.3.\n");
 
+   fprintf(stderr,"\nI/O is through standard input/output if files \
+are not specified.\n\n");
 }
 
@@ -4,11 +4,11 @@
    Program:    protrusion
    \file       protrusion.c
    
-   \version    V1.0
-   \date       12.01.21   
+   \version    V1.2
+   \date       16.10.26   
    \brief         
    
-   \copyright  (c) UCL / Prof. Andrew C. R. Martin 2021
+   \copyright  (c) UCL / Prof. Andrew C. R. Martin 2021-2026
    \author     Prof. Andrew C. R. Martin
    \par
                Institute of Structural & Molecular Biology,
@@ -36,6 +36,11 @@
 
    Description:
    ============
+   Takes a zone of residues and finds the C-alpha that protrudes most 
+   from the line between the C-alphas at the ends of the zone.
+
+   With -q, zones are read from a file, one per line, and all are 
+   answered from one read of the PDB file using a residue index.
 
 **************************************************************************
 
@@ -46,16 +51,21 @@
 
    Revision History:
    =================
+-  V1.0  12.01.21 Original   By: ACRM
+-  V1.2  16.10.26 Added -q for a file of zones. Residues are found 
+                  through a residue index   By: agent
 
 *************************************************************************/
 /* Includes
 */
 #include <stdio.h>
+#include <string.h>
 #include <math.h>
 #include "bioplib/macros.h"
 #include "bioplib/pdb.h"
 #include "bioplib/MathType.h"
 #include "bioplib/MathUtil.h"
+#include "resindex.h"
 
 /************************************************************************/
 /* Defines and macros
@@ -70,11 +80,13 @@
 /* Prototypes
 */
 int main(int argc, char **argv);
-PDB *RunAnalysis(PDB *pdb, char *startres, char *stopres,
-                 REAL *protrusion);
+PDB *RunAnalysis(RESINDEX *index, char *startres, char *stopres,
+                 REAL *protrusion, BOOL *validZone);
 BOOL ParseCmdLine(int argc, char **argv, char *infile, char *outfile, 
-                  char *startres, char *stopres);
+                  char *startres, char *stopres, char *queryFile);
 void Usage(void);
+BOOL RunQueries(FILE *out, RESINDEX *index, char *queryFile);
+void WriteProtrusion(FILE *out, PDB *protrudingRes, REAL protrusion);
 
 
 /************************************************************************/
@@ -84,21 +96,26 @@ void Usage(void);
    Main program
 
 - 12.01.21 Original   By: ACRM
+- 16.10.26 Added query file mode and residue index   By: agent
+- 17.10.26 Exits with an error if the zone is reversed   By: agent
 **/
 int main(int argc, char **argv)
 {
-   FILE *in     = stdin,
-        *out    = stdout;
-   int  natoms;
-   REAL protrusion = 0.0;
-   PDB  *pdb, *protrudingRes;
-   char infile[MAXBUFF],
-        outfile[MAXBUFF],
-        startres[MAXBUFF],
-        stopres[MAXBUFF];
+   FILE     *in     = stdin,
+            *out    = stdout;
+   int      natoms;
+   REAL     protrusion = 0.0;
+   BOOL     validZone;
+   PDB      *pdb, *protrudingRes;
+   RESINDEX *index;
+   char     infile[MAXBUFF],
+            outfile[MAXBUFF],
+            startres[MAXBUFF],
+            stopres[MAXBUFF],
+            queryFile[MAXBUFF];
    
    if(!ParseCmdLine(argc, argv, infile, outfile,
-                    startres, stopres))
+                    startres, stopres, queryFile))
    {
       Usage();
       return(0);
@@ -121,50 +138,166 @@ file, %s\n", infile);
    /* Reduce to CA atoms only                                           */
    pdb = blSelectCaPDB(pdb);
 
-   if((protrudingRes=RunAnalysis(pdb, startres, stopres, &protrusion))
-      != NULL)
+   if((index = BuildResidueIndex(pdb))==NULL)
+   {
+      fprintf(stderr, "Error (protrusion): No memory for residue \
+index\n");
+      return(1);
+   }
+
+   if(queryFile[0])
+   {
+      if(!RunQueries(out, index, queryFile))
+         return(1);
+   }
+   else 
    {
-      fprintf(out, "%s%d%s %s Protrusion: %.3f\n",
-              protrudingRes->chain,
-              protrudingRes->resnum,
-              protrudingRes->insert,
-              protrudingRes->resnam,
-              protrusion);
+      if((protrudingRes=RunAnalysis(index, startres, stopres, 
+                                    &protrusion, &validZone)) != NULL)
+         WriteProtrusion(out, protrudingRes, protrusion);
+      if(!validZone)
+         return(1);
    }
    
    return(0);
 }
 
+
+/************************************************************************/
+/*>BOOL RunQueries(FILE *out, RESINDEX *index, char *queryFile)
+   ------------------------------------------------------------
+*//**
+   \param[in]   FILE     *out        Output file pointer
+   \param[in]   RESINDEX *index      Residue index
+   \param[in]   char     *queryFile  File of zones
+   \return      BOOL                 Success
+
+   Reads zones as pairs of residue specs, one per line, and writes each
+   zone followed by the most protruding residue (or NULL if there is 
+   none). Blank lines and lines starting with a # are skipped. Every 
+   other line gives one output line so the output can be matched to the
+   queries: a line with only one residue gives "startres NULL", and 
+   anything after the zone is ignored with a warning.
+
+-  16.10.26 Original   By: agent
+-  17.10.26 Writes NULL for a line with one residue and warns about
+            extra fields   By: agent
+**/
+BOOL RunQueries(FILE *out, RESINDEX *index, char *queryFile)
+{
+   FILE *fp;
+   char buffer[MAXBUFF],
+        startres[MAXBUFF],
+        stopres[MAXBUFF],
+        extra[MAXBUFF];
+
+   if((fp = fopen(queryFile, "r"))==NULL)
+   {
+      fprintf(stderr, "Error (protrusion): Unable to open query file, \
+%s\n", queryFile);
+      return(FALSE);
+   }
+
+   while(fgets(buffer, MAXBUFF, fp))
+   {
+      PDB  *protrudingRes;
+      REAL protrusion = 0.0;
+      BOOL validZone;
+      int  nFields;
+      
+      TERMINATE(buffer);
+      if((buffer[0] == '#') ||
+         ((nFields = sscanf(buffer, "%s %s %s", startres, stopres, 
+                            extra)) < 1))
+         continue;
+      if(nFields == 1)
+      {
+         fprintf(stderr, "Warning (protrusion): Zone with only one \
+residue, %s\n", startres);
+         fprintf(out, "%s NULL\n", startres);
+         continue;
+      }
+      if(nFields > 2)
+      {
+         fprintf(stderr, "Warning (protrusion): Ignored extra fields \
+after zone %s %s\n", startres, stopres);
+      }
+
+      fprintf(out, "%s %s ", startres, stopres);
+      if((protrudingRes=RunAnalysis(index, startres, stopres, 
+                                    &protrusion, &validZone)) != NULL)
+         WriteProtrusion(out, protrudingRes, protrusion);
+      else
+         fprintf(out, "NULL\n");
+   }
+
+   fclose(fp);
+   return(TRUE);
+}
+
+
+/************************************************************************/
+/*>void WriteProtrusion(FILE *out, PDB *protrudingRes, REAL protrusion)
+   --------------------------------------------------------------------
+*//**
+   \param[in]   FILE   *out            Output file pointer
+   \param[in]   PDB    *protrudingRes  The most protruding residue
+   \param[in]   REAL   protrusion      Its protrusion
+
+   Writes the most protruding residue and its protrusion
+
+-  16.10.26 Original   By: agent (split from main())
+**/
+void WriteProtrusion(FILE *out, PDB *protrudingRes, REAL protrusion)
+{
+   fprintf(out, "%s%d%s %s Protrusion: %.3f\n",
+           protrudingRes->chain,
+           protrudingRes->resnum,
+           protrudingRes->insert,
+           protrudingRes->resnam,
+           protrusion);
+}
+
 /************************************************************************/
-/*>PDB *RunAnalysis(PDB *pdb, char *startres, char *stopres,
-                    REAL *protrusion)
+/*>PDB *RunAnalysis(RESINDEX *index, char *startres, char *stopres,
+                    REAL *protrusion, BOOL *validZone)
    --------------------------------------------------------------------
 *//**
-   \param[in]   PDB    *pdb             PDB linked list
+   \param[in]   RESINDEX *index         Residue index of the C-alphas
    \param[in]   char   *startres        start residue specification
    \param[in]   char   *stopres         stop residue specification
    \param[out]  REAL   *protrusion      The protrusion of the most
                                         protruding residue
+   \param[out]  BOOL   *validZone       FALSE if the stop residue does
+                                        not follow the start residue
    \return      PDB*                    The PDB record of the most
-                                        protruding residue
+                                        protruding residue (NULL if
+                                        none or the zone is invalid)
 
    Calculates the protrusion of the most protrtuding residue from the
-   line between the two specified ends
+   line between the two specified ends. Reports an error if the stop
+   residue does not come after the start residue.
 
 -  12.01.21 Original   By: ACRM
+-  16.10.26 Finds the ends through the residue index   By: agent
+-  17.10.26 Rejects a zone whose stop residue does not follow the start
+            By: agent
 **/
-PDB *RunAnalysis(PDB *pdb, char *startres, char *stopres,
-                 REAL *protrusion)
+PDB *RunAnalysis(RESINDEX *index, char *startres, char *stopres,
+                 REAL *protrusion, BOOL *validZone)
 {
    PDB   *p, *start, *stop,
          *residue=NULL;
    VEC3F end1, end2;
    REAL  maxDist = 0.0;
 
+   *validZone  = TRUE;
+   *protrusion = 0.0;
+
    /* Find the start and stop of the zone of interest                   */
-   if((start = blFindResidueSpec(pdb, startres))==NULL)
+   if((start = FindIndexedResidueSpec(index, startres))==NULL)
       return(NULL);
-   if((stop  = blFindResidueSpec(pdb, stopres))==NULL)
+   if((stop  = FindIndexedResidueSpec(index, stopres))==NULL)
       return(NULL);
 
    /* Fill in the vectors                                               */
@@ -179,7 +312,7 @@ PDB *RunAnalysis(PDB *pdb, char *startres, char *stopres,
    /* Step through the PDB linked list between start and stop and 
       measure the distance from the line, recording the longest
    */
-   for(p=start->next; p!=stop; NEXT(p))
+   for(p=start->next; (p!=NULL) && (p!=stop); NEXT(p))
    {
       VEC3F point;
       REAL  dist;
@@ -196,6 +329,15 @@ PDB *RunAnalysis(PDB *pdb, char *startres, char *stopres,
       }
    }
 
+   /* Ran off the end of the list without finding the stop residue      */
+   if(p == NULL)
+   {
+      fprintf(stderr, "Error (protrusion): Zone end, %s, does not come \
+after zone start, %s\n", stopres, startres);
+      *validZone = FALSE;
+      return(NULL);
+   }
+
    *protrusion = maxDist;
    return(residue);
 }
@@ -203,7 +345,7 @@ PDB *RunAnalysis(PDB *pdb, char *startres, char *stopres,
 
 /************************************************************************/
 /*>BOOL ParseCmdLine(int argc, char **argv, char *infile, char *outfile, 
-                     char *startres, char *stopres)
+                     char *startres, char *stopres, char *queryFile)
    ----------------------------------------------------------------------
 *//**
    \param[in]   int    argc              Argument count
@@ -212,20 +354,23 @@ PDB *RunAnalysis(PDB *pdb, char *startres, char *stopres,
    \param[out]  char   *outfile          Output filename (or blank string)
    \param[out]  char   *startres         First residue of zone
    \param[out]  char   *stopres          Last residue of zone
+   \param[out]  char   *queryFile        File of zones (or blank string)
 
    \return      BOOL                     Success
 
    Parse the command line
 
    17.07.14 Original    By: ACRM
+   16.10.26 Added -q   By: agent
 */
 BOOL ParseCmdLine(int argc, char **argv, char *infile, char *outfile, 
-                  char *startres, char *stopres)
+                  char *startres, char *stopres, char *queryFile)
 {
    argc--;
    argv++;
    
    infile[0] = outfile[0] = startres[0] = stopres[0] = '\0';
+   queryFile[0] = '\0';
    
    while(argc)
    {
@@ -235,10 +380,28 @@ BOOL ParseCmdLine(int argc, char **argv, char *infile, char *outfile,
          {
          case 'h':
             return(FALSE);
+         case 'q':
+            argc--;
+            argv++;
+            if(!argc)
+               return(FALSE);
+            strncpy(queryFile, argv[0], MAXBUFF);
+            queryFile[MAXBUFF-1] = '\0';
+            break;
          default:
             return(FALSE);
          }
       }
+      else if(queryFile[0])
+      {
+         /* Just the input and output files with a query file           */
+         if(argc > 2)
+            return(FALSE);
+         strcpy(infile, argv[0]);
+         if(argc > 1)
+            strcpy(outfile, argv[1]);
+         return(TRUE);
+      }
       else
       {
          /* Check that there are between 2 and 4 arguments left         */
@@ -272,7 +435,8 @@ BOOL ParseCmdLine(int argc, char **argv, char *infile, char *outfile,
       argv++;
    }
    
-   return(TRUE);
+   /* The zone is needed unless there is a query file                   */
+   return(queryFile[0] != '\0');
 }
 
 /************************************************************************/
@@ -282,19 +446,26 @@ BOOL ParseCmdLine(int argc, char **argv, char *infile, char *outfile,
    Prints a usage message
 
 -   12.01.21 Original   By: ACRM
+-   16.10.26 Added -q   By: agent
 */
 void Usage(void)
 {
-   fprintf(stderr,"\nprotrusion V1.1 (c) 2021 UCL, Prof. Andrew C.R. \
-Martin\n");
+   fprintf(stderr,"\nprotrusion V1.2 (c) 2021-2026 UCL, Prof. Andrew \
+C.R. Martin\n");
 
    fprintf(stderr,"\nUsage: protrusion startres lastres \
 [in.pdb [out.txt]]\n");
+   fprintf(stderr,"       protrusion -q zones.txt [in.pdb [out.txt]]\n");
+   fprintf(stderr,"       -q Read zones from a file, one startres \
+lastres pair per line\n");
 
    fprintf(stderr,"\nTakes a zone of residues and finds the distance of \
 the intervening\n");
    fprintf(stderr,"residue that protrudes most from the line between \
 the two specified\n");
-   fprintf(stderr,"residues. Uses only the C-alpha atoms.\n\n");
+   fprintf(stderr,"residues. Uses only the C-alpha atoms.\n");
+   fprintf(stderr,"\nWith -q, each output line starts with the zone \
+and ends with NULL\n");
+   fprintf(stderr,"if there is no protruding residue.\n\n");
 }
 
@@ -3,11 +3,11 @@
    Program:    cdrcontacts
    File:       cdrcontacts.c
    
-   Version:    V1.1
-   Date:       03.12.14
+   Version:    V1.4
+   Date:       16.10.26
    Function:   Find contacts between CDRs and framework
    
-   Copyright:  (c) UCL / Dr. Andrew C. R. Martin 2014
+   Copyright:  (c) UCL / Dr. Andrew C. R. Martin 2014-2026
    Author:     Dr. Andrew C. R. Martin
    Address:    Biomolecular Structure & Modelling Unit,
                Institute of Structural & Molecular Biology,
@@ -48,13 +48,24 @@
    =================
    V1.0   16.11.14  Original   By: ACRM
    V1.1   03.12.14  Output now includes residue names
+   V1.2   16.10.26  CDR zones are parsed once and each residue is labelled
+                    with its CDR before the contact search
+   V1.3   16.10.26  Framework atoms are placed on a grid so each CDR 
+                    residue is only compared with nearby residues
+   V1.4   16.10.26  Added -l and -j to analyse a list or directory of 
+                    files on several threads
 
 *************************************************************************/
 /* Includes
 */
+#define _POSIX_C_SOURCE 200809L
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include <math.h>
+#include <pthread.h>
+#include <dirent.h>
+#include <sys/stat.h>
 #include "bioplib/macros.h"
 #include "bioplib/pdb.h"
 
@@ -65,14 +76,69 @@
 #define MAXBUFF       400
 #define DEF_DISTCUT   (REAL)4.0
 #define MAXBONDDISTSQ (REAL)5.29  /* i.e. 2.3A (Nx...O(x-1))            */
+#define NOCDR         (-1)
+#define MINCELLSIZE   (REAL)1.0
+#define MAXCELLS      1000000     /* Cells are enlarged to stay below    */
+#define MAXTHREADS    256
+#define JOBWINDOW     4           /* Files in hand per thread in -l mode */
+#define FILELISTQUANTUM 1024
 
 typedef struct _zone
 {
    char cdr[MAXLABEL],
         start[MAXLABEL],
-        stop[MAXLABEL];
+        stop[MAXLABEL],
+        chain[8],                 /* Set from start/stop by ParseZones() */
+        startInsert[8],
+        stopInsert[8];
+   int  startResnum,
+        stopResnum;
 } ZONE;
 
+typedef struct
+{
+   PDB *start,                    /* First atom of the residue           */
+       *stop;                     /* First atom of the next residue      */
+   int cdr;                       /* Index into the zones or NOCDR       */
+} RESIDUE;
+
+typedef struct
+{
+   PDB  **atoms;                  /* Framework atoms                     */
+   int  *atomRes,                 /* Residue index of each atom          */
+        *atomNext,                /* Next atom in the same cell          */
+        *cellHead,                /* First atom in each cell             */
+        nAtoms,
+        nx, ny, nz;
+   REAL xmin, ymin, zmin,
+        cellSize;
+} ATOMGRID;
+
+typedef struct
+{
+   char   *filename,
+          *output,                /* Results, printed tagged with the    */
+          *error;                 /* file name                           */
+   size_t outputLen;
+   BOOL   done;
+} FILEJOB;
+
+typedef struct
+{
+   FILEJOB         *jobs;
+   ZONE            *cdrs;
+   REAL            dist;
+   BOOL            doResList;
+   int             nJobs,
+                   nextJob,       /* Next job for a worker to take       */
+                   nWritten;      /* Jobs printed by the main thread     */
+   int             window;        /* Max jobs taken but not yet printed  */
+   pthread_mutex_t lock,
+                   readLock;
+   pthread_cond_t  jobDone,
+                   jobWritten;
+} WORKQUEUE;
+
    
 
 /************************************************************************/
@@ -83,17 +149,40 @@ typedef struct _zone
 /* Prototypes
 */
 int main(int argc, char **argv);
-void RunAnalysis(FILE *out, PDB *pdb, ZONE *cdrs, REAL dist);
+BOOL RunAnalysis(FILE *out, PDB *pdb, ZONE *cdrs, REAL dist);
 BOOL ParseCmdLine(int argc, char **argv, char *infile, char *outfile,
-                  REAL *dist, BOOL *doResList);
+                  REAL *dist, BOOL *doResList, char *listFile,
+                  int *nThreads);
+BOOL RunBatch(FILE *out, char *listFile, ZONE *cdrs, REAL dist, 
+              BOOL doResList, int nThreads);
+char **ReadFileList(char *listFile, int *nFiles);
+BOOL AddFileName(char ***files, int *nFiles, int *maxFiles, char *dir,
+                 char *name);
+int CompareStrings(const void *a, const void *b);
+void AnalyseFile(WORKQUEUE *queue, FILEJOB *job);
+void *FileWorker(void *arg);
+void WriteFileJob(FILE *out, FILEJOB *job);
 void Usage(void);
-BOOL InCDR(PDB *p, ZONE *cdrs, char *theCDR);
-REAL MakesContact(PDB *res1, PDB *res2, REAL distSq);
-BOOL InPDBZoneSpec(PDB *p, char *start, char *stop);
+void ParseZones(ZONE *cdrs);
+RESIDUE *LabelResidues(PDB *pdb, ZONE *cdrs, int *nRes);
+int FindCDR(PDB *p, ZONE *cdrs);
+REAL MakesContact(RESIDUE *res1, RESIDUE *res2, REAL distSq);
+BOOL BuildFrameworkGrid(RESIDUE *residues, int nRes, REAL cellSize,
+                        ATOMGRID *grid);
+void FreeAtomGrid(ATOMGRID *grid);
+int FindNeighbourResidues(ATOMGRID *grid, RESIDUE *res, int resIndex,
+                          int *mark, int *nbrs);
+int CompareInts(const void *a, const void *b);
 void PrintResList(FILE *out, PDB *pdb);
 
 
 /************************************************************************/
+/*>int main(int argc, char **argv)
+   -------------------------------
+   16.11.14 Original   By: ACRM
+   16.10.26 Parses the CDR zones once   By: agent
+   16.10.26 Added batch mode   By: agent
+*/
 int main(int argc, char **argv)
 {
    /* Initialize the zones for CDRs and the whole of an antibody        */
@@ -107,13 +196,29 @@ int main(int argc, char **argv)
    FILE *in  = stdin,
         *out = stdout;
    char infile[MAXBUFF],
-        outfile[MAXBUFF];
+        outfile[MAXBUFF],
+        listFile[MAXBUFF];
    REAL dist = DEF_DISTCUT;
    BOOL doResList = FALSE;
+   int  nThreads  = 1;
    
 
-   if(ParseCmdLine(argc, argv, infile, outfile, &dist, &doResList))
+   if(ParseCmdLine(argc, argv, infile, outfile, &dist, &doResList,
+                   listFile, &nThreads))
    {
+      ParseZones(cdrs);
+      
+      if(listFile[0])
+      {
+         if(!blOpenStdFiles(infile, outfile, &in, &out))
+         {
+            fprintf(stderr,"Error: Unable to open output file\n");
+            return(1);
+         }
+         return(RunBatch(out, listFile, cdrs, dist, doResList, nThreads)
+                ? 0 : 1);
+      }
+      
       if(blOpenStdFiles(infile, outfile, &in, &out))
       {
          PDB *pdb;
@@ -121,7 +226,12 @@ int main(int argc, char **argv)
          
          if((pdb=blReadPDBAtoms(in, &natoms))!=NULL)
          {
-            RunAnalysis(out, pdb, cdrs, dist);
+            if(!RunAnalysis(out, pdb, cdrs, dist))
+            {
+               fprintf(stderr,"Error: No memory for contact analysis\n");
+               FREELIST(pdb, PDB);
+               return(1);
+            }
             if(doResList)
                PrintResList(out, pdb);
             FREELIST(pdb, PDB);
@@ -142,6 +252,387 @@ int main(int argc, char **argv)
 }
 
 
+/************************************************************************/
+/*>BOOL RunBatch(FILE *out, char *listFile, ZONE *cdrs, REAL dist, 
+                 BOOL doResList, int nThreads)
+   ---------------------------------------------------------------
+   Input:   FILE   *out       Output file
+            char   *listFile  File of PDB file names, or a directory
+            ZONE   *cdrs      CDR zones
+            REAL   dist       Contact distance
+            BOOL   doResList  Print the residue list for each file
+            int    nThreads   Number of worker threads
+   Returns: BOOL              Success (FALSE if the list couldn't be read
+                              or no memory)
+
+   Analyses a set of PDB files. Worker threads take the files in turn,
+   so one file is read while others are analysed, and each writes its 
+   results to its own buffer. This thread prints the buffers in the 
+   order of the file list, each line tagged with the file name. Workers
+   stay at most JOBWINDOW files per thread ahead of the printing so the
+   buffered output is bounded.
+
+   16.10.26   Original   By: agent
+*/
+BOOL RunBatch(FILE *out, char *listFile, ZONE *cdrs, REAL dist, 
+              BOOL doResList, int nThreads)
+{
+   WORKQUEUE queue;
+   pthread_t threads[MAXTHREADS];
+   char      **files;
+   int       nFiles,
+             nStarted = 0,
+             i;
+   BOOL      ok = TRUE;
+
+   if((files = ReadFileList(listFile, &nFiles))==NULL)
+   {
+      fprintf(stderr,"Error: Unable to read file list %s\n", listFile);
+      return(FALSE);
+   }
+   if((queue.jobs = (FILEJOB *)calloc(nFiles+1, sizeof(FILEJOB)))==NULL)
+   {
+      fprintf(stderr,"Error: No memory for file list\n");
+      return(FALSE);
+   }
+   for(i=0; i<nFiles; i++)
+      queue.jobs[i].filename = files[i];
+   
+   queue.cdrs      = cdrs;
+   queue.dist      = dist;
+   queue.doResList = doResList;
+   queue.nJobs     = nFiles;
+   queue.nextJob   = 0;
+   queue.nWritten  = 0;
+   queue.window    = JOBWINDOW * nThreads;
+   pthread_mutex_init(&queue.lock, NULL);
+   pthread_mutex_init(&queue.readLock, NULL);
+   pthread_cond_init(&queue.jobDone, NULL);
+   pthread_cond_init(&queue.jobWritten, NULL);
+
+   while((nStarted < nThreads) && (nStarted < nFiles))
+   {
+      if(pthread_create(&(threads[nStarted]), NULL, FileWorker, 
+                        (void *)&queue))
+         break;
+      nStarted++;
+   }
+
+   /* Print the results in file order. Without any workers, each file is
+      analysed here first
+   */
+   for(i=0; i<nFiles; i++)
+   {
+      FILEJOB *job = &(queue.jobs[i]);
+
+      if(nStarted == 0)
+      {
+         AnalyseFile(&queue, job);
+      }
+      else
+      {
+         pthread_mutex_lock(&queue.lock);
+         while(!job->done)
+            pthread_cond_wait(&queue.jobDone, &queue.lock);
+         pthread_mutex_unlock(&queue.lock);
+      }
+
+      WriteFileJob(out, job);
+      if(job->error != NULL)
+      {
+         fprintf(stderr,"Error: %s: %s\n", job->filename, job->error);
+         if(!strcmp(job->error, "No memory"))
+            ok = FALSE;
+      }
+      
+      pthread_mutex_lock(&queue.lock);
+      queue.nWritten++;
+      pthread_cond_broadcast(&queue.jobWritten);
+      pthread_mutex_unlock(&queue.lock);
+
+      if(job->output != NULL)
+         free(job->output);
+      free(job->filename);
+   }
+   
+   for(i=0; i<nStarted; i++)
+      pthread_join(threads[i], NULL);
+
+   pthread_mutex_destroy(&queue.lock);
+   pthread_mutex_destroy(&queue.readLock);
+   pthread_cond_destroy(&queue.jobDone);
+   pthread_cond_destroy(&queue.jobWritten);
+   free(queue.jobs);
+   free(files);
+
+   return(ok);
+}
+
+
+/************************************************************************/
+/*>void *FileWorker(void *arg)
+   ---------------------------
+   Input:   void  *arg       The WORKQUEUE, cast to void *
+   Returns: void *           NULL
+
+   Thread function. Repeatedly takes the next PDB file from the work 
+   queue and analyses it, waiting while the printing is too far behind.
+
+   16.10.26   Original   By: agent
+*/
+void *FileWorker(void *arg)
+{
+   WORKQUEUE *queue = (WORKQUEUE *)arg;
+   int       job;
+
+   for(;;)
+   {
+      pthread_mutex_lock(&queue->lock);
+      while((queue->nextJob < queue->nJobs) &&
+            (queue->nextJob >= queue->nWritten + queue->window))
+         pthread_cond_wait(&queue->jobWritten, &queue->lock);
+      job = (queue->nextJob)++;
+      pthread_mutex_unlock(&queue->lock);
+
+      if(job >= queue->nJobs)
+         break;
+
+      AnalyseFile(queue, &(queue->jobs[job]));
+
+      pthread_mutex_lock(&queue->lock);
+      queue->jobs[job].done = TRUE;
+      pthread_cond_broadcast(&queue->jobDone);
+      pthread_mutex_unlock(&queue->lock);
+   }
+
+   return(NULL);
+}
+
+
+/************************************************************************/
+/*>void AnalyseFile(WORKQUEUE *queue, FILEJOB *job)
+   ------------------------------------------------
+   Input:   WORKQUEUE *queue  Analysis parameters and the read lock
+   I/O:     FILEJOB   *job    The file to analyse and its results
+
+   Reads a PDB file and runs the analysis into a memory buffer. Any
+   error is left in job->error.
+
+   16.10.26   Original   By: agent
+*/
+void AnalyseFile(WORKQUEUE *queue, FILEJOB *job)
+{
+   FILE *fp,
+        *buff;
+   PDB  *pdb;
+   int  natoms;
+
+   if((fp=fopen(job->filename, "r"))==NULL)
+   {
+      job->error = "Unable to open file";
+      return;
+   }
+
+   /* PDB reading isn't thread-safe so is done by one thread at a time  */
+   pthread_mutex_lock(&queue->readLock);
+   pdb = blReadPDBAtoms(fp, &natoms);
+   pthread_mutex_unlock(&queue->readLock);
+   fclose(fp);
+   if(pdb==NULL)
+   {
+      job->error = "No atoms read";
+      return;
+   }
+
+   if((buff = open_memstream(&(job->output), &(job->outputLen)))==NULL)
+   {
+      job->error = "No memory";
+   }
+   else
+   {
+      if(!RunAnalysis(buff, pdb, queue->cdrs, queue->dist))
+         job->error = "No memory";
+      else if(queue->doResList)
+         PrintResList(buff, pdb);
+      fclose(buff);
+   }
+   
+   FREELIST(pdb, PDB);
+}
+
+
+/************************************************************************/
+/*>void WriteFileJob(FILE *out, FILEJOB *job)
+   ------------------------------------------
+   Input:   FILE    *out      Output file
+            FILEJOB *job      Analysed file
+
+   Prints the results for a file with each line preceded by the file
+   name
+
+   16.10.26   Original   By: agent
+*/
+void WriteFileJob(FILE *out, FILEJOB *job)
+{
+   char *line,
+        *eol;
+
+   if(job->output == NULL)
+      return;
+   
+   for(line=job->output; *line; line=eol+1)
+   {
+      if((eol = strchr(line, '\n'))==NULL)
+      {
+         fprintf(out, "%s: %s\n", job->filename, line);
+         break;
+      }
+      fprintf(out, "%s: %.*s\n", job->filename, (int)(eol-line), line);
+   }
+}
+
+
+/************************************************************************/
+/*>char **ReadFileList(char *listFile, int *nFiles)
+   ------------------------------------------------
+   Input:   char   *listFile  File of PDB file names (one per line; blank
+                              lines and lines starting with # are 
+                              skipped) or a directory
+   Output:  int    *nFiles    Number of files
+   Returns: char   **         Malloc'd array of malloc'd file names 
+                              (NULL on error)
+
+   The files in a directory are taken in alphabetical order, skipping
+   hidden files and anything which isn't a plain file.
+
+   16.10.26   Original   By: agent
+*/
+char **ReadFileList(char *listFile, int *nFiles)
+{
+   struct stat statBuf;
+   char        **files  = NULL,
+               buffer[MAXBUFF];
+   int         maxFiles = 0;
+   BOOL        ok       = TRUE;
+
+   *nFiles = 0;
+   if(stat(listFile, &statBuf))
+      return(NULL);
+
+   if(S_ISDIR(statBuf.st_mode))
+   {
+      DIR           *dir;
+      struct dirent *entry;
+      
+      if((dir = opendir(listFile))==NULL)
+         return(NULL);
+      while(ok && ((entry = readdir(dir))!=NULL))
+      {
+         if(entry->d_name[0] == '.')
+            continue;
+         ok = AddFileName(&files, nFiles, &maxFiles, listFile, 
+                          entry->d_name);
+         if(ok && (stat(files[*nFiles-1], &statBuf) || 
+                   !S_ISREG(statBuf.st_mode)))
+            free(files[--(*nFiles)]);
+      }
+      closedir(dir);
+      if(ok && (*nFiles > 1))
+         qsort(files, *nFiles, sizeof(char *), CompareStrings);
+   }
+   else
+   {
+      FILE *fp;
+      
+      if((fp = fopen(listFile, "r"))==NULL)
+         return(NULL);
+      while(ok && fgets(buffer, MAXBUFF, fp))
+      {
+         char *name;
+         
+         TERMINATE(buffer);
+         for(name=buffer; (*name == ' ') || (*name == '\t'); name++);
+         KILLTRAILSPACES(name);
+         if(name[0] && (name[0] != '#'))
+            ok = AddFileName(&files, nFiles, &maxFiles, NULL, name);
+      }
+      fclose(fp);
+   }
+
+   if(!ok)
+   {
+      while(*nFiles)
+         free(files[--(*nFiles)]);
+      if(files != NULL)
+         free(files);
+      return(NULL);
+   }
+
+   /* An empty list gives an empty array rather than an error           */
+   if((files == NULL) && 
+      ((files = (char **)malloc(sizeof(char *)))==NULL))
+      return(NULL);
+   
+   return(files);
+}
+
+
+/************************************************************************/
+/*>BOOL AddFileName(char ***files, int *nFiles, int *maxFiles, char *dir,
+                    char *name)
+   ----------------------------------------------------------------------
+   I/O:     char   ***files   Array of file names, expanded as needed
+            int    *nFiles    Number of file names
+            int    *maxFiles  Space in the array
+   Input:   char   *dir       Directory or NULL
+            char   *name      File name
+   Returns: BOOL              Success (FALSE if no memory)
+
+   16.10.26   Original   By: agent
+*/
+BOOL AddFileName(char ***files, int *nFiles, int *maxFiles, char *dir,
+                 char *name)
+{
+   char *fullName;
+   
+   if(*nFiles >= *maxFiles)
+   {
+      char **newFiles;
+      
+      *maxFiles += FILELISTQUANTUM;
+      if((newFiles = (char **)realloc(*files, *maxFiles * sizeof(char *)))
+         ==NULL)
+         return(FALSE);
+      *files = newFiles;
+   }
+
+   if((fullName = (char *)malloc(strlen(name) + 
+                                 ((dir==NULL) ? 1 : strlen(dir) + 2)))
+      ==NULL)
+      return(FALSE);
+   if(dir == NULL)
+      strcpy(fullName, name);
+   else
+      sprintf(fullName, "%s/%s", dir, name);
+
+   (*files)[(*nFiles)++] = fullName;
+   return(TRUE);
+}
+
+
+/************************************************************************/
+/*>int CompareStrings(const void *a, const void *b)
+   ------------------------------------------------
+   qsort() comparison function for an array of strings
+
+   16.10.26   Original   By: agent
+*/
+int CompareStrings(const void *a, const void *b)
+{
+   return(strcmp(*(char * const *)a, *(char * const *)b));
+}
+
+
 /************************************************************************/
 /*>void PrintResList(FILE *out, PDB *pdb)
    --------------------------------------
@@ -161,65 +652,326 @@ void PrintResList(FILE *out, PDB *pdb)
 
 
 /************************************************************************/
-/*>void RunAnalysis(FILE *out, PDB *pdb, ZONE *cdrs, REAL dist)
+/*>BOOL RunAnalysis(FILE *out, PDB *pdb, ZONE *cdrs, REAL dist)
    ------------------------------------------------------------
+   Returns: BOOL              Success (FALSE if no memory)
+
    16.11.14   Original   By: ACRM
    03.12.14   Added output or amino acid type
+   16.10.26   Works from the list of labelled residues rather than 
+              testing the CDR zones for each residue pair   By: agent
+   16.10.26   Only compares each CDR residue with the framework residues
+              found near it on a grid   By: agent
+*/
+BOOL RunAnalysis(FILE *out, PDB *pdb, ZONE *cdrs, REAL dist)
+{
+   RESIDUE  *residues;
+   ATOMGRID grid;
+   REAL     distSq   = dist * dist,
+            theDist  = 0.0;
+   int      *mark    = NULL,
+            *nbrs    = NULL,
+            nRes, nNbrs, i, j;
+   
+   /* An empty structure is not an error                                */
+   if((residues = LabelResidues(pdb, cdrs, &nRes))==NULL)
+      return(pdb == NULL);
+   
+   /* Any atom within the cutoff of a CDR atom is in a neighbouring cell
+      of the grid
+   */
+   if(!BuildFrameworkGrid(residues, nRes, dist, &grid) ||
+      ((mark = (int *)malloc(nRes * sizeof(int)))==NULL) ||
+      ((nbrs = (int *)malloc(nRes * sizeof(int)))==NULL))
+   {
+      FreeAtomGrid(&grid);
+      if(mark != NULL) free(mark);
+      free(residues);
+      return(FALSE);
+   }
+   for(j=0; j<nRes; j++)
+      mark[j] = (-1);
+   
+   for(i=0; i<nRes; i++)
+   {
+      if(residues[i].cdr != NOCDR)
+      {
+         PDB *p = residues[i].start;
+
+         /* Candidates are sorted so the output is in residue order     */
+         nNbrs = FindNeighbourResidues(&grid, &(residues[i]), i, 
+                                       mark, nbrs);
+         if(nNbrs > 1)
+            qsort(nbrs, nNbrs, sizeof(int), CompareInts);
+         
+         for(j=0; j<nNbrs; j++)
+         {
+            RESIDUE *res = &(residues[nbrs[j]]);
+            PDB     *q   = res->start;
+            
+            if((theDist=MakesContact(&(residues[i]), res, distSq))
+               >= (REAL)0.0)
+            {
+               fprintf(out, "%s %s%d%s %s contacts %s%d%s %s : %.2f\n",
+                       cdrs[residues[i].cdr].cdr, 
+                       p->chain, p->resnum, p->insert, p->resnam,
+                       q->chain, q->resnum, q->insert, q->resnam,
+                       theDist);
+            }
+         }
+      }
+   }
+
+   FreeAtomGrid(&grid);
+   free(mark);
+   free(nbrs);
+   free(residues);
+   return(TRUE);
+}
+
+
+/************************************************************************/
+/*>BOOL BuildFrameworkGrid(RESIDUE *residues, int nRes, REAL cellSize,
+                           ATOMGRID *grid)
+   -------------------------------------------------------------------
+   Input:   RESIDUE  *residues  Labelled residues
+            int      nRes       Number of residues
+            REAL     cellSize   Minimum grid cell size (the cutoff)
+   Output:  ATOMGRID *grid      Grid of the atoms of residues not in a
+                                CDR
+   Returns: BOOL                Success (FALSE if no memory)
+
+   Places the framework atoms on a grid of cubic cells. The cells are
+   enlarged if needed to keep the number of cells below MAXCELLS.
+
+   16.10.26   Original   By: agent
 */
-void RunAnalysis(FILE *out, PDB *pdb, ZONE *cdrs, REAL dist)
+BOOL BuildFrameworkGrid(RESIDUE *residues, int nRes, REAL cellSize,
+                        ATOMGRID *grid)
 {
-   PDB *p        = NULL,
-       *nextPRes = NULL,
-       *q        = NULL,
-       *nextQRes = NULL;
-   REAL distSq   = dist * dist,
-        theDist  = 0.0;
-   char theCDR[MAXLABEL];
+   PDB  *p;
+   REAL xmax, ymax, zmax;
+   int  i, n, nCells;
+
+   memset(grid, 0, sizeof(ATOMGRID));
+   grid->cellSize = MAX(cellSize, MINCELLSIZE);
+   xmax = ymax = zmax = (REAL)0.0;
+   
+   for(i=0, n=0; i<nRes; i++)
+   {
+      if(residues[i].cdr != NOCDR)
+         continue;
+      
+      for(p=residues[i].start; p!=residues[i].stop; NEXT(p))
+      {
+         if(n == 0)
+         {
+            grid->xmin = xmax = p->x;
+            grid->ymin = ymax = p->y;
+            grid->zmin = zmax = p->z;
+         }
+         grid->xmin = MIN(grid->xmin, p->x);  xmax = MAX(xmax, p->x);
+         grid->ymin = MIN(grid->ymin, p->y);  ymax = MAX(ymax, p->y);
+         grid->zmin = MIN(grid->zmin, p->z);  zmax = MAX(zmax, p->z);
+         n++;
+      }
+   }
+   grid->nAtoms = n;
+
+   for(;;)
+   {
+      grid->nx = 1 + (int)((xmax - grid->xmin) / grid->cellSize);
+      grid->ny = 1 + (int)((ymax - grid->ymin) / grid->cellSize);
+      grid->nz = 1 + (int)((zmax - grid->zmin) / grid->cellSize);
+      if((double)grid->nx * grid->ny * grid->nz <= MAXCELLS)
+         break;
+      grid->cellSize *= 2;
+   }
+   nCells = grid->nx * grid->ny * grid->nz;
+
+   if(((grid->atoms    = (PDB **)malloc((n+1) * sizeof(PDB *)))==NULL) ||
+      ((grid->atomRes  = (int *)malloc((n+1) * sizeof(int)))==NULL)    ||
+      ((grid->atomNext = (int *)malloc((n+1) * sizeof(int)))==NULL)    ||
+      ((grid->cellHead = (int *)malloc(nCells * sizeof(int)))==NULL))
+      return(FALSE);
+   
+   for(i=0; i<nCells; i++)
+      grid->cellHead[i] = (-1);
+
+   for(i=0, n=0; i<nRes; i++)
+   {
+      if(residues[i].cdr != NOCDR)
+         continue;
+      
+      for(p=residues[i].start; p!=residues[i].stop; NEXT(p))
+      {
+         int ix   = (int)((p->x - grid->xmin) / grid->cellSize),
+             iy   = (int)((p->y - grid->ymin) / grid->cellSize),
+             iz   = (int)((p->z - grid->zmin) / grid->cellSize),
+             cell = (iz * grid->ny + iy) * grid->nx + ix;
+
+         grid->atoms[n]      = p;
+         grid->atomRes[n]    = i;
+         grid->atomNext[n]   = grid->cellHead[cell];
+         grid->cellHead[cell] = n;
+         n++;
+      }
+   }
    
+   return(TRUE);
+}
+
+
+/************************************************************************/
+/*>void FreeAtomGrid(ATOMGRID *grid)
+   ---------------------------------
+   16.10.26   Original   By: agent
+*/
+void FreeAtomGrid(ATOMGRID *grid)
+{
+   if(grid->atoms    != NULL) free(grid->atoms);
+   if(grid->atomRes  != NULL) free(grid->atomRes);
+   if(grid->atomNext != NULL) free(grid->atomNext);
+   if(grid->cellHead != NULL) free(grid->cellHead);
+   memset(grid, 0, sizeof(ATOMGRID));
+}
+
+
+/************************************************************************/
+/*>int FindNeighbourResidues(ATOMGRID *grid, RESIDUE *res, int resIndex,
+                             int *mark, int *nbrs)
+   ---------------------------------------------------------------------
+   Input:   ATOMGRID *grid      Framework atom grid
+            RESIDUE  *res       CDR residue
+            int      resIndex   Index of the CDR residue
+   I/O:     int      *mark      Per-residue flags. Set to resIndex for
+                                each residue found
+   Output:  int      *nbrs      Indexes of the framework residues
+   Returns: int                 Number of framework residues
+
+   Finds the framework residues with an atom in a grid cell next to one
+   of the atoms of the CDR residue. This includes every residue which
+   could be within the cutoff used to size the grid.
+
+   16.10.26   Original   By: agent
+*/
+int FindNeighbourResidues(ATOMGRID *grid, RESIDUE *res, int resIndex,
+                          int *mark, int *nbrs)
+{
+   PDB *p;
+   int nNbrs = 0;
+
+   if(grid->nAtoms == 0)
+      return(0);
    
-   for(p=pdb; p!=NULL; p=nextPRes)
+   for(p=res->start; p!=res->stop; NEXT(p))
    {
-      if(InCDR(p, cdrs, theCDR))
+      int ix = (int)floor((p->x - grid->xmin) / grid->cellSize),
+          iy = (int)floor((p->y - grid->ymin) / grid->cellSize),
+          iz = (int)floor((p->z - grid->zmin) / grid->cellSize),
+          x, y, z;
+
+      for(z=MAX(iz-1, 0); z<=MIN(iz+1, grid->nz-1); z++)
       {
-         for(q=pdb; q!=NULL; q=nextQRes)
+         for(y=MAX(iy-1, 0); y<=MIN(iy+1, grid->ny-1); y++)
          {
-            if(!InCDR(q, cdrs, NULL))
+            for(x=MAX(ix-1, 0); x<=MIN(ix+1, grid->nx-1); x++)
             {
-               if((theDist=MakesContact(p, q, distSq)) >= (REAL)0.0)
+               int a;
+               
+               for(a=grid->cellHead[(z * grid->ny + y) * grid->nx + x];
+                   a >= 0;
+                   a=grid->atomNext[a])
                {
-                  fprintf(out, "%s %s%d%s %s contacts %s%d%s %s : %.2f\n",
-                          theCDR, 
-                          p->chain, p->resnum, p->insert, p->resnam,
-                          q->chain, q->resnum, q->insert, q->resnam,
-                          theDist);
+                  int r = grid->atomRes[a];
+                  
+                  if(mark[r] != resIndex)
+                  {
+                     mark[r]       = resIndex;
+                     nbrs[nNbrs++] = r;
+                  }
                }
             }
-            nextQRes = blFindNextResidue(q);
          }
       }
-      nextPRes = blFindNextResidue(p);
    }
+
+   return(nNbrs);
+}
+
+
+/************************************************************************/
+/*>int CompareInts(const void *a, const void *b)
+   ---------------------------------------------
+   qsort() comparison function for integers
+
+   16.10.26   Original   By: agent
+*/
+int CompareInts(const void *a, const void *b)
+{
+   int i = *(const int *)a,
+       j = *(const int *)b;
+
+   return((i > j) - (i < j));
+}
+
+
+/************************************************************************/
+/*>RESIDUE *LabelResidues(PDB *pdb, ZONE *cdrs, int *nRes)
+   -------------------------------------------------------
+   Input:   PDB     *pdb      PDB linked list
+            ZONE    *cdrs     CDR zones (parsed by ParseZones())
+   Output:  int     *nRes     Number of residues
+   Returns: RESIDUE *         Malloc'd array of residues (NULL if no 
+                              memory or no atoms)
+
+   Builds an array of the residues in the structure, each labelled with
+   the CDR in which it lies
+
+   16.10.26   Original   By: agent
+*/
+RESIDUE *LabelResidues(PDB *pdb, ZONE *cdrs, int *nRes)
+{
+   RESIDUE *residues;
+   PDB     *p;
+   int     n = 0;
+
+   *nRes = 0;
+   for(p=pdb; p!=NULL; p=blFindNextResidue(p))
+      n++;
+   if((n == 0) ||
+      ((residues = (RESIDUE *)malloc(n * sizeof(RESIDUE)))==NULL))
+      return(NULL);
+
+   for(p=pdb; p!=NULL; p=residues[*nRes].stop, (*nRes)++)
+   {
+      residues[*nRes].start = p;
+      residues[*nRes].stop  = blFindNextResidue(p);
+      residues[*nRes].cdr   = FindCDR(p, cdrs);
+   }
+
+   return(residues);
 }
 
 
 /************************************************************************/
-/*>REAL MakesContact(PDB *res1, PDB *res2, REAL distSq)
-   ----------------------------------------------------
+/*>REAL MakesContact(RESIDUE *res1, RESIDUE *res2, REAL distSq)
+   --------------------------------------------------------------
+   Returns the minimum distance between the two residues, ignoring atom
+   pairs close enough to be bonded, or -1 if this is over the cutoff
+
    16.11.14   Original   By: ACRM
+   16.10.26   Takes RESIDUEs so the end of each residue is already known
+              By: agent
 */
-REAL MakesContact(PDB *res1, PDB *res2, REAL distSq)
+REAL MakesContact(RESIDUE *res1, RESIDUE *res2, REAL distSq)
 {
-   PDB *nextPRes = NULL,
-       *nextQRes = NULL,
-       *p, *q;
+   PDB *p, *q;
    REAL minDistSq  = (REAL)(100000.0);
    
-   nextPRes = blFindNextResidue(res1);
-   nextQRes = blFindNextResidue(res2);
-
-   for(p=res1; p!=nextPRes; NEXT(p))
+   for(p=res1->start; p!=res1->stop; NEXT(p))
    {
-      for(q=res2; q!=nextQRes; NEXT(q))
+      for(q=res2->start; q!=res2->stop; NEXT(q))
       {
          REAL d;
          d = DISTSQ(p, q);
@@ -240,50 +992,65 @@ REAL MakesContact(PDB *res1, PDB *res2, REAL distSq)
 
 
 /************************************************************************/
-/*>BOOL InCDR(PDB *p, ZONE *cdrs, char *theCDR)
-   --------------------------------------------
-   16.11.14   Original   By: ACRM
+/*>int FindCDR(PDB *p, ZONE *cdrs)
+   -------------------------------
+   Input:   PDB    *p        Residue
+            ZONE   *cdrs     CDR zones (parsed by ParseZones())
+   Returns: int              Index of the CDR containing the residue or
+                             NOCDR
+
+   16.11.14   Original (as InCDR())   By: ACRM
    03.12.14   Sets theCDR
+   16.10.26   Renamed and returns the CDR index. Uses the zone 
+              boundaries from ParseZones()   By: agent
 */
-BOOL InCDR(PDB *p, ZONE *cdrs, char *theCDR)
+int FindCDR(PDB *p, ZONE *cdrs)
 {
    int i;
    for(i=0; cdrs[i].start[0]; i++)
    {
-      if(InPDBZoneSpec(p, cdrs[i].start, cdrs[i].stop))
+      if(blInPDBZone(p, cdrs[i].chain, 
+                     cdrs[i].startResnum, cdrs[i].startInsert,
+                     cdrs[i].stopResnum,  cdrs[i].stopInsert))
       {
-         if(theCDR != NULL)
-            strncpy(theCDR, cdrs[i].cdr, MAXLABEL);
-         return(TRUE);
+         return(i);
       }
    }
-   return(FALSE);
+   return(NOCDR);
 }
 
 
 /************************************************************************/
-/*>BOOL InPDBZoneSpec(PDB *p, char *start, char *stop)
-   ---------------------------------------------------
-   16.11.14   Original   By: ACRM
+/*>void ParseZones(ZONE *cdrs)
+   ---------------------------
+   I/O:     ZONE   *cdrs     CDR zones
+
+   Parses the start and stop residue specifications of each zone so they
+   need not be parsed again for every residue
+
+   16.11.14   Original (as InPDBZoneSpec())   By: ACRM
+   16.10.26   Parses all the zones once   By: agent
 */
-BOOL InPDBZoneSpec(PDB *p, char *start, char *stop)
+void ParseZones(ZONE *cdrs)
 {
-   int  startResnum,    stopResnum;
-   char startChain[8],  stopChain[8],
-        startInsert[8], stopInsert[8];
-   
-   blParseResSpec(start, startChain, &startResnum, startInsert);
-   blParseResSpec(stop,  stopChain,  &stopResnum,  stopInsert);
-   
-   return(blInPDBZone(p, startChain, startResnum, startInsert,
-                                     stopResnum,  stopInsert));
+   int  i;
+   char stopChain[8];
+
+   for(i=0; cdrs[i].start[0]; i++)
+   {
+      blParseResSpec(cdrs[i].start, cdrs[i].chain, 
+                     &(cdrs[i].startResnum), cdrs[i].startInsert);
+      blParseResSpec(cdrs[i].stop,  stopChain,
+                     &(cdrs[i].stopResnum),  cdrs[i].stopInsert);
+   }
 }
 
 
 
 /************************************************************************/
 /*>BOOL ParseCmdLine(int argc, char **argv, char *infile, char *outfile,
-                  REAL *dist, BOOL *doResList)
+                  REAL *dist, BOOL *doResList, char *listFile,
+                  int *nThreads)
    ---------------------------------------------------------------------
    Input:   int    argc         Argument count
             char   **argv       Argument array
@@ -296,14 +1063,17 @@ BOOL InPDBZoneSpec(PDB *p, char *start, char *stop)
    05.11.07 Added first check that at least one parameter is on the
             command line
    04.12.14 Added doResList
+   16.10.26 Added -l and -j. With -l, the only file on the command line
+            is the output file   By: agent
 */
 BOOL ParseCmdLine(int argc, char **argv, char *infile, char *outfile,
-                  REAL *dist, BOOL *doResList)
+                  REAL *dist, BOOL *doResList, char *listFile,
+                  int *nThreads)
 {
    argc--;
    argv++;
 
-   infile[0] = outfile[0] = '\0';
+   infile[0] = outfile[0] = listFile[0] = '\0';
    *dist     = DEF_DISTCUT;
 
    while(argc)
@@ -323,6 +1093,23 @@ BOOL ParseCmdLine(int argc, char **argv, char *infile, char *outfile,
             argv++;
             sscanf(argv[0], "%lf", dist);
             break;
+         case 'l':
+            argc--;
+            argv++;
+            if(!argc)
+               return(FALSE);
+            strncpy(listFile, argv[0], MAXBUFF);
+            listFile[MAXBUFF-1] = '\0';
+            break;
+         case 'j':
+            argc--;
+            argv++;
+            if(!argc || !sscanf(argv[0], "%d", nThreads) ||
+               (*nThreads < 1))
+               return(FALSE);
+            if(*nThreads > MAXTHREADS)
+               *nThreads = MAXTHREADS;
+            break;
          default:
             return(FALSE);
             break;
@@ -330,6 +1117,13 @@ BOOL ParseCmdLine(int argc, char **argv, char *infile, char *outfile,
       }
       else
       {
+         /* In batch mode the only file is the output file              */
+         if(listFile[0])
+         {
+            strcpy(outfile, argv[0]);
+            return(argc == 1);
+         }
+         
          /* Copy the first to infile                                    */
          if(argc)
          {
@@ -360,18 +1154,30 @@ BOOL ParseCmdLine(int argc, char **argv, char *infile, char *outfile,
 /*>void Usage(void)
    ----------------
    16.11.14   Original   By: ACRM
+   16.10.26   Added -l and -j   By: agent
 */
 void Usage(void)
 {
    fprintf(stderr,"\n");
-   fprintf(stderr,"cdrcontacts V1.1 (c) 2014, Dr. Andrew C.R. Martin\n");
+   fprintf(stderr,"cdrcontacts V1.4 (c) 2014-2026, Dr. Andrew C.R. \
+Martin\n");
 
    fprintf(stderr,"\nUsage: cdrcontacts [-d dist] [-r] [in.pdb \
 [outfile]]\n");
    fprintf(stderr,"       -d  Specify contact distance [Default: %.2f]\n",
            DEF_DISTCUT);
    fprintf(stderr,"       -r  Output the complete residue list too\n");
+   fprintf(stderr,"\n       cdrcontacts [-d dist] [-r] [-j n] -l \
+filelist|directory [outfile]\n");
+   fprintf(stderr,"       -l  Analyse each PDB file in a list (one per \
+line) or directory\n");
+   fprintf(stderr,"       -j  Number of threads used with -l [1]\n");
 
    fprintf(stderr,"\nFind contacts between CDRs and framework in an \
-antibody\n\n");
+antibody\n");
+   fprintf(stderr,"\nWith -l, each output line starts with the name of \
+the PDB file and the\n");
+   fprintf(stderr,"files are reported in the order of the list (or \
+alphabetical order for a\n");
+   fprintf(stderr,"directory).\n\n");
 }
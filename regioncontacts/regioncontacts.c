@@ -3,8 +3,8 @@
    Program:    regioncontacts
    File:       regioncontacts.c
    
-   Version:    V1.2
-   Date:       04.11.14
+   Version:    V1.8
+   Date:       16.10.26
    Function:   Analyse contacts between regions of structure (typically
                loops).
    
@@ -54,13 +54,29 @@
                   Keywords generalized to regions of structure rather 
                   than loops.
                   Added option to specify contact cutoff distance
+   V1.3  16.10.26 Contacts and residue counts are kept in hash tables
+                  keyed by packed residue ids rather than linked lists
+   V1.4  16.10.26 Added -j to analyse the PDB files on several threads
+   V1.5  16.10.26 Region pairs are culled by bounding box and contacts
+                  found with a grid of each region's atoms
+   V1.6  16.10.26 Contacts are found residue against residue, rejecting
+                  pairs by bounding sphere and stopping at the first 
+                  contacting atom pair
+   V1.7  16.10.26 Added -c to cache the results for each PDB file
+   V1.8  16.10.26 Added -m to write the contacts as a binary sparse 
+                  matrix
 
 *************************************************************************/
 /* Includes
 */
+#define _POSIX_C_SOURCE 200112L
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include <math.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <sys/types.h>
 #include "bioplib/MathType.h"
 #include "bioplib/MathUtil.h"
 #include "bioplib/SysDefs.h"
@@ -89,32 +105,154 @@
 
 #define MAXBUFF              160
 #define DISTMAX              ((REAL)4.0)
+#define TABLEQUANTUM         64    /* Initial size of a hash table       */
+#define MAXTHREADS           256
+#define MAXBATCH             256   /* PDB files analysed together        */
+#define MINCELLSIZE          ((REAL)1.0)
+#define CACHEMAGIC           "RCCACHE1" /* Identifies a cache entry      */
+#define HASHBUFF             8192
+#define MATRIXMAGIC          "RCMATRX1" /* Identifies a contact matrix   */
+#define MATRIXIDLEN          8     /* Residue id length in the matrix    */
+#define PAD8(x)              (((x) + 7) & ~7L)
+#define RADSLACK             ((REAL)0.001) /* Rounding allowance on 
+                                              residue radii           */
+#define MAXCELLS             1000000
+#define CELLINDEX(g, ix, iy, iz) ((ix) + (g)->nx * ((iy) + (g)->ny * (iz)))
+#define EMPTYSLOT            (-1)
+
+/* Residue ids are packed as chain (8 bits), insert (8 bits) and the 
+   residue number (16 bits)
+*/
+#define RESKEY_CHAIN(k)      ((char)(((k) >> 24) & 0xFF))
+#define RESKEY_INSERT(k)     ((char)(((k) >> 16) & 0xFF))
+#define RESKEY_RESNUM(k)     ((int)((k) & 0xFFFF) - \
+                              (((k) & 0x8000) ? 0x10000 : 0))
 
 typedef struct _region
 {
    struct _region *next;
-   PDB  *start,
-        *end;
    char startres[16],
         endres[16];
 }  REGION;
 
-typedef struct _contact
+typedef struct
+{
+   PDB  *start,                  /* First atom of a region in a file     */
+        *end;                    /* Atom after the region                */
+}  ZONE;
+
+typedef struct
+{
+   PDB  **atoms;                 /* Atoms of the zone in list order      */
+   REAL *resX, *resY, *resZ,     /* Residue centres                      */
+        *resRad,                 /* Residue bounding sphere radii        */
+        xmin, ymin, zmin,        /* Bounding box of the atoms            */
+        xmax, ymax, zmax,
+        maxRad,
+        cellSize;
+   int  *resStart,               /* First atom of each residue (nRes+1)  */
+        *cellHead,               /* First residue in each cell (-1 none) */
+        *resNext,                /* Next residue in the same cell        */
+        nAtoms,
+        nRes,
+        nx, ny, nz;
+}  ZONEGRID;
+
+typedef struct
+{
+   int p, q;                     /* First contacting atoms of a residue 
+                                    pair                                 */
+}  RESCONTACT;
+
+typedef struct
+{
+   char          magic[8];       /* CACHEMAGIC                           */
+   unsigned long hash[2];        /* Key from ContentKey()                */
+   REAL          distSqMax;
+   int           keySize,        /* sizeof(RESKEY)                       */
+                 nRes,           /* Entries in each of the tables which  */
+                 nContacts,      /* follow                               */
+                 nCRes;
+}  CACHEHEADER;
+
+typedef struct
+{
+   char magic[8];                /* MATRIXMAGIC                          */
+   int  nRes,                    /* Residue ids in the dictionary        */
+        nPairs,                  /* Contacting residue pairs             */
+        nFiles,
+        nFileContacts,           /* Sum of the contacts in each file     */
+        idLen,                   /* MATRIXIDLEN                          */
+        nameLen;                 /* PARSER_MAXSTRLEN                     */
+   long dictOffset,              /* char[nRes][idLen]    residue ids     */
+        resCountOffset,          /* int[nRes]            occurrences     */
+        rowPtrOffset,            /* int[nRes+1]          CSR rows        */
+        colOffset,               /* int[nPairs]          CSR columns     */
+        countOffset,             /* int[nPairs]          files in contact*/
+        freqOffset,              /* float[nPairs]        frequency       */
+        fileNameOffset,          /* char[nFiles][nameLen] file names     */
+        fileRowPtrOffset,        /* int[nFiles+1]        CSR rows        */
+        filePairOffset;          /* int[nFileContacts]   pair indexes    */
+}  MATRIXHEADER;
+
+typedef struct
+{
+   int row, col, count;
+}  MATRIXENTRY;
+
+typedef unsigned long RESKEY;
+
+typedef struct
 {
-   struct _contact *next;
-   char res1[16],
-        res2[16];
-   BOOL done;
-   int  count;
+   RESKEY res1,
+          res2;
+   int    count;
 }  CONTACT;
 
-typedef struct _reslist
+typedef struct
 {
-   struct _reslist *next;
-   char res[16];
-   int count;
+   RESKEY res;
+   int    count;
 }  RESLIST;
 
+typedef struct
+{
+   CONTACT *items;               /* Contacts in the order first stored   */
+   int     *slots,               /* Open addressed index into items      */
+           nItems,
+           maxItems,
+           nSlots;
+}  CONTACTTABLE;
+
+typedef struct
+{
+   RESLIST *items;               /* Residues in the order first stored   */
+   int     *slots,               /* Open addressed index into items      */
+           nItems,
+           maxItems,
+           nSlots;
+}  RESTABLE;
+
+typedef struct
+{
+   char         filename[PARSER_MAXSTRLEN],
+                *error;          /* Why the file failed (NULL if OK)     */
+   ZONE         *zones;          /* Where each region lies in the file   */
+   CONTACTTABLE contacts;        /* Contacts made in the file            */
+   RESTABLE     resList,         /* Residues seen in the regions         */
+                cResList;        /* Residues making contacts             */
+   BOOL         gotAtoms;
+}  FILEJOB;
+
+typedef struct
+{
+   FILEJOB         *jobs;
+   int             nJobs,
+                   nextJob;      /* Next file to be handed out           */
+   pthread_mutex_t lock,
+                   readLock;     /* Serialises ReadPDB()                 */
+}  WORKQUEUE;
+
 
 /************************************************************************/
 /* Globals
@@ -123,13 +261,22 @@ static MKeyWd sKeyWords[PARSER_NCOMM];         /* Parser keywords       */
 static char   *sStrParam[PARSER_MAXSTRPARAM];  /* Parser string params  */
 static REAL   sRealParam[PARSER_MAXREALPARAM], /* Parser real params    */
               gDistSqMax = DISTMAX * DISTMAX;
-static int     gRegionCount = 0;
+static int     gRegionCount = 0,
+               gNRegions    = 0,
+               gNThreads    = 1;
 static REGION  *gRegions    = NULL;
-static CONTACT *gContacts = NULL,
-               *gTotal    = NULL;
-static RESLIST *gResList  = NULL,
-               *gCResList = NULL,
-               *gCRTotal  = NULL;
+static CONTACTTABLE gTotal;
+static RESTABLE     gResList,
+                    gCRTotal;
+static FILEJOB      gBatch[MAXBATCH];
+static int          gNBatch     = 0;
+static char         gCacheDir[MAXBUFF] = "",
+                    gMatrixFile[MAXBUFF] = "",
+                    (*gFileNames)[PARSER_MAXSTRLEN] = NULL;
+static FILE         *gFileContactsFp = NULL; /* Per-file contacts for -m */
+static int          *gFileRowPtr     = NULL,
+                    gNFiles          = 0,
+                    gMaxFiles        = 0;
 
 
 /************************************************************************/
@@ -140,21 +287,51 @@ BOOL ParseCmdLine(int argc, char **argv, char *infile, char *outfile);
 BOOL SetupParser(void);
 BOOL ProcessInFile(FILE *in, FILE *out);
 BOOL StoreRegion(char *startres, char *endres);
-void PatchRegions(PDB *pdb);
+void PatchRegions(PDB *pdb, ZONE *zones);
 BOOL ProcessFile(FILE *out, char *filename);
-BOOL UpdateResCounts(void);
-BOOL DoContactAnalysis(FILE *out);
-void ClearContacts(void);
-BOOL StoreContact(PDB *p, PDB *q);
-void DisplayContacts(FILE *out, CONTACT *clist, REAL cutoff);
-void DisplayReslist(FILE *out, RESLIST *rlist, REAL cutoff);
-BOOL UpdateTotals(void);
-CONTACT *GotContact(char *resspec1, char *resspec2, CONTACT *clist);
+void AnalyseFile(FILEJOB *job, pthread_mutex_t *readLock);
+BOOL MergeFile(FILE *out, FILEJOB *job);
+BOOL QueueFile(FILE *out, char *filename);
+void FlushBatch(FILE *out);
+void *FileWorker(void *arg);
+void InitFileJob(FILEJOB *job, char *filename);
+void FreeFileJob(FILEJOB *job);
+BOOL UpdateResCounts(FILEJOB *job);
+BOOL DoContactAnalysis(FILEJOB *job);
+BOOL FindZoneContacts(FILEJOB *job, ZONEGRID *g1, ZONEGRID *g2, 
+                      int *nbrs, RESCONTACT *found);
+BOOL FirstResContact(ZONEGRID *g1, int res1, ZONEGRID *g2, int res2,
+                     RESCONTACT *found);
+BOOL BuildZoneGrid(ZONE *zone, ZONEGRID *grid);
+void FreeZoneGrid(ZONEGRID *grid);
+int CompareInts(const void *a, const void *b);
+int CompareResContacts(const void *a, const void *b);
+void ClearContacts(FILEJOB *job);
+BOOL StoreContact(FILEJOB *job, PDB *p, PDB *q);
+void DisplayContacts(FILE *out, CONTACTTABLE *clist, REAL cutoff);
+void DisplayReslist(FILE *out, RESTABLE *rlist, REAL cutoff);
+BOOL UpdateTotals(FILEJOB *job);
+CONTACT *GotContact(RESKEY res1, RESKEY res2, CONTACTTABLE *clist);
+CONTACT *AddContact(RESKEY res1, RESKEY res2, CONTACTTABLE *clist);
 void Usage(void);
-RESLIST *InResList(char *rspec, RESLIST *rlist);
-int CountRes(char *rspec);
-char *PDBResSpec(PDB *p);
-BOOL StoreCRes(PDB *p);
+RESLIST *InResList(RESKEY res, RESTABLE *rlist);
+RESLIST *AddRes(RESKEY res, RESTABLE *rlist);
+int CountRes(RESKEY res);
+RESKEY PDBResKey(PDB *p);
+char *ResKeySpec(RESKEY res);
+unsigned long HashResKey(RESKEY res);
+int *MakeSlots(int nSlots);
+BOOL StoreCRes(FILEJOB *job, PDB *p);
+BOOL ContentKey(FILE *fp, unsigned long *hash);
+void HashBytes(unsigned long *hash, unsigned char *bytes, int nBytes);
+void CacheFileName(unsigned long *hash, char *filename);
+BOOL ReadCache(FILEJOB *job, unsigned long *hash);
+void WriteCache(FILEJOB *job, unsigned long *hash);
+BOOL RecordFileContacts(FILEJOB *job);
+BOOL WriteMatrix(char *filename);
+BOOL WriteMatrixBlock(FILE *fp, void *data, int size, int n);
+int ResIndex(RESKEY res);
+int CompareMatrixEntries(const void *a, const void *b);
 
 
 /************************************************************************/
@@ -163,6 +340,7 @@ BOOL StoreCRes(PDB *p);
    Main program for counting interregion contacts
 
    25.09.96 Original   By: ACRM
+   16.10.26 Writes the contact matrix   By: agent
 */
 int main(int argc, char **argv)
 {
@@ -179,7 +357,11 @@ int main(int argc, char **argv)
          if(OpenStdFiles(infile, outfile, &in, &out))
          {
             if(ProcessInFile(in, out))
+            {
+               if(gMatrixFile[0] && !WriteMatrix(gMatrixFile))
+                  return(1);
                return(0);
+            }
          }
       }
       return(1);
@@ -201,9 +383,14 @@ int main(int argc, char **argv)
             char   *outfile     Output file (or blank string)
    Returns: BOOL                Success?
 
-   Parse the command line
+   Parse the command line. The number of threads (-j) is stored in 
+   gNThreads, the cache directory (-c) in gCacheDir and the matrix file
+   (-m) in gMatrixFile.
    
    25.09.96 Original    By: ACRM
+   16.10.26 Added -j    By: agent
+   16.10.26 Added -c    By: agent
+   16.10.26 Added -m    By: agent
 */
 BOOL ParseCmdLine(int argc, char **argv, char *infile, char *outfile)
 {
@@ -218,6 +405,33 @@ BOOL ParseCmdLine(int argc, char **argv, char *infile, char *outfile)
       {
          switch(argv[0][1])
          {
+         case 'j':
+            argc--;
+            argv++;
+            if(!argc)
+               return(FALSE);
+            if((sscanf(argv[0], "%d", &gNThreads) != 1) || 
+               (gNThreads < 1))
+               return(FALSE);
+            if(gNThreads > MAXTHREADS)
+               gNThreads = MAXTHREADS;
+            break;
+         case 'c':
+            argc--;
+            argv++;
+            if(!argc)
+               return(FALSE);
+            strncpy(gCacheDir, argv[0], MAXBUFF);
+            gCacheDir[MAXBUFF-1] = '\0';
+            break;
+         case 'm':
+            argc--;
+            argv++;
+            if(!argc)
+               return(FALSE);
+            strncpy(gMatrixFile, argv[0], MAXBUFF);
+            gMatrixFile[MAXBUFF-1] = '\0';
+            break;
          case 'h':
          default:
             return(FALSE);
@@ -315,6 +529,8 @@ BOOL SetupParser(void)
 
    25.09.96 Original   By: ACRM
    01.10.96 Removed unused variable
+   16.10.26 With -j, runs of PDB commands are queued and analysed
+            together before the next command   By: agent
 */
 BOOL ProcessInFile(FILE *in, FILE *out)
 {
@@ -332,12 +548,15 @@ BOOL ProcessInFile(FILE *in, FILE *out)
 
       if(!upstrncmp(buffer,"ECHO",4))
       {
+         FlushBatch(out);
          fprintf(out,"%s\n",buffer+5);
       }
       else
       {
          key = mparse(buffer, PARSER_NCOMM, sKeyWords, sRealParam,
                       sStrParam, &NParams);
+         if((key != KEY_PDB) && (key != PARSE_COMMENT))
+            FlushBatch(out);
 
          switch(key)
          {
@@ -372,7 +591,7 @@ before any PDB commands\n");
                     sRealParam[0]);
             fprintf(out,"===============================\n");
             
-            DisplayContacts(out, gTotal, sRealParam[0]);
+            DisplayContacts(out, &gTotal, sRealParam[0]);
             break;
          case KEY_RESIDUES:
             fprintf(out,"----------------------------------------------\
@@ -381,18 +600,18 @@ before any PDB commands\n");
                     sRealParam[0]);
             fprintf(out,"==========================================\n");
             
-            DisplayReslist(out, gCRTotal, sRealParam[0]);
+            DisplayReslist(out, &gCRTotal, sRealParam[0]);
             break;
          case KEY_EXIT:
             fprintf(out,"\n--------------------------------------------\
 ------------------------------\n");
             fprintf(out,"Summary Contacts\n================\n");
-            DisplayContacts(out, gTotal, (REAL)(-1.0));
+            DisplayContacts(out, &gTotal, (REAL)(-1.0));
             fprintf(out,"\n--------------------------------------------\
 ------------------------------\n");
             fprintf(out,"Summary Contacting Residues\n=================\
 ==========\n");
-            DisplayReslist(out, gCRTotal, (REAL)(-1.0));
+            DisplayReslist(out, &gCRTotal, (REAL)(-1.0));
             return(TRUE);
             break;
          case KEY_QUIT:
@@ -400,7 +619,15 @@ before any PDB commands\n");
             break;
          case KEY_PDB:
             gotPDB = TRUE;
-            if(!ProcessFile(out, sStrParam[0]))
+            if(gNThreads > 1)
+            {
+               if(!QueueFile(out, sStrParam[0]))
+               {
+                  fprintf(stderr,"No memory for PDB file queue\n");
+                  return(FALSE);
+               }
+            }
+            else if(!ProcessFile(out, sStrParam[0]))
             {
                fprintf(stderr,"Error processing PDB file: %s\n",
                        sStrParam[0]);
@@ -413,6 +640,7 @@ before any PDB commands\n");
       PROMPT(in,"RegionContacts> ");
    }  
 
+   FlushBatch(out);
    return(TRUE);
 }
 
@@ -447,30 +675,35 @@ BOOL StoreRegion(char *startres, char *endres)
    
    strncpy(p->startres, startres, 16);
    strncpy(p->endres,   endres,   16);
+   gNRegions++;
    
    return(TRUE);
 }
 
 
 /************************************************************************/
-/*>void PatchRegions(PDB *pdb)
-   ---------------------------
-   Patches the actual PDB pointers into the linked list of regions.
+/*>void PatchRegions(PDB *pdb, ZONE *zones)
+   ----------------------------------------
+   Finds where each region lies in a PDB linked list, storing the PDB
+   pointers in zones[], which has an entry for each region.
 
    25.09.96 Original   By: ACRM
+   16.10.26 Stores the pointers in zones[] rather than the region list
+            so several files can be patched at once   By: agent
 */
-void PatchRegions(PDB *pdb)
+void PatchRegions(PDB *pdb, ZONE *zones)
 {
    REGION *r;
+   ZONE   *z;
    PDB    *p;
    BOOL   found;
 
    
    /* Go through each of the region specifications                        */
-   for(r=gRegions; r!=NULL; NEXT(r))
+   for(r=gRegions, z=zones; r!=NULL; NEXT(r), z++)
    {
       /* Set the PDB pointers to NULLs                                  */
-      r->start = r->end = NULL;
+      z->start = z->end = NULL;
       found = FALSE;
 
       /* Run through the PDB linked list                                */
@@ -480,11 +713,11 @@ void PatchRegions(PDB *pdb)
          if(InPDBZoneSpec(p, r->startres, r->endres))
          {
             /* Store start of zone                                      */
-            if(r->start == NULL)
-               r->start = p;
+            if(z->start == NULL)
+               z->start = p;
 
             /* Update end of zone                                       */
-            r->end = p;
+            z->end = p;
             found  = TRUE;
          }
          else
@@ -501,8 +734,8 @@ void PatchRegions(PDB *pdb)
       /* Step the end of zone on so that we can use a simple not-equal
          test
       */
-      if(r->end != NULL)
-         r->end = r->end->next;
+      if(z->end != NULL)
+         z->end = z->end->next;
       
    }  /* Loop through ranges                                            */
 }
@@ -512,533 +745,1865 @@ void PatchRegions(PDB *pdb)
 /*>BOOL ProcessFile(FILE *out, char *filename)
    -------------------------------------------
    Process a PDB file. The region zone specifications must already have
-   been given. Opens and reads the specified PDB file. Calls code to
-   patch the PDB pointers into the linked list of region specifications.
-   Calls code to update the counts of each residue number found within
-   the regions then does the contact analysis and frees the PDB
-   linked list.
+   been given. The file is analysed by AnalyseFile() and the results 
+   are added to the totals by MergeFile().
 
    25.09.96 Original   By: ACRM
+   16.10.26 Split into AnalyseFile() and MergeFile()   By: agent
 */
 BOOL ProcessFile(FILE *out, char *filename)
 {
-   FILE *fp;
-   PDB  *pdb;
-   BOOL retval = TRUE;
-   int  natoms;
+   FILEJOB job;
+   BOOL    retval;
+
+   InitFileJob(&job, filename);
+   AnalyseFile(&job, NULL);
+   retval = MergeFile(out, &job);
+   FreeFileJob(&job);
+   
+   return(retval);
+}
+
+
+/************************************************************************/
+/*>void AnalyseFile(FILEJOB *job, pthread_mutex_t *readLock)
+   ---------------------------------------------------------
+   Input:   pthread_mutex_t *readLock  Lock held while reading the PDB
+                                       file (NULL if unthreaded)
+   I/O:     FILEJOB         *job       The file to analyse and its
+                                       results
+
+   Opens and reads the PDB file for a job. Finds where the regions lie
+   in it, counts the residues in each region and does the contact 
+   analysis, all into the job's own tables so that several files can be
+   analysed at once. Nothing is printed; any error is left in 
+   job->error.
+
+   With a cache directory, the results are taken from the cache if 
+   there is an entry for the file's contents, regions and cutoff, and
+   are otherwise stored there after the analysis.
+
+   16.10.26 Original (from ProcessFile())   By: agent
+   16.10.26 Uses the cache   By: agent
+*/
+void AnalyseFile(FILEJOB *job, pthread_mutex_t *readLock)
+{
+   FILE          *fp;
+   PDB           *pdb;
+   unsigned long hash[2];
+   int           natoms;
+   BOOL          useCache = FALSE;
 
    
    /* Open and read PDB file                                            */
-   if((fp=fopen(filename,"r"))==NULL)
+   if((fp=fopen(job->filename,"r"))==NULL)
    {
-      fprintf(stderr,"Unable to open file\n");
-      return(FALSE);
+      job->error = "Unable to open file";
+      return;
    }
-   if((pdb=ReadPDB(fp, &natoms))==NULL)
+
+   /* See if the results are cached                                     */
+   if(gCacheDir[0] && ContentKey(fp, hash))
    {
-      fprintf(stderr,"No atoms read\n");
-      fclose(fp);
-      return(FALSE);
+      if(ReadCache(job, hash))
+      {
+         fclose(fp);
+         return;
+      }
+      useCache = TRUE;
    }
+   rewind(fp);
+   
+   if(readLock != NULL)
+      pthread_mutex_lock(readLock);
+   pdb = ReadPDB(fp, &natoms);
+   if(readLock != NULL)
+      pthread_mutex_unlock(readLock);
    fclose(fp);
+   if(pdb==NULL)
+   {
+      job->error = "No atoms read";
+      return;
+   }
 
-   gRegionCount++;
+   job->gotAtoms = TRUE;
 
-   /* Patch the PDB pointers into the linked list of regions              */
-   PatchRegions(pdb);
+   if((gNRegions > 0) &&
+      ((job->zones = (ZONE *)malloc(gNRegions * sizeof(ZONE)))==NULL))
+   {
+      job->error = "No memory to store contact data";
+      FREELIST(pdb, PDB);
+      return;
+   }
+
+   /* Find the regions in the PDB linked list                           */
+   PatchRegions(pdb, job->zones);
    
-   /* Update the counts for each residue number so we can calculate
-      percentages later
-   */
-   UpdateResCounts();
+   /* Count each residue number so we can calculate percentages later   */
+   if(!UpdateResCounts(job))
+      job->error = "No memory to store residue counts";
 
    /* Perform the contact analysis                                      */
-   if(!DoContactAnalysis(out))
-      retval = FALSE;
+   else if(!DoContactAnalysis(job))
+      job->error = "No memory to store contact data";
 
    /* Free the PDB linked list                                          */
    FREELIST(pdb, PDB);
-   
-   return(retval);
+
+   if(useCache && (job->error == NULL))
+   {
+      if(readLock != NULL)
+         pthread_mutex_lock(readLock);
+      WriteCache(job, hash);
+      if(readLock != NULL)
+         pthread_mutex_unlock(readLock);
+   }
 }
 
 
 /************************************************************************/
-/*>BOOL UpdateResCounts(void)
-   --------------------------
-   Maintains a linked list of counts of each residue number observed in
-   the region zones. This is used to calculate percentages for those 
-   residues involved in contacts.
+/*>BOOL ContentKey(FILE *fp, unsigned long *hash)
+   ----------------------------------------------
+   Input:   FILE          *fp      PDB file (read to the end)
+   Output:  unsigned long *hash    Two 32-bit hashes
+   Returns: BOOL                   Success (FALSE on a read error)
 
-   30.09.96 Original   By: ACRM
-   01.10.96 Changed call to InResList()
+   Builds the cache key for a PDB file from its contents, the region
+   specifications and the contact distance
+
+   16.10.26 Original   By: agent
 */
-BOOL UpdateResCounts(void)
+BOOL ContentKey(FILE *fp, unsigned long *hash)
 {
-   static RESLIST *sl;
-   RESLIST        *l;
-   REGION         *r;
-   PDB            *p;
-   
-   
-   /* For each region                                                   */
+   unsigned char buffer[HASHBUFF];
+   REGION        *r;
+   char          distance[32];
+   int           nBytes;
+
+   hash[0] = 2166136261UL;
+   hash[1] = 5381UL;
+
+   while((nBytes = (int)fread(buffer, 1, HASHBUFF, fp)) > 0)
+      HashBytes(hash, buffer, nBytes);
+   if(ferror(fp))
+      return(FALSE);
+
    for(r=gRegions; r!=NULL; NEXT(r))
    {
-      /* For each atom in the region                                    */
-      for(p=r->start; p!=NULL && p!=r->end; p=FindNextResidue(p))
-      {
-         /* If it's already in the residue list, just increment the 
-            count
-         */
-         if((l=InResList(PDBResSpec(p), gResList))!=NULL)
-         {
-            (l->count)++;
-         }
-         else
-         {
-            /* It's not already in the residue list, so allocate more
-               space and insert into the list
-            */
-            if(gResList == NULL)
-            {
-               INIT(gResList, RESLIST);
-               sl = gResList;
-            }
-            else
-            {
-               ALLOCNEXT(sl, RESLIST);
-            }
-            if(sl==NULL)
-            {
-               return(FALSE);
-            }
-            
-            strcpy(sl->res, PDBResSpec(p));
-            sl->count = 1;
-         }
-      }
+      HashBytes(hash, (unsigned char *)r->startres, strlen(r->startres)+1);
+      HashBytes(hash, (unsigned char *)r->endres,   strlen(r->endres)+1);
    }
-
+   sprintf(distance, "%.10g", gDistSqMax);
+   HashBytes(hash, (unsigned char *)distance, strlen(distance));
+   
    return(TRUE);
 }
 
 
 /************************************************************************/
-/*>BOOL DoContactAnalysis(FILE *out)
-   ---------------------------------
-   Does the actual contact analysis. Runs through the region zones and the
-   atoms within these zones. If any pair of atoms is in contact, the
-   residue pair is added to the contact list. Finally the contacts
-   seen in the current PDB file are displayed and the records of total
-   contact data are updated.
+/*>void HashBytes(unsigned long *hash, unsigned char *bytes, int nBytes)
+   ---------------------------------------------------------------------
+   I/O:     unsigned long *hash    Two 32-bit hashes to update
+   Input:   unsigned char *bytes   Data
+            int           nBytes   Amount of data
 
-   25.09.96 Original   By: ACRM
+   Adds data to an FNV-1a hash and a Bernstein hash
+
+   16.10.26 Original   By: agent
 */
-BOOL DoContactAnalysis(FILE *out)
+void HashBytes(unsigned long *hash, unsigned char *bytes, int nBytes)
 {
-   REGION *r1, *r2;
-   PDB    *p,  *q;
-
-
-   ClearContacts();
-   
-   /* For each region                                                   */
-   for(r1=gRegions; r1!=NULL; NEXT(r1))
-   {
-      /* For each other region                                          */
-      for(r2=r1->next; r2!=NULL; NEXT(r2))
-      {
-         for(p=r1->start; p!=r1->end; NEXT(p))
-         {
-            for(q=r2->start; q!=r2->end; NEXT(q))
-            {
-               if(DISTSQ(p,q) <= gDistSqMax)
-               {
-                  /* Store the contact (i.e. the pair of residues       */
-                  if(!StoreContact(p, q))
-                  {
-                     ClearContacts();
-                     fprintf(stderr,"No memory to store contact data\n");
-                     return(FALSE);
-                  }
-                  /* Store the contacting residues separately           */
-                  if(!StoreCRes(p))
-                  {
-                     ClearContacts();
-                     fprintf(stderr,"No memory to store contact data\n");
-                     return(FALSE);
-                  }
-                  if(!StoreCRes(q))
-                  {
-                     ClearContacts();
-                     fprintf(stderr,"No memory to store contact data\n");
-                     return(FALSE);
-                  }
-                  
-                  /* One could try to do something clever here to step p 
-                     and q on to the end of the residue to save time, but
-                     for now we won't bother!
-                  */
-               }
-            }
-         }
-      }
-   }
+   unsigned long h0 = hash[0],
+                 h1 = hash[1];
+   int           i;
 
-   DisplayContacts(out, gContacts, (REAL)(-1.0));
-   if(!UpdateTotals())
+   for(i=0; i<nBytes; i++)
    {
-      fprintf(stderr,"No memory to update total contact data\n");
-      return(FALSE);
+      h0 = ((h0 ^ bytes[i]) * 16777619UL) & 0xFFFFFFFFUL;
+      h1 = ((h1 * 33) ^ bytes[i]) & 0xFFFFFFFFUL;
    }
-   
-   return(TRUE);
+   hash[0] = h0;
+   hash[1] = h1;
 }
 
 
 /************************************************************************/
-/*>void ClearContacts(void)
-   ------------------------
-   Frees up the contact list which is used to store contacts for a single
-   protein.
+/*>void CacheFileName(unsigned long *hash, char *filename)
+   -------------------------------------------------------
+   Input:   unsigned long *hash      Cache key
+   Output:  char          *filename  Cache entry (MAXBUFF+32 long)
 
-   25.09.96 Original   By: ACRM
-   01.10.96 Also frees the list of residues which make contact
+   16.10.26 Original   By: agent
 */
-void ClearContacts(void)
+void CacheFileName(unsigned long *hash, char *filename)
 {
-   FREELIST(gContacts, CONTACT);
-   gContacts = NULL;
-
-   FREELIST(gCResList, RESLIST);
-   gCResList = NULL;
+   sprintf(filename, "%s/%08lx%08lx.rcc", gCacheDir, hash[0], hash[1]);
 }
 
 
 /************************************************************************/
-/*>BOOL StoreContact(PDB *p, PDB *q)
-   ---------------------------------
-   Store a contact between two residues into a linked list of contacts.
-   The contact is stored in both directions.
-
-   We set the counts to zero here since we are just storing a list of
-   what makes contact; we're not using any counts yet
-
-   25.09.96 Original   By: ACRM
+/*>BOOL ReadCache(FILEJOB *job, unsigned long *hash)
+   -------------------------------------------------
+   I/O:     FILEJOB       *job     Job to fill in
+   Input:   unsigned long *hash    Cache key
+   Returns: BOOL                   Was there a valid entry?
+
+   Loads the residue counts, contacts and contacting residues of a file
+   from its cache entry. The entry holds a CACHEHEADER followed by the 
+   residue counts, the contacts and the contacting residues as RESKEYs
+   and ints in the order in which they were stored. 
+
+   16.10.26 Original   By: agent
 */
-BOOL StoreContact(PDB *p, PDB *q)
+BOOL ReadCache(FILEJOB *job, unsigned long *hash)
 {
-   static CONTACT *c;
-   char   resspec1[16],
-          resspec2[16];
-
+   FILE        *fp;
+   CACHEHEADER header;
+   char        filename[MAXBUFF+32];
+   RESKEY      res[2];
+   RESLIST     *l;
+   int         count, i;
+   BOOL        ok;
+
+   CacheFileName(hash, filename);
+   if((fp=fopen(filename, "rb"))==NULL)
+      return(FALSE);
 
-   /* Create residue specs from the PDB pointers                        */
-   strcpy(resspec1, PDBResSpec(p));
-   strcpy(resspec2, PDBResSpec(q));
+   ok = ((fread(&header, sizeof(CACHEHEADER), 1, fp) == 1) &&
+         !memcmp(header.magic, CACHEMAGIC, 8)               &&
+         (header.hash[0]   == hash[0])                      &&
+         (header.hash[1]   == hash[1])                      &&
+         (header.distSqMax == gDistSqMax)                   &&
+         (header.keySize   == sizeof(RESKEY)));
 
-   if(gContacts == NULL)
+   for(i=0; ok && i<header.nRes; i++)
    {
-      INIT(gContacts, CONTACT);
-      c = gContacts;
+      ok = ((fread(res, sizeof(RESKEY), 1, fp) == 1)   &&
+            (fread(&count, sizeof(int), 1, fp) == 1)   &&
+            ((l = AddRes(res[0], &(job->resList)))!=NULL));
+      if(ok)
+         l->count = count;
    }
-   else
+   for(i=0; ok && i<header.nContacts; i++)
    {
-      if(GotContact(resspec1, resspec2, gContacts)!=NULL)
-         return(TRUE);
-      
-      ALLOCNEXT(c, CONTACT);
+      ok = ((fread(res, sizeof(RESKEY), 2, fp) == 2)   &&
+            (AddContact(res[0], res[1], &(job->contacts))!=NULL));
    }
-   if(c==NULL)
+   for(i=0; ok && i<header.nCRes; i++)
    {
-      FREELIST(gContacts, CONTACT);
-      return(FALSE);
+      ok = ((fread(res, sizeof(RESKEY), 1, fp) == 1)   &&
+            (fread(&count, sizeof(int), 1, fp) == 1)   &&
+            ((l = AddRes(res[0], &(job->cResList)))!=NULL));
+      if(ok)
+         l->count = count;
    }
+   fclose(fp);
 
-   /* Store the 1->2 contact                                            */
-   strcpy(c->res1, resspec1);
-   strcpy(c->res2, resspec2);
-   c->count = 0;
-   
-   /* Allocate space for the 2->1 contact                               */
-   ALLOCNEXT(c, CONTACT);
-   if(c==NULL)
+   if(!ok)
    {
-      FREELIST(gContacts, CONTACT);
+      /* Discard anything read from a bad entry                         */
+      ClearContacts(job);
+      for(i=0; i<job->resList.nSlots; i++)
+         job->resList.slots[i] = EMPTYSLOT;
+      job->resList.nItems = 0;
       return(FALSE);
    }
 
-   /* Store the 1->2 contact                                            */
-   strcpy(c->res1, resspec2);
-   strcpy(c->res2, resspec1);
-   c->count = 0;
-
+   job->gotAtoms = TRUE;
    return(TRUE);
 }
 
 
 /************************************************************************/
-/*>void DisplayContacts(FILE *out, CONTACT *clist, REAL cutoff)
-   ------------------------------------------------------------
-   Displays the contact list such that all contacts made from a given
-   residue are grouped. The contacts are only displayed if the fraction
-   of contacts made is greater than the specified cutoff
-
-   25.09.96 Original   By: ACRM
-   01.10.96 Doesn't print percentages if they are 0.00
+/*>void WriteCache(FILEJOB *job, unsigned long *hash)
+   --------------------------------------------------
+   Input:   FILEJOB       *job     An analysed file
+            unsigned long *hash    Cache key
+
+   Writes a cache entry for a file in the format read by ReadCache(). 
+   It is written under a temporary name and renamed into place so a 
+   partial entry is never seen. The temporary name includes the process
+   ID and a count of the entries written by this process, so files with
+   the same contents (and hence the same key) being cached by two 
+   threads or two runs never share a temporary file. The cache is only
+   an optimization so failures are ignored.
+
+   In threaded mode this is called with the read lock held, which also
+   protects the count.
+
+   16.10.26 Original   By: agent
+   17.10.26 Unique temporary file name   By: agent
 */
-void DisplayContacts(FILE *out, CONTACT *clist, REAL cutoff)
+void WriteCache(FILEJOB *job, unsigned long *hash)
 {
-   CONTACT *c, *d;
-   BOOL    Finished;
-   int     count, count1, count2;
-   REAL    perc;
-
+   static unsigned long nWritten = 0;
+   FILE        *fp;
+   CACHEHEADER header;
+   char        filename[MAXBUFF+32],
+               tmpname[MAXBUFF+80];
+   int         i;
+   BOOL        ok;
+
+   CacheFileName(hash, filename);
+   sprintf(tmpname, "%s.%ld.%lu.tmp", filename, (long)getpid(), 
+           nWritten++);
+   if((fp=fopen(tmpname, "wb"))==NULL)
+      return;
+
+   memset(&header, 0, sizeof(CACHEHEADER));
+   memcpy(header.magic, CACHEMAGIC, 8);
+   header.hash[0]   = hash[0];
+   header.hash[1]   = hash[1];
+   header.distSqMax = gDistSqMax;
+   header.keySize   = sizeof(RESKEY);
+   header.nRes      = job->resList.nItems;
+   header.nContacts = job->contacts.nItems;
+   header.nCRes     = job->cResList.nItems;
    
-   for(c=clist; c!=NULL; NEXT(c))
+   ok = (fwrite(&header, sizeof(CACHEHEADER), 1, fp) == 1);
+   for(i=0; ok && i<job->resList.nItems; i++)
    {
-      c->done = FALSE;
+      ok = ((fwrite(&(job->resList.items[i].res), sizeof(RESKEY), 1, fp)
+             == 1) &&
+            (fwrite(&(job->resList.items[i].count), sizeof(int), 1, fp)
+             == 1));
    }
-
-   Finished = FALSE;
-   while(!Finished)
+   for(i=0; ok && i<job->contacts.nItems; i++)
    {
-      Finished = TRUE;
-      
-      for(c=clist; c!=NULL; NEXT(c))
-      {
-         if(!c->done)
-         {
-            Finished = FALSE;
-
-            for(d=c; d!=NULL; NEXT(d))
-            {
-               if(!strcmp(c->res1, d->res1))
-               {
-                  d->done = TRUE;
-                  if((count1 = CountRes(d->res1))==0 || 
-                     (count2 = CountRes(d->res2))==0)
-                  {
-                     count = 1;
-                  }
-                  else
-                  {
-                     count = MIN(count1, count2);
-                  }
-                  perc = (REAL)d->count/(REAL)count;
-
-                  if(perc > cutoff)
-                  {
-                     if(perc != (REAL)0.0)
-                     {
-                        fprintf(out,"%-5s makes contact with %-5s %.2f\n",
-                                d->res1, d->res2, perc);
-                     }
-                     else
-                     {
-                        fprintf(out,"%-5s makes contact with %-5s\n",
-                                d->res1, d->res2);
-                     }
-                  }
-               }
-            }
-         }
-      }
+      ok = ((fwrite(&(job->contacts.items[i].res1), sizeof(RESKEY), 1, 
+                    fp) == 1) &&
+            (fwrite(&(job->contacts.items[i].res2), sizeof(RESKEY), 1, 
+                    fp) == 1));
    }
+   for(i=0; ok && i<job->cResList.nItems; i++)
+   {
+      ok = ((fwrite(&(job->cResList.items[i].res), sizeof(RESKEY), 1, fp)
+             == 1) &&
+            (fwrite(&(job->cResList.items[i].count), sizeof(int), 1, fp)
+             == 1));
+   }
+
+   if((fclose(fp) != 0) || !ok || rename(tmpname, filename))
+      remove(tmpname);
 }
 
 
 /************************************************************************/
-/*>BOOL UpdateTotals(void)
-   -----------------------
-   Updates the total contacts list with the contacts seen in this
-   individual protein. Also updates the total contacting residue lists.
+/*>BOOL MergeFile(FILE *out, FILEJOB *job)
+   ---------------------------------------
+   Input:   FILE     *out      Output file
+            FILEJOB  *job      An analysed file
+   Returns: BOOL               Success
 
-   25.09.96 Original   By: ACRM
-   01.10.96 Added contacting residues list
+   Adds the residue counts from a file to the overall counts, displays 
+   the contacts seen in the file and updates the records of total 
+   contact data. Must be called in file order.
+
+   16.10.26 Original (from ProcessFile())   By: agent
 */
-BOOL UpdateTotals(void)
+BOOL MergeFile(FILE *out, FILEJOB *job)
 {
-   static CONTACT *t;
-   CONTACT        *c, *t2;
-   static RESLIST *rt;
-   RESLIST        *r, *rt2;
+   RESLIST *l, *t;
+   int     i;
    
+   if(job->gotAtoms)
+      gRegionCount++;
 
-   for(c=gContacts; c!=NULL; NEXT(c))
+   for(i=0; i<job->resList.nItems; i++)
    {
-      if(gTotal == NULL)
-      {
-         INIT(gTotal, CONTACT);
-         t = gTotal;
-
-         if(t==NULL)
-            return(FALSE);
-            
-         strcpy(t->res1, c->res1);
-         strcpy(t->res2, c->res2);
-         t->count = 1;
-      }
-      else
+      l = &(job->resList.items[i]);
+      if((t=InResList(l->res, &gResList))==NULL)
       {
-         /* If we don't have it in the totals, create it                */
-         if((t2=GotContact(c->res1, c->res2, gTotal))==NULL)
-         {
-            ALLOCNEXT(t, CONTACT);
-            if(t==NULL)
-               return(FALSE);
-            
-            strcpy(t->res1, c->res1);
-            strcpy(t->res2, c->res2);
-            t->count = 1;
-         }
-         else
+         if((t=AddRes(l->res, &gResList))==NULL)
          {
-            strcpy(t2->res1, c->res1);
-            strcpy(t2->res2, c->res2);
-            (t2->count)++;
+            fprintf(stderr,"No memory to store residue counts\n");
+            return(FALSE);
          }
       }
+      t->count += l->count;
    }
 
-   for(r=gCResList; r!=NULL; NEXT(r))
+   if(job->error != NULL)
    {
-      if(gCRTotal == NULL)
-      {
-         INIT(gCRTotal, RESLIST);
-         rt = gCRTotal;
-
-         if(rt==NULL)
-            return(FALSE);
-            
-         strcpy(rt->res, r->res);
-         rt->count = 1;
-      }
-      else
-      {
-         /* If we don't have it in the totals, create it                */
-         if((rt2=InResList(r->res, gCRTotal))==NULL)
-         {
-            ALLOCNEXT(rt, RESLIST);
-            if(rt==NULL)
-               return(FALSE);
-            
-            strcpy(rt->res, r->res);
-            rt->count = 1;
-         }
-         else
-         {
-            strcpy(rt2->res, r->res);
-            (rt2->count)++;
-         }
-      }
+      fprintf(stderr,"%s\n", job->error);
+      return(FALSE);
    }
 
+   DisplayContacts(out, &(job->contacts), (REAL)(-1.0));
+   if(!UpdateTotals(job))
+   {
+      fprintf(stderr,"No memory to update total contact data\n");
+      return(FALSE);
+   }
+   if(gMatrixFile[0] && !RecordFileContacts(job))
+   {
+      fprintf(stderr,"Unable to store contacts for the matrix file\n");
+      return(FALSE);
+   }
+   
    return(TRUE);
 }
 
 
 /************************************************************************/
-/*>CONTACT *GotContact(char *resspec1, char *resspec2, CONTACT *clist)
-   -------------------------------------------------------------------
-   Looks in a linked list of contacts to see if a particular contact
-   is already found there. If found, the pointer into the linked list
-   is returned; if not, returns NULL.
-
-   25.09.96 Original   By: ACRM
+/*>BOOL RecordFileContacts(FILEJOB *job)
+   -------------------------------------
+   Input:   FILEJOB  *job      A merged file
+   Returns: BOOL               Success
+
+   Keeps the contacts of a file for WriteMatrix(). The file name is 
+   stored and the contacts are written to a temporary file as pairs of
+   indexes into the residue counts, so memory use doesn't grow with the
+   number of contacts.
+
+   16.10.26 Original   By: agent
+   17.10.26 Zeroes each file name slot   By: agent
 */
-CONTACT *GotContact(char *resspec1, char *resspec2, CONTACT *clist)
+BOOL RecordFileContacts(FILEJOB *job)
 {
-   CONTACT *c;
-
+   int i;
    
-   for(c=clist; c!=NULL; NEXT(c))
+   if(gFileContactsFp == NULL)
    {
-      if(!strcmp(c->res1, resspec1) &&
-         !strcmp(c->res2, resspec2))
-      {
-         return(c);
-      }
+      if((gFileContactsFp = tmpfile())==NULL)
+         return(FALSE);
    }
    
-   return(NULL);
-}
-
+   if(gNFiles >= gMaxFiles)
+   {
+      char (*names)[PARSER_MAXSTRLEN];
+      int  *rowPtr,
+           maxFiles = (gMaxFiles) ? 2 * gMaxFiles : TABLEQUANTUM;
 
-/************************************************************************/
-/*>RESLIST *InResList(char *rspec, RESLIST *rlist)
-   -----------------------------------------------
-   Looks to see if a particular residue specification is seen in the list
-   of counts of each residue number. If found, returns a pointer to that
-   item in the list; returns NULL if not found.
+      if((names = (char (*)[PARSER_MAXSTRLEN])
+          realloc(gFileNames, maxFiles * PARSER_MAXSTRLEN))==NULL)
+         return(FALSE);
+      gFileNames = names;
+      if((rowPtr = (int *)realloc(gFileRowPtr, 
+                                  (maxFiles+1) * sizeof(int)))==NULL)
+         return(FALSE);
+      if(gFileRowPtr == NULL)
+         rowPtr[0] = 0;
+      gFileRowPtr = rowPtr;
+      gMaxFiles   = maxFiles;
+   }
 
-   30.09.96 Original   By: ACRM
-   01.10.96 Added rlist as a parameter
-            Changed other input to rspec rather than a PDB pointer
-*/
-RESLIST *InResList(char *rspec, RESLIST *rlist)
-{
-   RESLIST *l;
-   
-   for(l=rlist; l!=NULL; NEXT(l))
+   for(i=0; i<job->contacts.nItems; i++)
    {
-      if(!strcmp(rspec, l->res))
-         return(l);
+      int pair[2];
+      pair[0] = ResIndex(job->contacts.items[i].res1);
+      pair[1] = ResIndex(job->contacts.items[i].res2);
+      if(fwrite(pair, sizeof(int), 2, gFileContactsFp) != 2)
+         return(FALSE);
    }
-   return(NULL);
+
+   /* Zero the slot so no uninitialized memory reaches the matrix file */
+   memset(gFileNames[gNFiles], 0, PARSER_MAXSTRLEN);
+   strcpy(gFileNames[gNFiles], job->filename);
+   gFileRowPtr[gNFiles+1] = gFileRowPtr[gNFiles] + job->contacts.nItems;
+   gNFiles++;
+   
+   return(TRUE);
 }
 
 
 /************************************************************************/
-/*>int CountRes(char *rspec)
-   -------------------------
-   Returns the residue count from the linked list of counts for each
-   residue specification for a given residue.
+/*>int ResIndex(RESKEY res)
+   ------------------------
+   Input:   RESKEY   res       Residue id
+   Returns: int                Index in the residue counts (-1 if not
+                               there)
 
-   30.09.96 Original   By: ACRM
+   16.10.26 Original   By: agent
 */
-int CountRes(char *rspec)
+int ResIndex(RESKEY res)
 {
    RESLIST *l;
 
-   
-   for(l=gResList; l!=NULL; NEXT(l))
-   {
-      if(!strcmp(rspec, l->res))
-         return(l->count);
-   }
-   
-   return(0);
+   if((l=InResList(res, &gResList))==NULL)
+      return(-1);
+   return((int)(l - gResList.items));
 }
 
 
 /************************************************************************/
-/*>char *PDBResSpec(PDB *p)
-   ------------------------
-   Builds a residue spec of the form [c]nnn[i] from a PDB pointer
-
-   30.09.96 Original   By: ACRM
+/*>BOOL WriteMatrix(char *filename)
+   --------------------------------
+   Input:   char     *filename Output file
+   Returns: BOOL               Success
+
+   Writes the contacts as a binary file which can be memory mapped. A
+   MATRIXHEADER gives the sizes and the byte offset of each block; every
+   block starts on an 8-byte boundary. The blocks are:
+
+   - a dictionary of residue ids ([c]nnn[i], NUL padded to MATRIXIDLEN),
+     in the order they were first seen, and the number of files in 
+     which each residue occurs
+   - the summary contacts as a CSR matrix over residue indexes: row 
+     pointers, column indexes, the number of files with the contact and
+     its frequency as shown by the EXIT command. Each row is sorted by
+     column and both directions of every contact are present.
+   - the names of the files and, as a CSR matrix with a row per file,
+     the index into the summary columns of each of the file's contacts
+
+   Fails if a residue id doesn't fit in MATRIXIDLEN-1 characters.
+
+   16.10.26 Original   By: agent
+   17.10.26 Rejects residue ids that would be truncated   By: agent
 */
-char *PDBResSpec(PDB *p)
+BOOL WriteMatrix(char *filename)
 {
-   static char rspec[16];
-   char        chain[16],
-               insert[16];
-
+   FILE         *fp;
+   MATRIXHEADER header;
+   MATRIXENTRY  *entries = NULL;
+   char         (*dict)[MATRIXIDLEN] = NULL;
+   int          *ints    = NULL,
+                nRes     = gResList.nItems,
+                nPairs   = gTotal.nItems,
+                nFileContacts,
+                i, n;
+   float        *freqs   = NULL;
+   BOOL         ok       = TRUE;
+
+   nFileContacts = (gNFiles) ? gFileRowPtr[gNFiles] : 0;
+
+   /* Work out the layout                                               */
+   memset(&header, 0, sizeof(MATRIXHEADER));
+   memcpy(header.magic, MATRIXMAGIC, 8);
+   header.nRes             = nRes;
+   header.nPairs           = nPairs;
+   header.nFiles           = gNFiles;
+   header.nFileContacts    = nFileContacts;
+   header.idLen            = MATRIXIDLEN;
+   header.nameLen          = PARSER_MAXSTRLEN;
+   header.dictOffset       = PAD8((long)sizeof(MATRIXHEADER));
+   header.resCountOffset   = header.dictOffset + 
+                             PAD8((long)nRes * MATRIXIDLEN);
+   header.rowPtrOffset     = header.resCountOffset +
+                             PAD8((long)nRes * sizeof(int));
+   header.colOffset        = header.rowPtrOffset + 
+                             PAD8((long)(nRes+1) * sizeof(int));
+   header.countOffset      = header.colOffset +
+                             PAD8((long)nPairs * sizeof(int));
+   header.freqOffset       = header.countOffset +
+                             PAD8((long)nPairs * sizeof(int));
+   header.fileNameOffset   = header.freqOffset +
+                             PAD8((long)nPairs * sizeof(float));
+   header.fileRowPtrOffset = header.fileNameOffset +
+                             PAD8((long)gNFiles * PARSER_MAXSTRLEN);
+   header.filePairOffset   = header.fileRowPtrOffset +
+                             PAD8((long)(gNFiles+1) * sizeof(int));
+
+   if((fp=fopen(filename, "wb"))==NULL)
+   {
+      fprintf(stderr,"Unable to open matrix file: %s\n", filename);
+      return(FALSE);
+   }
 
-   strcpy(chain,p->chain);
-   if(chain[0] == ' ')
-      chain[0] = '\0';
-   else
-      chain[1] = '\0';
+   /* Sort the summary contacts into rows                               */
+   if(((entries = (MATRIXENTRY *)malloc((nPairs+1) * sizeof(MATRIXENTRY)))
+       ==NULL) ||
+      ((ints  = (int *)malloc((MAX(nRes, nPairs)+1) * sizeof(int)))
+       ==NULL) ||
+      ((freqs = (float *)malloc((nPairs+1) * sizeof(float)))==NULL) ||
+      ((dict  = (char (*)[MATRIXIDLEN])calloc(nRes+1, MATRIXIDLEN))
+       ==NULL))
+   {
+      fprintf(stderr,"No memory to write matrix file\n");
+      ok = FALSE;
+   }
+   for(i=0; ok && i<nPairs; i++)
+   {
+      entries[i].row   = ResIndex(gTotal.items[i].res1);
+      entries[i].col   = ResIndex(gTotal.items[i].res2);
+      entries[i].count = gTotal.items[i].count;
+   }
+   if(ok && (nPairs > 1))
+      qsort(entries, nPairs, sizeof(MATRIXENTRY), CompareMatrixEntries);
 
-   strcpy(insert,p->insert);
+   /* Header, dictionary and residue counts                             */
+   if(ok)
+   {
+      for(i=0; ok && i<nRes; i++)
+      {
+         char *spec = ResKeySpec(gResList.items[i].res);
+         int  len   = strlen(spec);
+         
+         /* The slot is zeroed so the id is NUL padded                  */
+         if(len >= MATRIXIDLEN)
+         {
+            fprintf(stderr,"Residue id too long for matrix file: %s\n",
+                    spec);
+            ok = FALSE;
+         }
+         else
+         {
+            memcpy(dict[i], spec, len);
+            ints[i] = gResList.items[i].count;
+         }
+      }
+      ok = ok &&
+           WriteMatrixBlock(fp, &header, sizeof(MATRIXHEADER), 1) &&
+           WriteMatrixBlock(fp, dict, MATRIXIDLEN, nRes) &&
+           WriteMatrixBlock(fp, ints, sizeof(int), nRes);
+   }
+
+   /* Summary CSR matrix                                                */
+   if(ok)
+   {
+      for(i=0, n=0; i<=nRes; i++)
+      {
+         while((n < nPairs) && (entries[n].row < i))
+            n++;
+         ints[i] = n;
+      }
+      ok = WriteMatrixBlock(fp, ints, sizeof(int), nRes+1);
+   }
+   if(ok)
+   {
+      for(i=0; i<nPairs; i++)
+         ints[i] = entries[i].col;
+      ok = WriteMatrixBlock(fp, ints, sizeof(int), nPairs);
+   }
+   if(ok)
+   {
+      for(i=0; i<nPairs; i++)
+      {
+         int count1 = gResList.items[entries[i].row].count,
+             count2 = gResList.items[entries[i].col].count,
+             count  = (count1 && count2) ? MIN(count1, count2) : 1;
+         
+         ints[i]  = entries[i].count;
+         freqs[i] = (float)entries[i].count / (float)count;
+      }
+      ok = WriteMatrixBlock(fp, ints, sizeof(int), nPairs) &&
+           WriteMatrixBlock(fp, freqs, sizeof(float), nPairs);
+   }
+
+   /* Per-file CSR matrix. The contacts are read back from the temporary
+      file and looked up in the sorted summary rows
+   */
+   if(ok)
+   {
+      ok = WriteMatrixBlock(fp, gFileNames, PARSER_MAXSTRLEN, gNFiles) &&
+           WriteMatrixBlock(fp, gFileRowPtr, sizeof(int), 
+                            (gNFiles) ? gNFiles+1 : 0);
+      if(ok && (gNFiles == 0))
+      {
+         n  = 0;
+         ok = WriteMatrixBlock(fp, &n, sizeof(int), 1);
+      }
+   }
+   if(ok && (gFileContactsFp != NULL))
+   {
+      rewind(gFileContactsFp);
+      for(i=0; ok && i<nFileContacts; i++)
+      {
+         int pair[2], lo, hi;
+         
+         if(fread(pair, sizeof(int), 2, gFileContactsFp) != 2)
+         {
+            ok = FALSE;
+            break;
+         }
+
+         /* Binary search for the contact in the sorted summary       */
+         for(lo=0, hi=nPairs; lo<hi; )
+         {
+            int mid = (lo + hi) / 2;
+            if((entries[mid].row < pair[0]) ||
+               ((entries[mid].row == pair[0]) && 
+                (entries[mid].col < pair[1])))
+               lo = mid + 1;
+            else
+               hi = mid;
+         }
+         if(fwrite(&lo, sizeof(int), 1, fp) != 1)
+            ok = FALSE;
+      }
+   }
+
+   if((fclose(fp) != 0) && ok)
+      ok = FALSE;
+   if(!ok)
+      fprintf(stderr,"Error writing matrix file: %s\n", filename);
+
+   if(entries != NULL) free(entries);
+   if(ints    != NULL) free(ints);
+   if(freqs   != NULL) free(freqs);
+   if(dict    != NULL) free(dict);
+   return(ok);
+}
+
+
+/************************************************************************/
+/*>BOOL WriteMatrixBlock(FILE *fp, void *data, int size, int n)
+   ------------------------------------------------------------
+   Input:   FILE     *fp       Matrix file
+            void     *data     Block to write
+            int      size      Size of each item
+            int      n         Number of items
+   Returns: BOOL               Success
+
+   Writes a block of the matrix file padded with zeros to an 8-byte 
+   boundary
+
+   16.10.26 Original   By: agent
+*/
+BOOL WriteMatrixBlock(FILE *fp, void *data, int size, int n)
+{
+   static char zeros[8] = {0, 0, 0, 0, 0, 0, 0, 0};
+   long        nBytes   = (long)size * n;
+   
+   if((n > 0) && (fwrite(data, size, n, fp) != (size_t)n))
+      return(FALSE);
+   if((PAD8(nBytes) != nBytes) &&
+      (fwrite(zeros, 1, (size_t)(PAD8(nBytes) - nBytes), fp) != 
+       (size_t)(PAD8(nBytes) - nBytes)))
+      return(FALSE);
+   return(TRUE);
+}
+
+
+/************************************************************************/
+/*>int CompareMatrixEntries(const void *a, const void *b)
+   ------------------------------------------------------
+   qsort() comparison function to sort matrix entries by row then column
+
+   16.10.26 Original   By: agent
+*/
+int CompareMatrixEntries(const void *a, const void *b)
+{
+   const MATRIXENTRY *e1 = (const MATRIXENTRY *)a,
+                     *e2 = (const MATRIXENTRY *)b;
+
+   if(e1->row != e2->row)
+      return((e1->row < e2->row) ? -1 : 1);
+   if(e1->col != e2->col)
+      return((e1->col < e2->col) ? -1 : 1);
+   return(0);
+}
+
+
+/************************************************************************/
+/*>BOOL QueueFile(FILE *out, char *filename)
+   -----------------------------------------
+   Input:   FILE     *out      Output file
+            char     *filename PDB file
+   Returns: BOOL               Success
+
+   Adds a PDB file to the batch to be analysed on gNThreads threads, 
+   running the batch first if it is full.
+
+   16.10.26 Original   By: agent
+*/
+BOOL QueueFile(FILE *out, char *filename)
+{
+   if(gNBatch == MAXBATCH)
+      FlushBatch(out);
+   InitFileJob(&(gBatch[gNBatch++]), filename);
+   return(TRUE);
+}
+
+
+/************************************************************************/
+/*>void FlushBatch(FILE *out)
+   --------------------------
+   Input:   FILE     *out      Output file
+
+   Analyses the queued PDB files. Worker threads take the files in turn
+   and analyse each into its own tables; once all are done the results
+   are merged in file order so the output is identical to a serial run.
+
+   16.10.26 Original   By: agent
+*/
+void FlushBatch(FILE *out)
+{
+   WORKQUEUE queue;
+   pthread_t threads[MAXTHREADS];
+   int       nStarted = 0,
+             i;
+
+   if(gNBatch == 0)
+      return;
+
+   queue.jobs    = gBatch;
+   queue.nJobs   = gNBatch;
+   queue.nextJob = 0;
+   pthread_mutex_init(&queue.lock, NULL);
+   pthread_mutex_init(&queue.readLock, NULL);
+
+   /* Start the workers; any files they don't take are done here        */
+   while((nStarted < gNThreads) && (nStarted < gNBatch))
+   {
+      if(pthread_create(&(threads[nStarted]), NULL, FileWorker, 
+                        (void *)&queue))
+         break;
+      nStarted++;
+   }
+   if(nStarted == 0)
+      FileWorker((void *)&queue);
+   for(i=0; i<nStarted; i++)
+      pthread_join(threads[i], NULL);
+
+   /* Merge the results in file order                                   */
+   for(i=0; i<gNBatch; i++)
+   {
+      if(!MergeFile(out, &(gBatch[i])))
+      {
+         fprintf(stderr,"Error processing PDB file: %s\n",
+                 gBatch[i].filename);
+      }
+      FreeFileJob(&(gBatch[i]));
+   }
+   gNBatch = 0;
+
+   pthread_mutex_destroy(&queue.lock);
+   pthread_mutex_destroy(&queue.readLock);
+}
+
+
+/************************************************************************/
+/*>void *FileWorker(void *arg)
+   ---------------------------
+   Input:   void  *arg       The WORKQUEUE, cast to void *
+   Returns: void *           NULL
+
+   Thread function. Repeatedly takes the next PDB file from the work 
+   queue and analyses it.
+
+   16.10.26 Original   By: agent
+*/
+void *FileWorker(void *arg)
+{
+   WORKQUEUE *queue = (WORKQUEUE *)arg;
+   int       job;
+
+   for(;;)
+   {
+      pthread_mutex_lock(&queue->lock);
+      job = (queue->nextJob)++;
+      pthread_mutex_unlock(&queue->lock);
+
+      if(job >= queue->nJobs)
+         break;
+
+      AnalyseFile(&(queue->jobs[job]), &queue->readLock);
+   }
+
+   return(NULL);
+}
+
+
+/************************************************************************/
+/*>void InitFileJob(FILEJOB *job, char *filename)
+   ----------------------------------------------
+   Output:  FILEJOB  *job      Job to initialise
+   Input:   char     *filename PDB file
+
+   16.10.26 Original   By: agent
+*/
+void InitFileJob(FILEJOB *job, char *filename)
+{
+   strncpy(job->filename, filename, PARSER_MAXSTRLEN);
+   job->filename[PARSER_MAXSTRLEN-1] = '\0';
+   job->error    = NULL;
+   job->zones    = NULL;
+   job->gotAtoms = FALSE;
+
+   job->contacts.items  = NULL;
+   job->contacts.slots  = NULL;
+   job->contacts.nItems = job->contacts.maxItems = 
+      job->contacts.nSlots = 0;
+   job->resList.items   = job->cResList.items = NULL;
+   job->resList.slots   = job->cResList.slots = NULL;
+   job->resList.nItems  = job->resList.maxItems = 
+      job->resList.nSlots = 0;
+   job->cResList.nItems = job->cResList.maxItems = 
+      job->cResList.nSlots = 0;
+}
+
+
+/************************************************************************/
+/*>void FreeFileJob(FILEJOB *job)
+   ------------------------------
+   I/O:     FILEJOB  *job      Job whose tables are freed
+
+   16.10.26 Original   By: agent
+*/
+void FreeFileJob(FILEJOB *job)
+{
+   if(job->zones          != NULL) free(job->zones);
+   if(job->contacts.items != NULL) free(job->contacts.items);
+   if(job->contacts.slots != NULL) free(job->contacts.slots);
+   if(job->resList.items  != NULL) free(job->resList.items);
+   if(job->resList.slots  != NULL) free(job->resList.slots);
+   if(job->cResList.items != NULL) free(job->cResList.items);
+   if(job->cResList.slots != NULL) free(job->cResList.slots);
+   job->zones = NULL;
+}
+
+
+/************************************************************************/
+/*>BOOL UpdateResCounts(FILEJOB *job)
+   -----------------------------------
+   Maintains a table of counts of each residue number observed in
+   the region zones. This is used to calculate percentages for those 
+   residues involved in contacts. The counts for a file are kept in the
+   job and added to the overall counts by MergeFile().
+
+   30.09.96 Original   By: ACRM
+   01.10.96 Changed call to InResList()
+   16.10.26 Residue list is now a hash table   By: agent
+   16.10.26 Counts into the job   By: agent
+*/
+BOOL UpdateResCounts(FILEJOB *job)
+{
+   RESLIST        *l;
+   ZONE           *z;
+   PDB            *p;
+   int            i;
+   
+   
+   /* For each region                                                   */
+   for(i=0, z=job->zones; i<gNRegions; i++, z++)
+   {
+      /* For each atom in the region                                    */
+      for(p=z->start; p!=NULL && p!=z->end; p=FindNextResidue(p))
+      {
+         RESKEY res = PDBResKey(p);
+         
+         /* If it's not already in the residue list, add it             */
+         if((l=InResList(res, &(job->resList)))==NULL)
+         {
+            if((l=AddRes(res, &(job->resList)))==NULL)
+               return(FALSE);
+         }
+         (l->count)++;
+      }
+   }
+
+   return(TRUE);
+}
+
+
+/************************************************************************/
+/*>BOOL DoContactAnalysis(FILEJOB *job)
+   ------------------------------------
+   Does the actual contact analysis. Runs through the region zones and the
+   atoms within these zones. If any pair of atoms is in contact, the
+   residue pair is added to the job's contact list. 
+
+   Each zone's residues are put in a grid by their centres. Pairs of 
+   zones whose bounding boxes are further apart than the contact 
+   distance are skipped and FindZoneContacts() uses the grids for the 
+   rest.
+
+   25.09.96 Original   By: ACRM
+   16.10.26 Stores into the job. Display and totals are done by 
+            MergeFile()   By: agent
+   16.10.26 Uses bounding boxes and grids   By: agent
+   16.10.26 Grids hold residues rather than atoms   By: agent
+*/
+BOOL DoContactAnalysis(FILEJOB *job)
+{
+   ZONEGRID   *grids;
+   RESCONTACT *found = NULL;
+   REAL       cutoff = sqrt(gDistSqMax);
+   int        *nbrs  = NULL,
+              maxRes = 0,
+              i, j;
+   BOOL       ok = TRUE;
+
+
+   ClearContacts(job);
+   if(gNRegions == 0)
+      return(TRUE);
+
+   if((grids = (ZONEGRID *)calloc(gNRegions, sizeof(ZONEGRID)))==NULL)
+      return(FALSE);
+   for(i=0; ok && i<gNRegions; i++)
+   {
+      ok = BuildZoneGrid(&(job->zones[i]), &(grids[i]));
+      if(grids[i].nRes > maxRes)
+         maxRes = grids[i].nRes;
+   }
+   if(ok && (maxRes > 0) &&
+      (((nbrs  = (int *)malloc(maxRes * sizeof(int)))==NULL) ||
+       ((found = (RESCONTACT *)malloc(maxRes * sizeof(RESCONTACT)))
+        ==NULL)))
+      ok = FALSE;
+   
+   /* For each region                                                   */
+   for(i=0; ok && i<gNRegions; i++)
+   {
+      /* For each other region                                          */
+      for(j=i+1; ok && j<gNRegions; j++)
+      {
+         ZONEGRID *g1 = &(grids[i]),
+                  *g2 = &(grids[j]);
+
+         /* Skip regions which are too far apart                        */
+         if((g1->nAtoms == 0) || (g2->nAtoms == 0) ||
+            (g1->xmin > g2->xmax + cutoff) || 
+            (g2->xmin > g1->xmax + cutoff) ||
+            (g1->ymin > g2->ymax + cutoff) || 
+            (g2->ymin > g1->ymax + cutoff) ||
+            (g1->zmin > g2->zmax + cutoff) || 
+            (g2->zmin > g1->zmax + cutoff))
+            continue;
+
+         ok = FindZoneContacts(job, g1, g2, nbrs, found);
+      }
+   }
+
+   for(i=0; i<gNRegions; i++)
+      FreeZoneGrid(&(grids[i]));
+   free(grids);
+   if(nbrs  != NULL) free(nbrs);
+   if(found != NULL) free(found);
+
+   if(!ok)
+      ClearContacts(job);
+   return(ok);
+}
+
+
+/************************************************************************/
+/*>BOOL FindZoneContacts(FILEJOB *job, ZONEGRID *g1, ZONEGRID *g2, 
+                         int *nbrs, RESCONTACT *found)
+   ---------------------------------------------------------------
+   Input:   ZONEGRID   *g1     Grid of the first region
+            ZONEGRID   *g2     Grid of the second region
+            int        *nbrs   Workspace (g2->nRes long)
+            RESCONTACT *found  Workspace (g2->nRes long)
+   I/O:     FILEJOB    *job    Job in which to store the contacts
+   Returns: BOOL               Success (FALSE if out of memory)
+
+   Stores the contacts between two regions. For each residue of the 
+   first region, the residues of the second region in the grid cells 
+   within reach are tested by bounding sphere and then by 
+   FirstResContact(). The contacts found for the residue are sorted by
+   their first contacting atom pair and stored in that order, which is
+   the order in which an atom against atom scan would first find them.
+
+   16.10.26 Original (from DoContactAnalysis())   By: agent
+   16.10.26 Works residue against residue   By: agent
+*/
+BOOL FindZoneContacts(FILEJOB *job, ZONEGRID *g1, ZONEGRID *g2, 
+                      int *nbrs, RESCONTACT *found)
+{
+   REAL cutoff = sqrt(gDistSqMax);
+   int  i, k, nNbrs, nFound;
+
+   for(i=0; i<g1->nRes; i++)
+   {
+      REAL x     = g1->resX[i],
+           y     = g1->resY[i],
+           z     = g1->resZ[i],
+           reach = g1->resRad[i] + cutoff;
+      int  ix, iy, iz, jx, jy, jz, kx, ky, kz;
+      
+      /* Skip residues too far from the other region's bounding box     */
+      if((x < g2->xmin - reach) || (x > g2->xmax + reach) ||
+         (y < g2->ymin - reach) || (y > g2->ymax + reach) ||
+         (z < g2->zmin - reach) || (z > g2->zmax + reach))
+         continue;
+
+      /* Collect the residues in cells within reach whose bounding 
+         spheres are within the contact distance
+      */
+      reach += g2->maxRad;
+      ix = MAX((int)floor((x - reach - g2->xmin) / g2->cellSize), 0);
+      iy = MAX((int)floor((y - reach - g2->ymin) / g2->cellSize), 0);
+      iz = MAX((int)floor((z - reach - g2->zmin) / g2->cellSize), 0);
+      kx = MIN((int)floor((x + reach - g2->xmin) / g2->cellSize), g2->nx-1);
+      ky = MIN((int)floor((y + reach - g2->ymin) / g2->cellSize), g2->ny-1);
+      kz = MIN((int)floor((z + reach - g2->zmin) / g2->cellSize), g2->nz-1);
+
+      nNbrs = 0;
+      for(jx=ix; jx<=kx; jx++)
+      {
+         for(jy=iy; jy<=ky; jy++)
+         {
+            for(jz=iz; jz<=kz; jz++)
+            {
+               for(k=g2->cellHead[CELLINDEX(g2, jx, jy, jz)];
+                   k>=0;
+                   k=g2->resNext[k])
+               {
+                  REAL dx   = x - g2->resX[k],
+                       dy   = y - g2->resY[k],
+                       dz   = z - g2->resZ[k],
+                       dmax = g1->resRad[i] + g2->resRad[k] + cutoff;
+                  
+                  if((dx*dx + dy*dy + dz*dz) <= dmax * dmax)
+                     nbrs[nNbrs++] = k;
+               }
+            }
+         }
+      }
+      if(nNbrs > 1)
+         qsort(nbrs, nNbrs, sizeof(int), CompareInts);
+
+      /* Find the first contacting atom pair with each                  */
+      nFound = 0;
+      for(k=0; k<nNbrs; k++)
+      {
+         if(FirstResContact(g1, i, g2, nbrs[k], &(found[nFound])))
+            nFound++;
+      }
+      if(nFound > 1)
+         qsort(found, nFound, sizeof(RESCONTACT), CompareResContacts);
+
+      for(k=0; k<nFound; k++)
+      {
+         PDB *p = g1->atoms[found[k].p],
+             *q = g2->atoms[found[k].q];
+         
+         /* Store the contact (i.e. the pair of residues                */
+         if(!StoreContact(job, p, q))
+            return(FALSE);
+
+         /* Store the contacting residues separately                    */
+         if(!StoreCRes(job, p))
+            return(FALSE);
+         if(!StoreCRes(job, q))
+            return(FALSE);
+      }
+   }
+
+   return(TRUE);
+}
+
+
+/************************************************************************/
+/*>BOOL FirstResContact(ZONEGRID *g1, int res1, ZONEGRID *g2, int res2,
+                        RESCONTACT *found)
+   --------------------------------------------------------------------
+   Input:   ZONEGRID   *g1     Grid of the first region
+            int        res1    Residue in the first region
+            ZONEGRID   *g2     Grid of the second region
+            int        res2    Residue in the second region
+   Output:  RESCONTACT *found  First contacting atom pair
+   Returns: BOOL               Do the residues make contact?
+
+   Tests the atoms of two residues in list order, stopping at the first
+   pair in contact. Atoms of the first residue outside the second 
+   residue's bounding sphere expanded by the contact distance are 
+   skipped.
+
+   16.10.26 Original   By: agent
+*/
+BOOL FirstResContact(ZONEGRID *g1, int res1, ZONEGRID *g2, int res2,
+                     RESCONTACT *found)
+{
+   REAL reach = g2->resRad[res2] + sqrt(gDistSqMax);
+   int  i, j;
+
+   reach *= reach;
+   for(i=g1->resStart[res1]; i<g1->resStart[res1+1]; i++)
+   {
+      PDB  *p  = g1->atoms[i];
+      REAL dx  = p->x - g2->resX[res2],
+           dy  = p->y - g2->resY[res2],
+           dz  = p->z - g2->resZ[res2];
+
+      if((dx*dx + dy*dy + dz*dz) > reach)
+         continue;
+
+      for(j=g2->resStart[res2]; j<g2->resStart[res2+1]; j++)
+      {
+         if(DISTSQ(p, g2->atoms[j]) <= gDistSqMax)
+         {
+            found->p = i;
+            found->q = j;
+            return(TRUE);
+         }
+      }
+   }
+   
+   return(FALSE);
+}
+
+
+/************************************************************************/
+/*>BOOL BuildZoneGrid(ZONE *zone, ZONEGRID *grid)
+   ----------------------------------------------
+   Input:   ZONE     *zone     Region of a PDB file
+   Output:  ZONEGRID *grid     Grid of the region's residues
+   Returns: BOOL               Success (FALSE if out of memory)
+
+   Finds the residue boundaries, the bounding sphere of each residue 
+   and the bounding box of the region, then bins the residues by centre
+   into a grid of cubic cells. Cells are the contact distance plus 
+   twice the largest residue radius across, increased if there would be
+   more than MAXCELLS cells. An empty region gives a grid with no atoms.
+
+   16.10.26 Original   By: agent
+   16.10.26 Grids residues rather than atoms   By: agent
+*/
+BOOL BuildZoneGrid(ZONE *zone, ZONEGRID *grid)
+{
+   PDB    *p;
+   RESKEY lastRes = 0;
+   int    nCells,
+          i, r;
+
+   grid->atoms    = NULL;
+   grid->resX     = grid->resY = grid->resZ = grid->resRad = NULL;
+   grid->resStart = NULL;
+   grid->cellHead = NULL;
+   grid->resNext  = NULL;
+   grid->nAtoms   = grid->nRes = 0;
+   grid->maxRad   = (REAL)0.0;
+
+   /* Count the atoms and residues                                      */
+   for(p=zone->start; p!=zone->end; NEXT(p))
+   {
+      RESKEY res = PDBResKey(p);
+      if((grid->nAtoms == 0) || (res != lastRes))
+         grid->nRes++;
+      lastRes = res;
+      grid->nAtoms++;
+   }
+   if(grid->nAtoms == 0)
+      return(TRUE);
+
+   if(((grid->atoms  = (PDB **)malloc(grid->nAtoms * sizeof(PDB *)))
+       ==NULL) ||
+      ((grid->resStart = (int *)malloc((grid->nRes+1) * sizeof(int)))
+       ==NULL) ||
+      ((grid->resNext  = (int *)malloc(grid->nRes * sizeof(int)))==NULL) ||
+      ((grid->resX   = (REAL *)malloc(grid->nRes * sizeof(REAL)))==NULL) ||
+      ((grid->resY   = (REAL *)malloc(grid->nRes * sizeof(REAL)))==NULL) ||
+      ((grid->resZ   = (REAL *)malloc(grid->nRes * sizeof(REAL)))==NULL) ||
+      ((grid->resRad = (REAL *)malloc(grid->nRes * sizeof(REAL)))==NULL))
+      return(FALSE);
+   
+   /* Store the atoms and residue boundaries and find the bounding box  */
+   grid->xmin = grid->xmax = zone->start->x;
+   grid->ymin = grid->ymax = zone->start->y;
+   grid->zmin = grid->zmax = zone->start->z;
+   for(p=zone->start, i=0, r=0; p!=zone->end; NEXT(p), i++)
+   {
+      RESKEY res = PDBResKey(p);
+      if((i == 0) || (res != lastRes))
+         grid->resStart[r++] = i;
+      lastRes = res;
+      
+      grid->atoms[i] = p;
+      if(p->x < grid->xmin) grid->xmin = p->x;
+      if(p->y < grid->ymin) grid->ymin = p->y;
+      if(p->z < grid->zmin) grid->zmin = p->z;
+      if(p->x > grid->xmax) grid->xmax = p->x;
+      if(p->y > grid->ymax) grid->ymax = p->y;
+      if(p->z > grid->zmax) grid->zmax = p->z;
+   }
+   grid->resStart[grid->nRes] = grid->nAtoms;
+
+   /* Residue centres and bounding sphere radii                         */
+   for(r=0; r<grid->nRes; r++)
+   {
+      REAL x = (REAL)0.0, y = (REAL)0.0, z = (REAL)0.0,
+           radSq = (REAL)0.0;
+      int  n = grid->resStart[r+1] - grid->resStart[r];
+      
+      for(i=grid->resStart[r]; i<grid->resStart[r+1]; i++)
+      {
+         x += grid->atoms[i]->x;
+         y += grid->atoms[i]->y;
+         z += grid->atoms[i]->z;
+      }
+      x /= n;
+      y /= n;
+      z /= n;
+      for(i=grid->resStart[r]; i<grid->resStart[r+1]; i++)
+      {
+         REAL dx = grid->atoms[i]->x - x,
+              dy = grid->atoms[i]->y - y,
+              dz = grid->atoms[i]->z - z;
+         if((dx*dx + dy*dy + dz*dz) > radSq)
+            radSq = dx*dx + dy*dy + dz*dz;
+      }
+
+      grid->resX[r]   = x;
+      grid->resY[r]   = y;
+      grid->resZ[r]   = z;
+      grid->resRad[r] = sqrt(radSq) + RADSLACK;
+      if(grid->resRad[r] > grid->maxRad)
+         grid->maxRad = grid->resRad[r];
+   }
+
+   /* Choose the grid dimensions                                        */
+   grid->cellSize = MAX(sqrt(gDistSqMax) + 2.0 * grid->maxRad, 
+                        MINCELLSIZE);
+   do
+   {
+      grid->nx = 1 + (int)((grid->xmax - grid->xmin) / grid->cellSize);
+      grid->ny = 1 + (int)((grid->ymax - grid->ymin) / grid->cellSize);
+      grid->nz = 1 + (int)((grid->zmax - grid->zmin) / grid->cellSize);
+      if(((double)grid->nx * grid->ny * grid->nz) <= (double)MAXCELLS)
+         break;
+      grid->cellSize *= 2.0;
+   }  while(TRUE);
+   nCells = grid->nx * grid->ny * grid->nz;
+
+   if((grid->cellHead = (int *)malloc(nCells * sizeof(int)))==NULL)
+      return(FALSE);
+
+   /* Bin the residues. Centres lie inside the bounding box             */
+   for(i=0; i<nCells; i++)
+      grid->cellHead[i] = -1;
+   for(r=0; r<grid->nRes; r++)
+   {
+      int ix = MIN((int)((grid->resX[r] - grid->xmin) / grid->cellSize),
+                   grid->nx - 1),
+          iy = MIN((int)((grid->resY[r] - grid->ymin) / grid->cellSize),
+                   grid->ny - 1),
+          iz = MIN((int)((grid->resZ[r] - grid->zmin) / grid->cellSize),
+                   grid->nz - 1);
+
+      nCells = CELLINDEX(grid, MAX(ix, 0), MAX(iy, 0), MAX(iz, 0));
+      grid->resNext[r]       = grid->cellHead[nCells];
+      grid->cellHead[nCells] = r;
+   }
+
+   return(TRUE);
+}
+
+
+/************************************************************************/
+/*>void FreeZoneGrid(ZONEGRID *grid)
+   ---------------------------------
+   I/O:     ZONEGRID *grid     Grid whose arrays are freed
+
+   16.10.26 Original   By: agent
+*/
+void FreeZoneGrid(ZONEGRID *grid)
+{
+   if(grid->atoms    != NULL) free(grid->atoms);
+   if(grid->resX     != NULL) free(grid->resX);
+   if(grid->resY     != NULL) free(grid->resY);
+   if(grid->resZ     != NULL) free(grid->resZ);
+   if(grid->resRad   != NULL) free(grid->resRad);
+   if(grid->resStart != NULL) free(grid->resStart);
+   if(grid->cellHead != NULL) free(grid->cellHead);
+   if(grid->resNext  != NULL) free(grid->resNext);
+}
+
+
+/************************************************************************/
+/*>int CompareInts(const void *a, const void *b)
+   ---------------------------------------------
+   qsort() comparison function for ints
+
+   16.10.26 Original   By: agent
+*/
+int CompareInts(const void *a, const void *b)
+{
+   int i = *(const int *)a,
+       j = *(const int *)b;
+   
+   return((i < j) ? -1 : ((i > j) ? 1 : 0));
+}
+
+
+/************************************************************************/
+/*>void ClearContacts(FILEJOB *job)
+   --------------------------------
+   Empties the contact table which is used to store contacts for a single
+   protein.
+
+   25.09.96 Original   By: ACRM
+   01.10.96 Also frees the list of residues which make contact
+   16.10.26 Empties the hash tables rather than freeing lists  By: agent
+   16.10.26 Empties the job's tables   By: agent
+*/
+void ClearContacts(FILEJOB *job)
+{
+   int i;
+   
+   for(i=0; i<job->contacts.nSlots; i++)
+      job->contacts.slots[i] = EMPTYSLOT;
+   job->contacts.nItems = 0;
+
+   for(i=0; i<job->cResList.nSlots; i++)
+      job->cResList.slots[i] = EMPTYSLOT;
+   job->cResList.nItems = 0;
+}
+
+
+/************************************************************************/
+/*>BOOL StoreContact(FILEJOB *job, PDB *p, PDB *q)
+   -----------------------------------------------
+   Store a contact between two residues into the table of contacts.
+   The contact is stored in both directions.
+
+   We set the counts to zero here since we are just storing a list of
+   what makes contact; we're not using any counts yet
+
+   25.09.96 Original   By: ACRM
+   16.10.26 Uses the job's contact hash table   By: agent
+*/
+BOOL StoreContact(FILEJOB *job, PDB *p, PDB *q)
+{
+   RESKEY res1 = PDBResKey(p),
+          res2 = PDBResKey(q);
+
+   if(GotContact(res1, res2, &(job->contacts))!=NULL)
+      return(TRUE);
+
+   /* Store the 1->2 and 2->1 contacts                                  */
+   if((AddContact(res1, res2, &(job->contacts))==NULL) ||
+      (AddContact(res2, res1, &(job->contacts))==NULL))
+      return(FALSE);
+
+   return(TRUE);
+}
+
+
+/************************************************************************/
+/*>void DisplayContacts(FILE *out, CONTACTTABLE *clist, REAL cutoff)
+   -----------------------------------------------------------------
+   Displays the contact list such that all contacts made from a given
+   residue are grouped. The contacts are only displayed if the fraction
+   of contacts made is greater than the specified cutoff
+
+   The groups are in the order that their first residue was first seen
+   and each group is chained through next[] in storage order.
+
+   25.09.96 Original   By: ACRM
+   01.10.96 Doesn't print percentages if they are 0.00
+   16.10.26 Groups contacts using a hash table of first residues rather
+            than rescanning the list   By: agent
+*/
+void DisplayContacts(FILE *out, CONTACTTABLE *clist, REAL cutoff)
+{
+   RESTABLE groups;
+   CONTACT  *d;
+   int      *first = NULL,
+            *last  = NULL,
+            *next  = NULL,
+            count, count1, count2,
+            i, g;
+   REAL     perc;
+   BOOL     ok = TRUE;
+
+   if(clist->nItems == 0)
+      return;
+   
+   groups.items  = NULL;
+   groups.slots  = NULL;
+   groups.nItems = groups.maxItems = groups.nSlots = 0;
+   
+   if(((first = (int *)malloc(clist->nItems * sizeof(int)))==NULL) ||
+      ((last  = (int *)malloc(clist->nItems * sizeof(int)))==NULL) ||
+      ((next  = (int *)malloc(clist->nItems * sizeof(int)))==NULL))
+   {
+      ok = FALSE;
+   }
+
+   /* Chain together the contacts from each residue                     */
+   for(i=0; ok && i<clist->nItems; i++)
+   {
+      RESLIST *group;
+      
+      next[i] = -1;
+      if((group = InResList(clist->items[i].res1, &groups))==NULL)
+      {
+         if((group = AddRes(clist->items[i].res1, &groups))==NULL)
+         {
+            ok = FALSE;
+            break;
+         }
+         group->count = groups.nItems - 1;
+         first[group->count] = i;
+      }
+      else
+      {
+         next[last[group->count]] = i;
+      }
+      last[group->count] = i;
+   }
+
+   if(!ok)
+      fprintf(stderr,"No memory to display contacts\n");
+
+   for(g=0; ok && g<groups.nItems; g++)
+   {
+      for(i=first[g]; i>=0; i=next[i])
+      {
+         d = &(clist->items[i]);
+         
+         if((count1 = CountRes(d->res1))==0 || 
+            (count2 = CountRes(d->res2))==0)
+         {
+            count = 1;
+         }
+         else
+         {
+            count = MIN(count1, count2);
+         }
+         perc = (REAL)d->count/(REAL)count;
+
+         if(perc > cutoff)
+         {
+            char resspec1[16];
+
+            strcpy(resspec1, ResKeySpec(d->res1));
+            if(perc != (REAL)0.0)
+            {
+               fprintf(out,"%-5s makes contact with %-5s %.2f\n",
+                       resspec1, ResKeySpec(d->res2), perc);
+            }
+            else
+            {
+               fprintf(out,"%-5s makes contact with %-5s\n",
+                       resspec1, ResKeySpec(d->res2));
+            }
+         }
+      }
+   }
+
+   if(first != NULL)        free(first);
+   if(last  != NULL)        free(last);
+   if(next  != NULL)        free(next);
+   if(groups.items != NULL) free(groups.items);
+   if(groups.slots != NULL) free(groups.slots);
+}
+
+
+/************************************************************************/
+/*>BOOL UpdateTotals(FILEJOB *job)
+   -------------------------------
+   Updates the total contacts table with the contacts seen in this
+   individual protein. Also updates the total contacting residue table.
+
+   25.09.96 Original   By: ACRM
+   01.10.96 Added contacting residues list
+   16.10.26 Uses hash table lookups   By: agent
+   16.10.26 Takes the contacts from a job   By: agent
+*/
+BOOL UpdateTotals(FILEJOB *job)
+{
+   CONTACT *c, *t;
+   RESLIST *r, *rt;
+   int     i;
+   
+
+   for(i=0; i<job->contacts.nItems; i++)
+   {
+      c = &(job->contacts.items[i]);
+      
+      /* If we don't have it in the totals, create it                   */
+      if((t=GotContact(c->res1, c->res2, &gTotal))==NULL)
+      {
+         if((t=AddContact(c->res1, c->res2, &gTotal))==NULL)
+            return(FALSE);
+      }
+      (t->count)++;
+   }
+
+   for(i=0; i<job->cResList.nItems; i++)
+   {
+      r = &(job->cResList.items[i]);
+
+      /* If we don't have it in the totals, create it                   */
+      if((rt=InResList(r->res, &gCRTotal))==NULL)
+      {
+         if((rt=AddRes(r->res, &gCRTotal))==NULL)
+            return(FALSE);
+      }
+      (rt->count)++;
+   }
+
+   return(TRUE);
+}
+
+
+/************************************************************************/
+/*>CONTACT *GotContact(RESKEY res1, RESKEY res2, CONTACTTABLE *clist)
+   ------------------------------------------------------------------
+   Looks in a table of contacts to see if a particular contact is
+   already found there. If found, the pointer into the table is 
+   returned; if not, returns NULL.
+
+   25.09.96 Original   By: ACRM
+   16.10.26 Hash table lookup   By: agent
+*/
+CONTACT *GotContact(RESKEY res1, RESKEY res2, CONTACTTABLE *clist)
+{
+   int slot;
+
+   if(clist->nSlots == 0)
+      return(NULL);
+   
+   slot = (int)((HashResKey(res1) * 31 + HashResKey(res2)) & 
+                (clist->nSlots - 1));
+   while(clist->slots[slot] != EMPTYSLOT)
+   {
+      CONTACT *c = &(clist->items[clist->slots[slot]]);
+      if((c->res1 == res1) && (c->res2 == res2))
+         return(c);
+      slot = (slot + 1) & (clist->nSlots - 1);
+   }
+   
+   return(NULL);
+}
+
+
+/************************************************************************/
+/*>CONTACT *AddContact(RESKEY res1, RESKEY res2, CONTACTTABLE *clist)
+   ------------------------------------------------------------------
+   Appends a contact to a table of contacts with a zero count, growing
+   the table as needed. Returns a pointer to the new contact, valid until
+   the next addition, or NULL if out of memory.
+
+   16.10.26 Original   By: agent
+*/
+CONTACT *AddContact(RESKEY res1, RESKEY res2, CONTACTTABLE *clist)
+{
+   CONTACT *c;
+   int     slot;
+
+   /* Grow the table keeping the index at most half full                */
+   if(clist->nItems >= clist->maxItems)
+   {
+      int maxItems = (clist->maxItems) ? 2 * clist->maxItems 
+                                       : TABLEQUANTUM,
+          *slots,
+          i;
+      
+      if((c = (CONTACT *)realloc(clist->items, 
+                                 maxItems * sizeof(CONTACT)))==NULL)
+         return(NULL);
+      clist->items = c;
+      if((slots = MakeSlots(2 * maxItems))==NULL)
+         return(NULL);
+      if(clist->slots != NULL)
+         free(clist->slots);
+      clist->slots    = slots;
+      clist->nSlots   = 2 * maxItems;
+      clist->maxItems = maxItems;
+
+      for(i=0; i<clist->nItems; i++)
+      {
+         c    = &(clist->items[i]);
+         slot = (int)((HashResKey(c->res1) * 31 + HashResKey(c->res2)) &
+                      (clist->nSlots - 1));
+         while(clist->slots[slot] != EMPTYSLOT)
+            slot = (slot + 1) & (clist->nSlots - 1);
+         clist->slots[slot] = i;
+      }
+   }
+
+   slot = (int)((HashResKey(res1) * 31 + HashResKey(res2)) & 
+                (clist->nSlots - 1));
+   while(clist->slots[slot] != EMPTYSLOT)
+      slot = (slot + 1) & (clist->nSlots - 1);
+   clist->slots[slot] = clist->nItems;
+
+   c = &(clist->items[(clist->nItems)++]);
+   c->res1  = res1;
+   c->res2  = res2;
+   c->count = 0;
+   
+   return(c);
+}
+
+
+/************************************************************************/
+/*>RESLIST *InResList(RESKEY res, RESTABLE *rlist)
+   -----------------------------------------------
+   Looks to see if a particular residue is seen in a table of residue
+   counts. If found, returns a pointer to that item in the table; 
+   returns NULL if not found.
+
+   30.09.96 Original   By: ACRM
+   01.10.96 Added rlist as a parameter
+            Changed other input to rspec rather than a PDB pointer
+   16.10.26 Hash table lookup of a packed residue id   By: agent
+*/
+RESLIST *InResList(RESKEY res, RESTABLE *rlist)
+{
+   int slot;
+
+   if(rlist->nSlots == 0)
+      return(NULL);
+   
+   slot = (int)(HashResKey(res) & (rlist->nSlots - 1));
+   while(rlist->slots[slot] != EMPTYSLOT)
+   {
+      RESLIST *l = &(rlist->items[rlist->slots[slot]]);
+      if(l->res == res)
+         return(l);
+      slot = (slot + 1) & (rlist->nSlots - 1);
+   }
+   return(NULL);
+}
+
+
+/************************************************************************/
+/*>RESLIST *AddRes(RESKEY res, RESTABLE *rlist)
+   --------------------------------------------
+   Appends a residue to a table of residue counts with a zero count, 
+   growing the table as needed. Returns a pointer to the new item, valid
+   until the next addition, or NULL if out of memory.
+
+   16.10.26 Original   By: agent
+*/
+RESLIST *AddRes(RESKEY res, RESTABLE *rlist)
+{
+   RESLIST *l;
+   int     slot;
+
+   /* Grow the table keeping the index at most half full                */
+   if(rlist->nItems >= rlist->maxItems)
+   {
+      int maxItems = (rlist->maxItems) ? 2 * rlist->maxItems 
+                                       : TABLEQUANTUM,
+          *slots,
+          i;
+      
+      if((l = (RESLIST *)realloc(rlist->items, 
+                                 maxItems * sizeof(RESLIST)))==NULL)
+         return(NULL);
+      rlist->items = l;
+      if((slots = MakeSlots(2 * maxItems))==NULL)
+         return(NULL);
+      if(rlist->slots != NULL)
+         free(rlist->slots);
+      rlist->slots    = slots;
+      rlist->nSlots   = 2 * maxItems;
+      rlist->maxItems = maxItems;
+
+      for(i=0; i<rlist->nItems; i++)
+      {
+         slot = (int)(HashResKey(rlist->items[i].res) & 
+                      (rlist->nSlots - 1));
+         while(rlist->slots[slot] != EMPTYSLOT)
+            slot = (slot + 1) & (rlist->nSlots - 1);
+         rlist->slots[slot] = i;
+      }
+   }
+
+   slot = (int)(HashResKey(res) & (rlist->nSlots - 1));
+   while(rlist->slots[slot] != EMPTYSLOT)
+      slot = (slot + 1) & (rlist->nSlots - 1);
+   rlist->slots[slot] = rlist->nItems;
+
+   l = &(rlist->items[(rlist->nItems)++]);
+   l->res   = res;
+   l->count = 0;
+   
+   return(l);
+}
+
+
+/************************************************************************/
+/*>int *MakeSlots(int nSlots)
+   --------------------------
+   Allocates an empty hash table index
+
+   16.10.26 Original   By: agent
+*/
+int *MakeSlots(int nSlots)
+{
+   int *slots,
+       i;
+
+   if((slots = (int *)malloc(nSlots * sizeof(int)))!=NULL)
+   {
+      for(i=0; i<nSlots; i++)
+         slots[i] = EMPTYSLOT;
+   }
+   return(slots);
+}
+
+
+/************************************************************************/
+/*>unsigned long HashResKey(RESKEY res)
+   ------------------------------------
+   Scrambles a packed residue id so that neighbouring residue numbers 
+   spread over the table
+
+   16.10.26 Original   By: agent
+*/
+unsigned long HashResKey(RESKEY res)
+{
+   res  = (res & 0xFFFFFFFFUL) * 2654435761UL;
+   res ^= (res >> 15) & 0x1FFFFUL;
+   return(res & 0xFFFFFFFFUL);
+}
+
+
+/************************************************************************/
+/*>int CountRes(RESKEY res)
+   ------------------------
+   Returns the residue count from the table of counts for each
+   residue for a given residue.
+
+   30.09.96 Original   By: ACRM
+   16.10.26 Hash table lookup   By: agent
+*/
+int CountRes(RESKEY res)
+{
+   RESLIST *l;
+
+   if((l=InResList(res, &gResList))!=NULL)
+      return(l->count);
+   
+   return(0);
+}
+
+
+/************************************************************************/
+/*>RESKEY PDBResKey(PDB *p)
+   ------------------------
+   Packs the chain, residue number and insert code of a PDB pointer into
+   a residue id. Blank chain and insert codes are stored as spaces.
+
+   16.10.26 Original   By: agent
+*/
+RESKEY PDBResKey(PDB *p)
+{
+   unsigned char chain  = (unsigned char)p->chain[0],
+                 insert = (unsigned char)p->insert[0];
+
+   if(chain  == '\0') chain  = ' ';
+   if(insert == '\0') insert = ' ';
+
+   return(((RESKEY)chain << 24) | ((RESKEY)insert << 16) |
+          ((RESKEY)p->resnum & 0xFFFF));
+}
+
+
+/************************************************************************/
+/*>char *ResKeySpec(RESKEY res)
+   ----------------------------
+   Builds a residue spec of the form [c]nnn[i] from a packed residue id
+
+   30.09.96 Original (PDBResSpec())   By: ACRM
+   16.10.26 Works from a packed residue id   By: agent
+*/
+char *ResKeySpec(RESKEY res)
+{
+   static char rspec[16];
+   char        chain[2],
+               insert[2];
+
+   chain[0]  = RESKEY_CHAIN(res);
+   chain[1]  = '\0';
+   if(chain[0] == ' ')
+      chain[0] = '\0';
+
+   insert[0] = RESKEY_INSERT(res);
+   insert[1] = '\0';
    if(insert[0] == ' ')
       insert[0] = '\0';
-   else
-      insert[1] = '\0';
    
-   sprintf(rspec,"%s%d%s",chain,p->resnum,insert);
+   sprintf(rspec,"%s%d%s",chain,RESKEY_RESNUM(res),insert);
 
    return(rspec);
 }
@@ -1051,12 +2616,24 @@ char *PDBResSpec(PDB *p)
 
    30.09.96 Original   By: ACRM
    14.11.14 Updated for V1.2
+   16.10.26 Updated for V1.4   By: agent
+   16.10.26 Added -c   By: agent
+   16.10.26 Added -m   By: agent
 */
 void Usage(void)
 {
-   fprintf(stderr,"\nregioncontacts V1.2 (c) 1996-2014, Dr. Andrew C.R. \
+   fprintf(stderr,"\nregioncontacts V1.8 (c) 1996-2026, Dr. Andrew C.R. \
 Martin, UCL\n");
-   fprintf(stderr,"Usage: regioncontacts [controlfile [outputfile]]\n");
+   fprintf(stderr,"Usage: regioncontacts [-j n] [-c cachedir] \
+[-m matrixfile]\n");
+   fprintf(stderr,"                      [controlfile [outputfile]]\n");
+   fprintf(stderr,"       -j Number of threads used to analyse the PDB \
+files [1]\n");
+   fprintf(stderr,"       -c Directory in which to cache the results \
+for each PDB file\n");
+   fprintf(stderr,"       -m Write the per-file and summary contacts to \
+a binary sparse\n");
+   fprintf(stderr,"          matrix file\n");
 
    fprintf(stderr,"\nregioncontacts examines contacts between residues in \
 a set of regions in\n");
@@ -1106,63 +2683,46 @@ cutoff) and exits\n");
 
 
 /************************************************************************/
-/*>BOOL StoreCRes(PDB *p)
-   ----------------------
-   Store a residues which makes a contact into a linked list of 
-   contacting residues.
+/*>BOOL StoreCRes(FILEJOB *job, PDB *p)
+   ------------------------------------
+   Store a residue which makes a contact into the table of contacting
+   residues.
 
    We keep a count of how many contacts are made, though this isn't
    used...
 
    01.10.96 Original   By: ACRM
+   16.10.26 Uses the job's residue hash table   By: agent
 */
-BOOL StoreCRes(PDB *p)
+BOOL StoreCRes(FILEJOB *job, PDB *p)
 {
-   static RESLIST *c, *r;
+   RESKEY  res = PDBResKey(p);
+   RESLIST *r;
 
-   /* See if p is in the contacting residue list                        */
-   if((r=InResList(PDBResSpec(p), gCResList))!=NULL)
-   {
-      /* Yes, increment the count                                       */
-      (r->count)++;
-   }
-   else
+   /* See if p is in the contacting residue table, adding it if not     */
+   if((r=InResList(res, &(job->cResList)))==NULL)
    {
-      /* No, allocate space and add to list                             */
-      if(gCResList == NULL)
-      {
-         INIT(gCResList, RESLIST);
-         c = gCResList;
-      }
-      else
-      {
-         ALLOCNEXT(c, RESLIST);
-      }
-      if(c==NULL)
-      {
-         FREELIST(gCResList, RESLIST);
+      if((r=AddRes(res, &(job->cResList)))==NULL)
          return(FALSE);
-      }
-
-      /* Add to list                                                    */
-      strcpy(c->res, PDBResSpec(p));
-      c->count = 1;
    }
+   (r->count)++;
    
    return(TRUE);
 }
 
 
 /************************************************************************/
-void DisplayReslist(FILE *out, RESLIST *rlist, REAL cutoff)
+void DisplayReslist(FILE *out, RESTABLE *rlist, REAL cutoff)
 {
    RESLIST *r;
-   int     count;
+   int     count,
+           i;
    REAL    perc;
 
    
-   for(r=rlist; r!=NULL; NEXT(r))
+   for(i=0; i<rlist->nItems; i++)
    {
+      r = &(rlist->items[i]);
       if((count = CountRes(r->res))==0)
       {
          count = 1;
@@ -1172,8 +2732,28 @@ void DisplayReslist(FILE *out, RESLIST *rlist, REAL cutoff)
       if(perc > cutoff)
       {
          fprintf(out,"%-5s makes a contact %.2f\n",
-                 r->res, perc);
+                 ResKeySpec(r->res), perc);
       }
    }
 }
 
+
+/************************************************************************/
+/*>int CompareResContacts(const void *a, const void *b)
+   ----------------------------------------------------
+   qsort() comparison function to sort residue contacts by their first
+   contacting atom pair
+
+   16.10.26 Original   By: agent
+*/
+int CompareResContacts(const void *a, const void *b)
+{
+   const RESCONTACT *c1 = (const RESCONTACT *)a,
+                    *c2 = (const RESCONTACT *)b;
+
+   if(c1->p != c2->p)
+      return((c1->p < c2->p) ? -1 : 1);
+   if(c1->q != c2->q)
+      return((c1->q < c2->q) ? -1 : 1);
+   return(0);
+}
@@ -0,0 +1,263 @@
+/************************************************************************/
+/**
+
+   \file       resindex.c
+   
+   \version    V1.0
+   \date       16.10.26
+   \brief      Hashed index of the residues in a PDB linked list
+   
+   \copyright  (c) UCL / Prof. Andrew C. R. Martin 2026
+   \author     Prof. Andrew C. R. Martin
+   \par
+               Institute of Structural & Molecular Biology,
+               University College,
+               Gower Street,
+               London.
+               WC1E 6BT.
+   \par
+               andrew@bioinf.org.uk
+               andrew.martin@ucl.ac.uk
+               
+**************************************************************************
+
+   This program is not in the public domain, but it may be copied
+   according to the conditions laid out in the accompanying file
+   COPYING.DOC
+
+   The code may be modified as required, but any modifications must be
+   documented so that the person responsible can be identified.
+
+   The code may not be sold commercially or included as part of a 
+   commercial product except as described in the file COPYING.DOC.
+
+**************************************************************************
+
+   Description:
+   ============
+   Shared by calcpdbdistance, getresidue and protrusion to answer many
+   residue lookups from one read of a PDB file. blFindResidueSpec() 
+   walks the atom list for every lookup; the index is built in one pass
+   and each lookup then only examines the residues in one hash bucket.
+
+   Where the same residue identifier appears more than once, the index
+   returns the first occurrence, as blFindResidueSpec() does.
+
+**************************************************************************
+
+   Revision History:
+   =================
+-  V1.0  16.10.26 Original   By: agent
+
+*************************************************************************/
+/* Includes
+*/
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "bioplib/macros.h"
+#include "bioplib/pdb.h"
+#include "resindex.h"
+
+/************************************************************************/
+/* Defines and macros
+*/
+#define MINBUCKETS 64
+
+/************************************************************************/
+/* Prototypes
+*/
+static unsigned int HashResidue(char *chain, int resnum, char *insert);
+static BOOL ResidueMatches(PDB *p, char *chain, int resnum, 
+                           char *insert);
+
+
+/************************************************************************/
+/*>RESINDEX *BuildResidueIndex(PDB *pdb)
+   -------------------------------------
+*//**
+   \param[in]   PDB       *pdb     PDB linked list
+   \return      RESINDEX*          The index (NULL if no memory)
+
+   Builds the residue index for a PDB linked list. The linked list must
+   not be changed while the index is in use.
+
+-  16.10.26 Original   By: agent
+**/
+RESINDEX *BuildResidueIndex(PDB *pdb)
+{
+   RESINDEX *index;
+   PDB      *p;
+   int      nRes = 0,
+            i;
+
+   if((index = (RESINDEX *)malloc(sizeof(RESINDEX)))==NULL)
+      return(NULL);
+
+   for(p=pdb; p!=NULL; p=blFindNextResidue(p))
+      nRes++;
+
+   /* At least twice as many buckets as residues                        */
+   for(index->nBuckets=MINBUCKETS; 
+       index->nBuckets < 2*nRes; 
+       index->nBuckets *= 2);
+
+   index->nRes       = 0;
+   index->start      = (PDB **)malloc((nRes+1) * sizeof(PDB *));
+   index->resNext    = (int *)malloc((nRes+1) * sizeof(int));
+   index->bucketHead = (int *)malloc(index->nBuckets * sizeof(int));
+   if((index->start == NULL) || (index->resNext == NULL) ||
+      (index->bucketHead == NULL))
+   {
+      FreeResidueIndex(index);
+      return(NULL);
+   }
+   for(i=0; i<index->nBuckets; i++)
+      index->bucketHead[i] = (-1);
+
+   for(p=pdb; p!=NULL; p=blFindNextResidue(p))
+   {
+      unsigned int bucket;
+
+      /* Keep only the first occurrence of a residue                    */
+      if(FindIndexedResidue(index, p->chain, p->resnum, p->insert) 
+         != NULL)
+         continue;
+
+      bucket = HashResidue(p->chain, p->resnum, p->insert) & 
+               (index->nBuckets - 1);
+      index->start[index->nRes]   = p;
+      index->resNext[index->nRes] = index->bucketHead[bucket];
+      index->bucketHead[bucket]   = index->nRes;
+      index->nRes++;
+   }
+   
+   return(index);
+}
+
+
+/************************************************************************/
+/*>void FreeResidueIndex(RESINDEX *index)
+   --------------------------------------
+*//**
+   \param[in]   RESINDEX  *index   Index to free
+
+   Frees a residue index. The PDB linked list is not freed.
+
+-  16.10.26 Original   By: agent
+**/
+void FreeResidueIndex(RESINDEX *index)
+{
+   if(index == NULL)
+      return;
+   if(index->start      != NULL) free(index->start);
+   if(index->resNext    != NULL) free(index->resNext);
+   if(index->bucketHead != NULL) free(index->bucketHead);
+   free(index);
+}
+
+
+/************************************************************************/
+/*>PDB *FindIndexedResidue(RESINDEX *index, char *chain, int resnum, 
+                           char *insert)
+   --------------------------------------------------------------------
+*//**
+   \param[in]   RESINDEX  *index   Residue index
+   \param[in]   char      *chain   Chain label
+   \param[in]   int       resnum   Residue number
+   \param[in]   char      *insert  Insert code
+   \return      PDB*               First atom of the residue (NULL if
+                                   not found)
+
+   Equivalent to blFindResidue() using the index
+
+-  16.10.26 Original   By: agent
+**/
+PDB *FindIndexedResidue(RESINDEX *index, char *chain, int resnum, 
+                        char *insert)
+{
+   int i;
+   
+   i = index->bucketHead[HashResidue(chain, resnum, insert) & 
+                         (index->nBuckets - 1)];
+   for(; i != (-1); i=index->resNext[i])
+   {
+      if(ResidueMatches(index->start[i], chain, resnum, insert))
+         return(index->start[i]);
+   }
+   
+   return(NULL);
+}
+
+
+/************************************************************************/
+/*>PDB *FindIndexedResidueSpec(RESINDEX *index, char *resspec)
+   -----------------------------------------------------------
+*//**
+   \param[in]   RESINDEX  *index   Residue index
+   \param[in]   char      *resspec Residue specification
+   \return      PDB*               First atom of the residue (NULL if
+                                   not found)
+
+   Equivalent to blFindResidueSpec() using the index
+
+-  16.10.26 Original   By: agent
+**/
+PDB *FindIndexedResidueSpec(RESINDEX *index, char *resspec)
+{
+   char chain[8],
+        insert[8];
+   int  resnum;
+
+   if(!blParseResSpec(resspec, chain, &resnum, insert))
+      return(NULL);
+   return(FindIndexedResidue(index, chain, resnum, insert));
+}
+
+
+/************************************************************************/
+/*>static unsigned int HashResidue(char *chain, int resnum, char *insert)
+   ----------------------------------------------------------------------
+*//**
+   \param[in]   char      *chain   Chain label
+   \param[in]   int       resnum   Residue number
+   \param[in]   char      *insert  Insert code
+   \return      unsigned int       Hash value
+
+   Only the first character of the insert code is used, since that is
+   all that blFindResidue() compares
+
+-  16.10.26 Original   By: agent
+**/
+static unsigned int HashResidue(char *chain, int resnum, char *insert)
+{
+   unsigned int hash = (unsigned int)resnum * 2654435761U;
+   char         *c;
+
+   for(c=chain; *c; c++)
+      hash = (hash ^ (unsigned char)*c) * 16777619U;
+   hash = (hash ^ (unsigned char)insert[0]) * 16777619U;
+   
+   return(hash ^ (hash >> 16));
+}
+
+
+/************************************************************************/
+/*>static BOOL ResidueMatches(PDB *p, char *chain, int resnum, 
+                              char *insert)
+   ---------------------------------------------------------------
+*//**
+   \param[in]   PDB       *p       Atom
+   \param[in]   char      *chain   Chain label
+   \param[in]   int       resnum   Residue number
+   \param[in]   char      *insert  Insert code
+   \return      BOOL               Is the atom in this residue?
+
+-  16.10.26 Original   By: agent
+**/
+static BOOL ResidueMatches(PDB *p, char *chain, int resnum, char *insert)
+{
+   return((p->resnum    == resnum)    &&
+          (p->insert[0] == insert[0]) &&
+          CHAINMATCH(p->chain, chain));
+}
@@ -0,0 +1,70 @@
+/************************************************************************/
+/**
+
+   \file       resindex.h
+   
+   \version    V1.0
+   \date       16.10.26
+   \brief      Hashed index of the residues in a PDB linked list
+   
+   \copyright  (c) UCL / Prof. Andrew C. R. Martin 2026
+   \author     Prof. Andrew C. R. Martin
+   \par
+               Institute of Structural & Molecular Biology,
+               University College,
+               Gower Street,
+               London.
+               WC1E 6BT.
+   \par
+               andrew@bioinf.org.uk
+               andrew.martin@ucl.ac.uk
+               
+**************************************************************************
+
+   This program is not in the public domain, but it may be copied
+   according to the conditions laid out in the accompanying file
+   COPYING.DOC
+
+   The code may be modified as required, but any modifications must be
+   documented so that the person responsible can be identified.
+
+   The code may not be sold commercially or included as part of a 
+   commercial product except as described in the file COPYING.DOC.
+
+**************************************************************************
+
+   Revision History:
+   =================
+-  V1.0  16.10.26 Original   By: agent
+
+*************************************************************************/
+#ifndef _RESINDEX_H
+#define _RESINDEX_H
+
+#include "bioplib/SysDefs.h"
+#include "bioplib/pdb.h"
+
+/************************************************************************/
+/* Index from chain/resnum/insert to the first atom of each residue. 
+   The residues are chained through the hash buckets by their number 
+   in the file
+*/
+typedef struct
+{
+   PDB  **start;        /* First atom of each residue                  */
+   int  *bucketHead,    /* First residue in each bucket (-1 if empty)  */
+        *resNext,       /* Next residue in the same bucket             */
+        nRes,
+        nBuckets;       /* Always a power of 2                         */
+}  RESINDEX;
+
+/************************************************************************/
+/* Prototypes
+*/
+RESINDEX *BuildResidueIndex(PDB *pdb);
+void FreeResidueIndex(RESINDEX *index);
+PDB *FindIndexedResidue(RESINDEX *index, char *chain, int resnum, 
+                        char *insert);
+PDB *FindIndexedResidueSpec(RESINDEX *index, char *resspec);
+
+#endif